@@ -0,0 +1,65 @@
+#include "../mpc.h"
+#include <time.h>
+
+static double time_parse(
+  int (*parse)(const char*, const char*, mpc_parser_t*, mpc_result_t*),
+  const char *input, mpc_parser_t *p) {
+
+  mpc_result_t r;
+  clock_t start = clock();
+
+  if (parse("<input>", input, p, &r)) {
+    mpc_ast_delete(r.output);
+  } else {
+    mpc_err_print(r.error);
+    mpc_err_delete(r.error);
+  }
+
+  return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char **argv) {
+
+  int i, depth, max = argc > 1 ? atoi(argv[1]) : 16;
+  char *input;
+
+  mpc_parser_t *Nest = mpc_new("nest");
+  mpc_parser_t *Top  = mpc_new("top");
+
+  /*
+  ** Each level tries the first alternative all the
+  ** way down before finding an 'a' where it wanted
+  ** a 'b', so the backtracking parser takes time
+  ** exponential in the depth of nesting.
+  */
+
+  mpca_lang(MPCA_LANG_DEFAULT,
+    " nest : '(' <nest> ')' 'b' | '(' <nest> ')' 'a' | 'x'; "
+    " top  : /^/ <nest> /$/;                                ",
+    Nest, Top, NULL);
+
+  printf("depth      mpc_parse   mpc_parse_earley\n");
+
+  for (depth = 1; depth <= max; depth++) {
+
+    input = malloc(depth * 3 + 2);
+    for (i = 0; i < depth; i++) { input[i] = '('; }
+    input[depth] = 'x';
+    for (i = 0; i < depth; i++) {
+      input[depth + 1 + i * 2 + 0] = ')';
+      input[depth + 1 + i * 2 + 1] = 'a';
+    }
+    input[depth * 3 + 1] = '\0';
+
+    printf("%5i  %12.6fs  %16.6fs\n", depth,
+      time_parse(mpc_parse, input, Top),
+      time_parse(mpc_parse_earley, input, Top));
+
+    free(input);
+  }
+
+  mpc_cleanup(2, Nest, Top);
+
+  return 0;
+
+}
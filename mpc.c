@@ -1,5 +1,50 @@
+/*
+** Memory mapping and scatter/gather input are
+** only available on POSIX systems. Define
+** `MPC_NO_MMAP` to disable memory mapping.
+*/
+
+#if defined(__unix__) || defined(__unix) || (defined(__APPLE__) && defined(__MACH__))
+#define MPC_POSIX
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+#endif
+
+#if defined(MPC_POSIX) && !defined(MPC_NO_MMAP)
+#define MPC_USE_MMAP
+#endif
+
+/*
+** Define `MPC_THREADED` when building with GCC or
+** Clang to have the interpreter use computed gotos
+** for dispatch. They are a GNU extension, so the
+** portable switch statement is used otherwise.
+*/
+
+#if defined(__GNUC__) && defined(MPC_THREADED)
+#define MPC_USE_THREADED
+#endif
+
 #include "mpc.h"
 
+#ifdef MPC_POSIX
+#include <sys/types.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef MPC_USE_MMAP
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+#ifdef MPC_PREFETCH
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 /*
 ** State Type
 */
@@ -26,6 +71,96 @@ static mpc_state_t *mpc_state_copy(mpc_state_t s) {
   return r;
 }
 
+/*
+** Label Type
+**
+** While parsing, each stack gives the labels it
+** meets a small id, which indexes sets of labels.
+** Labels with the same text get the same id, so
+** merging sets gives the same labels as comparing
+** each with `strcmp`. Ids are looked up by pointer,
+** only falling back on the text the first time a
+** pointer is seen, and are forgotten when the stack
+** is next reset, keeping the space the tables use.
+** Nothing is written to the parsers, so grammars can
+** be built and run in different threads. Labels
+** made up while parsing, such as those of
+** `mpc_many1`, are copied into the stack too.
+*/
+
+typedef struct {
+  int num;
+  unsigned long slots;
+  const char **keys;
+  int *ids;
+} mpc_labels_t;
+
+static unsigned long mpc_labels_hash(const char *s, int text) {
+  unsigned long h = 5381;
+  if (!text) {
+    h = (unsigned long)(size_t)s;
+    return h ^ (h >> 11);
+  }
+  while (*s) { h = h * 33 + (unsigned char)*s++; }
+  return h;
+}
+
+/* Finds the slot `s` is in, or the empty one it would go in */
+static unsigned long mpc_labels_slot(mpc_labels_t *t, const char *s, int text) {
+  unsigned long h = mpc_labels_hash(s, text) & (t->slots-1);
+  while (t->keys[h] && (text ? strcmp(t->keys[h], s) != 0 : t->keys[h] != s)) {
+    h = (h+1) & (t->slots-1);
+  }
+  return h;
+}
+
+static void mpc_labels_grow(mpc_labels_t *t, int text) {
+  
+  unsigned long j, h, slots = t->slots;
+  const char **keys = t->keys;
+  int *ids = t->ids;
+  
+  t->slots = slots ? slots * 2 : 64;
+  t->keys = calloc(t->slots, sizeof(char*));
+  t->ids = malloc(sizeof(int) * t->slots);
+  
+  for (j = 0; j < slots; j++) {
+    if (keys[j] == NULL) { continue; }
+    h = mpc_labels_slot(t, keys[j], text);
+    t->keys[h] = keys[j];
+    t->ids[h] = ids[j];
+  }
+  
+  free(keys);
+  free(ids);
+}
+
+/* Finds `s` in `t`, adding it with the id `id` if it isn't there */
+static unsigned long mpc_labels_find(mpc_labels_t *t, const char *s, int text, int id) {
+  
+  unsigned long h;
+  
+  if ((unsigned long)(t->num + 1) * 2 > t->slots) { mpc_labels_grow(t, text); }
+  
+  h = mpc_labels_slot(t, s, text);
+  if (t->keys[h] == NULL) {
+    t->keys[h] = s;
+    t->ids[h] = id;
+    t->num++;
+  }
+  return h;
+}
+
+static void mpc_labels_clear(mpc_labels_t *t) {
+  if (t->num) { memset(t->keys, 0, sizeof(char*) * t->slots); }
+  t->num = 0;
+}
+
+static void mpc_labels_free(mpc_labels_t *t) {
+  free(t->keys);
+  free(t->ids);
+}
+
 /*
 ** Error Type
 */
@@ -70,6 +205,28 @@ void mpc_err_delete(mpc_err_t *x) {
   free(x);
 }
 
+static mpc_err_t *mpc_err_copy(mpc_err_t *x) {
+  
+  int i;
+  mpc_err_t *e = malloc(sizeof(mpc_err_t));
+  e->filename = malloc(strlen(x->filename) + 1);
+  strcpy(e->filename, x->filename);
+  e->state = x->state;
+  e->expected_num = x->expected_num;
+  e->expected = malloc(sizeof(char*) * x->expected_num);
+  for (i = 0; i < x->expected_num; i++) {
+    e->expected[i] = malloc(strlen(x->expected[i]) + 1);
+    strcpy(e->expected[i], x->expected[i]);
+  }
+  e->failure = NULL;
+  if (x->failure) {
+    e->failure = malloc(strlen(x->failure) + 1);
+    strcpy(e->failure, x->failure);
+  }
+  e->recieved = x->recieved;
+  return e;
+}
+
 static int mpc_err_contains_expected(mpc_err_t *x, char *expected) {
   
   int i;
@@ -122,14 +279,13 @@ void mpc_err_string_cat(char *buffer, int *pos, int *max, char const *fmt, ...)
   va_end(va);
 }
 
-static char char_unescape_buffer[4];
-
-static const char *mpc_err_char_unescape(char c) {
+/* Plain characters are quoted in `buffer`, which needs room for four */
+static const char *mpc_err_char_unescape(char c, char *buffer) {
   
-  char_unescape_buffer[0] = '\'';
-  char_unescape_buffer[1] = ' ';
-  char_unescape_buffer[2] = '\'';
-  char_unescape_buffer[3] = '\0';
+  buffer[0] = '\'';
+  buffer[1] = ' ';
+  buffer[2] = '\'';
+  buffer[3] = '\0';
   
   switch (c) {
     
@@ -143,8 +299,8 @@ static const char *mpc_err_char_unescape(char c) {
     case '\t': return "tab";
     case ' ' : return "space";
     default:
-      char_unescape_buffer[1] = c;
-      return char_unescape_buffer;
+      buffer[1] = c;
+      return buffer;
   }
   
 }
@@ -155,6 +311,7 @@ char *mpc_err_string(mpc_err_t *x) {
   int pos = 0; 
   int max = 1023;
   char *buffer = calloc(1, 1024);
+  char unescaped[4];
   
   if (x->failure) {
     mpc_err_string_cat(buffer, &pos, &max,
@@ -179,7 +336,7 @@ char *mpc_err_string(mpc_err_t *x) {
   }
   
   mpc_err_string_cat(buffer, &pos, &max, " at ");
-  mpc_err_string_cat(buffer, &pos, &max, mpc_err_char_unescape(x->recieved));
+  mpc_err_string_cat(buffer, &pos, &max, mpc_err_char_unescape(x->recieved, unescaped));
   mpc_err_string_cat(buffer, &pos, &max, "\n");
   
   return realloc(buffer, strlen(buffer) + 1);
@@ -277,30 +434,60 @@ static mpc_err_t *mpc_err_count(mpc_err_t *x, int n) {
 */
 
 /*
-** In mpc the input type has three modes of 
-** operation: String, File and Pipe.
+** In mpc the input type has four modes of 
+** operation: String, Mmap, File and Pipe.
 **
 ** String is easy. The whole contents are 
-** loaded into a buffer and scanned through.
-** The cursor can jump around at will making 
-** backtracking easy.
+** already in a buffer and are scanned through
+** in place without being copied. The length
+** is given up front so the input may contain
+** null characters. The cursor can jump around
+** at will making backtracking easy.
+**
+** Mmap is the same as String, except the
+** buffer is a read only mapping of a regular
+** file. Nothing is copied onto the heap and
+** the operating system pages the contents in
+** as they are touched.
 **
-** The second is a File which is also somewhat
+** Iov is a list of buffers (`struct iovec`)
+** which are scanned through in place as if they
+** were one String. The offset of each buffer is
+** worked out up front and the current buffer is
+** remembered, so moving between neighbouring
+** buffers is constant time and jumping further
+** (on backtracking) is a binary search.
+**
+** The third is a File which is also somewhat
 ** easy. The contents are never loaded into 
-** memory but backtracking can still be achieved
-** by seeking in the file at different positions.
+** memory all at once but backtracking can still
+** be achieved by seeking in the file at different
+** positions. This is used when a file cannot be
+** mapped.
 **
 ** The final mode is Pipe. This is the difficult
-** one. As we assume pipes cannot be seeked - and 
-** only support a single character lookahead at 
-** any point, when the input is marked for a 
-** potential backtracking we start buffering any 
-** input.
+** one. As we assume pipes cannot be seeked, any
+** input read is appended to a buffer which is
+** kept for as long as it might be needed.
 **
 ** This means that if we are requested to seek
 ** back we can simply start reading from the
 ** buffer instead of the input.
 **
+** Input before the oldest mark can never be
+** returned to, so when the buffer fills up that
+** part is discarded and the rest moved down. The
+** buffer only grows (doubling in size) when more
+** than half of it is still in use. This keeps the
+** memory used bounded by the backtracking window
+** and the time spent copying linear in the input.
+**
+** User supplied sources (`mpc_source_t`) are
+** read in the same way as Files if they can seek
+** and in the same way as Pipes if they cannot.
+** Either way they are asked for whole blocks of
+** input at a time rather than single characters.
+**
 ** Of course using `mpc_predictive` will disable
 ** backtracking and make LL(1) grammars easy
 ** to parse for all input methods.
@@ -310,108 +497,462 @@ static mpc_err_t *mpc_err_count(mpc_err_t *x, int n) {
 enum {
   MPC_INPUT_STRING = 0,
   MPC_INPUT_FILE   = 1,
-  MPC_INPUT_PIPE   = 2
+  MPC_INPUT_PIPE   = 2,
+  MPC_INPUT_MMAP   = 3,
+  MPC_INPUT_IOV    = 4
 };
 
+/*
+** Files are read in pages of `MPC_INPUT_PAGE_SIZE`
+** bytes. A few recently used pages are kept so that
+** backtracking and lookahead are just an index into
+** one of them, and the file is only read (or seeked)
+** when the cursor moves onto a page not in the cache.
+*/
+
+#define MPC_INPUT_PAGE_SIZE 65536
+#define MPC_INPUT_PAGES 4
+#define MPC_INPUT_BLOCK_SIZE 4096
+
+typedef struct {
+  long index;
+  long len;
+  long used;
+  char *data;
+} mpc_input_page_t;
+
+/*
+** When `MPC_PREFETCH` is defined a helper thread can
+** read a stream ahead of the parser. It fills a ring
+** of `MPC_INPUT_PREFETCH_BLOCKS` pages which the Pipe
+** buffer takes from, so the parser only waits on the
+** stream when it has caught up with the reader.
+**
+** The reader uses `read` on the file descriptor and
+** waits in `poll` alongside a wakeup pipe, so that
+** deleting the input can stop it even while it is
+** blocked on a stream that has nothing to give.
+*/
+
+#define MPC_INPUT_PREFETCH_BLOCKS 3
+
+#ifdef MPC_PREFETCH
+
+typedef struct mpc_input_prefetch_t {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int fd;
+  int wake[2];
+  char *blocks[MPC_INPUT_PREFETCH_BLOCKS];
+  long lens[MPC_INPUT_PREFETCH_BLOCKS];
+  int head;
+  int count;
+  int ended;
+  int stop;
+} mpc_input_prefetch_t;
+
+#endif
+
 typedef struct {
 
   int type;
   char *filename;  
-  mpc_state_t state;
+  long pos;
   
-  char *string;
-  char *buffer;
+  const char *string;
   FILE *file;
+  mpc_source_t source;
+  struct mpc_input_prefetch_t *prefetch;
+  int ended;
+  
+  char *buffer;
+  long buffer_pos;
+  long buffer_len;
+  long buffer_slots;
+  
+  long length;
+  char *mapping;
+  long mapping_len;
+  
+  const struct iovec *segments;
+  long *segments_pos;
+  int segments_num;
+  int segment;
+  
+  long file_start;
+  long file_pos;
+  long page_tick;
+  mpc_input_page_t *page;
+  mpc_input_page_t pages[MPC_INPUT_PAGES];
+  
+  long *lines;
+  long lines_num;
+  long lines_slots;
+  long lines_base;
+  long lines_last;
+  long lines_upto;
+  long lines_hint;
+  int lines_segment;
+  
+  const char *window;
+  long window_pos;
+  long window_end;
   
   int backtrack;
   int marks_num;
-  mpc_state_t* marks;
+  int marks_slots;
+  long *marks;
   char* lasts;
   
   char last;
+  const char *error;
   
 } mpc_input_t;
 
-static mpc_input_t *mpc_input_new_string(const char *filename, const char *string) {
-
+static mpc_input_t *mpc_input_new(const char *filename, int type) {
+  
+  int j;
   mpc_input_t *i = malloc(sizeof(mpc_input_t));
   
   i->filename = malloc(strlen(filename) + 1);
   strcpy(i->filename, filename);
-  i->type = MPC_INPUT_STRING;
+  i->type = type;
   
-  i->state = mpc_state_new();
+  i->pos = 0;
   
-  i->string = malloc(strlen(string) + 1);
-  strcpy(i->string, string);
-  i->buffer = NULL;
+  i->string = NULL;
   i->file = NULL;
+  i->source.data = NULL;
+  i->source.read = NULL;
+  i->source.seek = NULL;
+  i->source.size = NULL;
+  i->prefetch = NULL;
+  i->ended = 0;
+  
+  i->buffer = NULL;
+  i->buffer_pos = 0;
+  i->buffer_len = 0;
+  i->buffer_slots = 0;
+  
+  i->length = 0;
+  i->mapping = NULL;
+  i->mapping_len = 0;
+  
+  i->segments = NULL;
+  i->segments_pos = NULL;
+  i->segments_num = 0;
+  i->segment = 0;
+  
+  i->file_start = 0;
+  i->file_pos = 0;
+  i->page_tick = 0;
+  i->page = &i->pages[0];
+  for (j = 0; j < MPC_INPUT_PAGES; j++) {
+    i->pages[j].index = -1;
+    i->pages[j].len = 0;
+    i->pages[j].used = 0;
+    i->pages[j].data = NULL;
+  }
+  
+  i->lines = NULL;
+  i->lines_num = 0;
+  i->lines_slots = 0;
+  i->lines_base = 0;
+  i->lines_last = -1;
+  i->lines_upto = 0;
+  i->lines_hint = 0;
+  i->lines_segment = 0;
+  
+  i->window = NULL;
+  i->window_pos = 0;
+  i->window_end = 0;
   
   i->backtrack = 1;
   i->marks_num = 0;
+  i->marks_slots = 0;
   i->marks = NULL;
   i->lasts = NULL;
 
   i->last = '\0';
+  i->error = NULL;
   
   return i;
 }
 
-static mpc_input_t *mpc_input_new_pipe(const char *filename, FILE *pipe) {
+static mpc_input_t *mpc_input_new_string(const char *filename, const char *string, long length) {
+  mpc_input_t *i = mpc_input_new(filename, MPC_INPUT_STRING);
+  i->string = string;
+  i->length = length;
+  i->window = string;
+  i->window_end = length;
+  return i;
+}
 
-  mpc_input_t *i = malloc(sizeof(mpc_input_t));
+/* Points a String input at some new string, keeping the space it has allocated */
+static void mpc_input_reset_string(mpc_input_t *i, const char *filename, const char *string, long length) {
   
-  i->filename = malloc(strlen(filename) + 1);
-  strcpy(i->filename, filename);
+  if (strcmp(i->filename, filename) != 0) {
+    i->filename = realloc(i->filename, strlen(filename) + 1);
+    strcpy(i->filename, filename);
+  }
   
-  i->type = MPC_INPUT_PIPE;
-  i->state = mpc_state_new();
+  i->pos = 0;
+  i->string = string;
+  i->length = length;
+  i->window = string;
+  i->window_pos = 0;
+  i->window_end = length;
   
-  i->string = NULL;
-  i->buffer = NULL;
-  i->file = pipe;
+  i->lines_num = 0;
+  i->lines_base = 0;
+  i->lines_last = -1;
+  i->lines_upto = 0;
+  i->lines_hint = 0;
+  i->lines_segment = 0;
   
   i->backtrack = 1;
   i->marks_num = 0;
-  i->marks = NULL;
-  i->lasts = NULL;
-  
   i->last = '\0';
-  
+}
+
+static mpc_input_t *mpc_input_new_pipe(const char *filename, FILE *pipe) {
+  mpc_input_t *i = mpc_input_new(filename, MPC_INPUT_PIPE);
+  i->file = pipe;
   return i;
+}
+
+#ifdef MPC_PREFETCH
+
+/* Reads a block, returning -1 on error or once woken to stop */
+static long mpc_input_prefetch_read(mpc_input_prefetch_t *f, char *block) {
+  
+  long n;
+  struct pollfd fds[2];
   
+  fds[0].fd = f->fd;
+  fds[0].events = POLLIN;
+  fds[1].fd = f->wake[0];
+  fds[1].events = POLLIN;
+  
+  while (1) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) { continue; }
+      return -1;
+    }
+    if (fds[1].revents) { return -1; }
+    n = (long)read(f->fd, block, MPC_INPUT_PAGE_SIZE);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) { continue; }
+    return n;
+  }
 }
 
-static mpc_input_t *mpc_input_new_file(const char *filename, FILE *file) {
+static void *mpc_input_prefetch_run(void *data) {
   
-  mpc_input_t *i = malloc(sizeof(mpc_input_t));
+  int slot;
+  long n;
+  mpc_input_prefetch_t *f = data;
   
-  i->filename = malloc(strlen(filename) + 1);
-  strcpy(i->filename, filename);
-  i->type = MPC_INPUT_FILE;
-  i->state = mpc_state_new();
+  while (1) {
+    
+    pthread_mutex_lock(&f->lock);
+    while (f->count == MPC_INPUT_PREFETCH_BLOCKS && !f->stop) {
+      pthread_cond_wait(&f->cond, &f->lock);
+    }
+    if (f->stop) { pthread_mutex_unlock(&f->lock); break; }
+    slot = (f->head + f->count) % MPC_INPUT_PREFETCH_BLOCKS;
+    pthread_mutex_unlock(&f->lock);
+    
+    /* The slot being filled is not visible to the parser until `count` includes it */
+    n = mpc_input_prefetch_read(f, f->blocks[slot]);
+    
+    pthread_mutex_lock(&f->lock);
+    f->lens[slot] = n;
+    if (n > 0) { f->count++; } else { f->ended = 1; }
+    pthread_cond_signal(&f->cond);
+    pthread_mutex_unlock(&f->lock);
+    
+    if (n <= 0) { break; }
+  }
   
-  i->string = NULL;
-  i->buffer = NULL;
+  return NULL;
+}
+
+#endif
+
+/*
+** Reads `file` as a Pipe with a helper thread
+** reading ahead. If this is not supported, or
+** the thread cannot be started, the input just
+** reads `file` as a normal Pipe.
+*/
+
+static mpc_input_t *mpc_input_new_prefetch(const char *filename, FILE *file) {
+  
+  mpc_input_t *i = mpc_input_new(filename, MPC_INPUT_PIPE);
+  
+#ifdef MPC_PREFETCH
+  
+  int j;
+  mpc_input_prefetch_t *f = malloc(sizeof(mpc_input_prefetch_t));
+  
+  f->fd = fileno(file);
+  f->head = 0;
+  f->count = 0;
+  f->ended = 0;
+  f->stop = 0;
+  for (j = 0; j < MPC_INPUT_PREFETCH_BLOCKS; j++) {
+    f->blocks[j] = malloc(MPC_INPUT_PAGE_SIZE);
+    f->lens[j] = 0;
+  }
+  
+  pthread_mutex_init(&f->lock, NULL);
+  pthread_cond_init(&f->cond, NULL);
+  
+  if (pipe(f->wake) == 0) {
+    if (pthread_create(&f->thread, NULL, mpc_input_prefetch_run, f) == 0) {
+      i->prefetch = f;
+      return i;
+    }
+    close(f->wake[0]);
+    close(f->wake[1]);
+  }
+  
+  pthread_cond_destroy(&f->cond);
+  pthread_mutex_destroy(&f->lock);
+  for (j = 0; j < MPC_INPUT_PREFETCH_BLOCKS; j++) { free(f->blocks[j]); }
+  free(f);
+  
+#endif
+  
+  i->file = file;
+  return i;
+}
+
+static mpc_input_t *mpc_input_new_file(const char *filename, FILE *file) {
+  mpc_input_t *i = mpc_input_new(filename, MPC_INPUT_FILE);
   i->file = file;
+  i->file_start = ftell(file);
+  if (i->file_start < 0) { i->file_start = 0; }
+  return i;
+}
+
+static mpc_input_t *mpc_input_new_iov(const char *filename, const struct iovec *iov, int n) {
   
-  i->backtrack = 1;
-  i->marks_num = 0;
-  i->marks = NULL;
-  i->lasts = NULL;
+  int j;
+  mpc_input_t *i = mpc_input_new(filename, MPC_INPUT_IOV);
   
-  i->last = '\0';
+  i->segments = iov;
+  i->segments_num = n;
+  i->segments_pos = malloc(sizeof(long) * (n + 1));
+  i->segments_pos[0] = 0;
+  for (j = 0; j < n; j++) {
+    i->segments_pos[j+1] = i->segments_pos[j] + (long)iov[j].iov_len;
+  }
+  
+  i->length = i->segments_pos[n];
+  return i;
+}
+
+static mpc_input_t *mpc_input_new_source(const char *filename, mpc_source_t *s) {
+  mpc_input_t *i = mpc_input_new(filename, s->seek ? MPC_INPUT_FILE : MPC_INPUT_PIPE);
+  i->source = *s;
+  return i;
+}
+
+/*
+** Maps the remainder of a regular file into
+** memory, starting from the current position
+** of `file`. Returns `NULL` if this is not
+** possible (for example if the file is a pipe
+** or terminal, is empty, or mapping is not
+** supported) in which case the caller should
+** fall back to reading it as a normal File.
+*/
+
+static mpc_input_t *mpc_input_new_mmap(const char *filename, FILE *file) {
+
+#ifdef MPC_USE_MMAP
+  
+  struct stat st;
+  long start;
+  void *mapping;
+  mpc_input_t *i;
+  
+  start = ftell(file);
+  if (start < 0) { return NULL; }
+  if (fstat(fileno(file), &st) != 0) { return NULL; }
+  if (!S_ISREG(st.st_mode) || (long)st.st_size <= start) { return NULL; }
   
+  mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+  if (mapping == MAP_FAILED) { return NULL; }
+  
+  i = mpc_input_new(filename, MPC_INPUT_MMAP);
+  i->string = (const char*)mapping + start;
+  i->file = file;
+  i->length = (long)st.st_size - start;
+  i->mapping = mapping;
+  i->mapping_len = (long)st.st_size;
+  i->window = i->string;
+  i->window_end = i->length;
   return i;
+  
+#else
+  
+  (void) filename; (void) file;
+  return NULL;
+  
+#endif
+  
 }
 
 static void mpc_input_delete(mpc_input_t *i) {
   
+  int j;
+  
   free(i->filename);
   
-  if (i->type == MPC_INPUT_STRING) { free(i->string); }
-  if (i->type == MPC_INPUT_PIPE) { free(i->buffer); }
+#ifdef MPC_PREFETCH
+  if (i->prefetch) {
+    /* Wakes the reader even if it is waiting on the stream, anything it read ahead is lost */
+    pthread_mutex_lock(&i->prefetch->lock);
+    i->prefetch->stop = 1;
+    pthread_cond_signal(&i->prefetch->cond);
+    pthread_mutex_unlock(&i->prefetch->lock);
+    while (write(i->prefetch->wake[1], "", 1) < 0 && errno == EINTR) { }
+    pthread_join(i->prefetch->thread, NULL);
+    close(i->prefetch->wake[0]);
+    close(i->prefetch->wake[1]);
+    pthread_cond_destroy(&i->prefetch->cond);
+    pthread_mutex_destroy(&i->prefetch->lock);
+    for (j = 0; j < MPC_INPUT_PREFETCH_BLOCKS; j++) { free(i->prefetch->blocks[j]); }
+    free(i->prefetch);
+  }
+#endif
+  
+  if (i->type == MPC_INPUT_PIPE) {
+    /* Return a single character of lookahead like `ungetc` did */
+    if (i->file && i->buffer_pos + i->buffer_len - i->pos == 1) {
+      ungetc((unsigned char)i->buffer[i->buffer_len-1], i->file);
+    }
+    free(i->buffer);
+  }
+  
+  if (i->type == MPC_INPUT_FILE) {
+    if (i->file) { fseek(i->file, i->file_start + i->pos, SEEK_SET); }
+    for (j = 0; j < MPC_INPUT_PAGES; j++) { free(i->pages[j].data); }
+  }
   
+#ifdef MPC_USE_MMAP
+  /* Leave the file positioned after the parsed input like File mode does */
+  if (i->type == MPC_INPUT_MMAP) {
+    fseek(i->file, (long)(i->string - i->mapping) + i->pos, SEEK_SET);
+    munmap(i->mapping, i->mapping_len);
+  }
+#endif
+  
+  free(i->segments_pos);
+  free(i->lines);
   free(i->marks);
   free(i->lasts);
   free(i);
@@ -425,14 +966,13 @@ static void mpc_input_mark(mpc_input_t *i) {
   if (i->backtrack < 1) { return; }
   
   i->marks_num++;
-  i->marks = realloc(i->marks, sizeof(mpc_state_t) * i->marks_num);
-  i->lasts = realloc(i->lasts, sizeof(char) * i->marks_num);
-  i->marks[i->marks_num-1] = i->state;
-  i->lasts[i->marks_num-1] = i->last;
-  
-  if (i->type == MPC_INPUT_PIPE && i->marks_num == 1) {
-    i->buffer = calloc(1, 1);
+  if (i->marks_num > i->marks_slots) {
+    i->marks_slots = i->marks_slots ? i->marks_slots * 2 : 16;
+    i->marks = realloc(i->marks, sizeof(long) * i->marks_slots);
+    i->lasts = realloc(i->lasts, sizeof(char) * i->marks_slots);
   }
+  i->marks[i->marks_num-1] = i->pos;
+  i->lasts[i->marks_num-1] = i->last;
   
 }
 
@@ -441,13 +981,6 @@ static void mpc_input_unmark(mpc_input_t *i) {
   if (i->backtrack < 1) { return; }
   
   i->marks_num--;
-  i->marks = realloc(i->marks, sizeof(mpc_state_t) * i->marks_num);
-  i->lasts = realloc(i->lasts, sizeof(char) * i->marks_num);
-  
-  if (i->type == MPC_INPUT_PIPE && i->marks_num == 0) {
-    free(i->buffer);
-    i->buffer = NULL;
-  }
   
 }
 
@@ -455,187 +988,415 @@ static void mpc_input_rewind(mpc_input_t *i) {
   
   if (i->backtrack < 1) { return; }
   
-  i->state = i->marks[i->marks_num-1];
+  i->pos  = i->marks[i->marks_num-1];
   i->last  = i->lasts[i->marks_num-1];
   
-  if (i->type == MPC_INPUT_FILE) {
-    fseek(i->file, i->state.pos, SEEK_SET);
-  }
-  
   mpc_input_unmark(i);
 }
 
-static int mpc_input_buffer_in_range(mpc_input_t *i) {
-  return i->state.pos < (long)(strlen(i->buffer) + i->marks[0].pos);
-}
-
-static char mpc_input_buffer_get(mpc_input_t *i) {
-  return i->buffer[i->state.pos - i->marks[0].pos];
-}
-
-static int mpc_input_terminated(mpc_input_t *i) {
-  if (i->type == MPC_INPUT_STRING && i->state.pos == (long)strlen(i->string)) { return 1; }
-  if (i->type == MPC_INPUT_FILE && feof(i->file)) { return 1; }
-  if (i->type == MPC_INPUT_PIPE && feof(i->file)) { return 1; }
-  return 0;
-}
+/*
+** Only the position is tracked while parsing. Rows
+** and columns are worked out when they are asked for
+** from an index of newline offsets, which is extended
+** as input is seen up to `lines_upto`. Pipe input is
+** indexed before it is discarded from the buffer and
+** File input as each page is first read.
+**
+** Once a Pipe buffer moves on nothing behind it can
+** be asked for again, so those entries are dropped,
+** leaving just their count in `lines_base` and the
+** last of them in `lines_last` to measure from.
+*/
 
-static char mpc_input_getc(mpc_input_t *i) {
+static void mpc_input_lines_add(mpc_input_t *i, const char *data, long pos, long end) {
   
-  char c = '\0';
+  const char *s, *e, *n;
   
-  switch (i->type) {
-    
-    case MPC_INPUT_STRING: return i->string[i->state.pos];
-    case MPC_INPUT_FILE: c = fgetc(i->file); return c;
-    case MPC_INPUT_PIPE:
-    
-      if (!i->buffer) { c = getc(i->file); return c; }
-      
-      if (i->buffer && mpc_input_buffer_in_range(i)) {
-        c = mpc_input_buffer_get(i);
-        return c;
-      } else {
-        c = getc(i->file);
-        return c;
-      }
-    
-    default: return c;
+  if (end <= i->lines_upto || pos > i->lines_upto) { return; }
+  
+  s = data + (i->lines_upto - pos);
+  e = data + (end - pos);
+  
+  while (s < e && (n = memchr(s, '\n', e - s)) != NULL) {
+    if (i->lines_num == i->lines_slots) {
+      i->lines_slots = i->lines_slots ? i->lines_slots * 2 : 64;
+      i->lines = realloc(i->lines, sizeof(long) * i->lines_slots);
+    }
+    i->lines[i->lines_num++] = pos + (n - data);
+    s = n + 1;
   }
+  
+  i->lines_upto = end;
 }
 
-static char mpc_input_peekc(mpc_input_t *i) {
+static void mpc_input_lines_drop(mpc_input_t *i, long pos) {
   
-  char c = '\0';
+  long k = 0;
   
-  switch (i->type) {
-    case MPC_INPUT_STRING: return i->string[i->state.pos];
-    case MPC_INPUT_FILE: 
-      
-      c = fgetc(i->file);
-      if (feof(i->file)) { return '\0'; }
-      
-      fseek(i->file, -1, SEEK_CUR);
-      return c;
-    
-    case MPC_INPUT_PIPE:
-      
-      if (!i->buffer) {
-        c = getc(i->file);
-        if (feof(i->file)) { return '\0'; }
-        ungetc(c, i->file);
-        return c;
-      }
-      
-      if (i->buffer && mpc_input_buffer_in_range(i)) {
-        return mpc_input_buffer_get(i);
-      } else {
-        c = getc(i->file);
-        if (feof(i->file)) { return '\0'; }
-        ungetc(c, i->file);
-        return c;
-      }
-    
-    default: return c;
-  }
+  while (k < i->lines_num && i->lines[k] < pos) { k++; }
+  if (k == 0) { return; }
   
+  i->lines_base += k;
+  i->lines_last = i->lines[k-1];
+  i->lines_num -= k;
+  i->lines_hint = i->lines_hint > k ? i->lines_hint - k : 0;
+  memmove(i->lines, i->lines + k, sizeof(long) * i->lines_num);
 }
 
-static int mpc_input_failure(mpc_input_t *i, char c) {
-
-  switch (i->type) {
-    case MPC_INPUT_STRING: { break; }
-    case MPC_INPUT_FILE: fseek(i->file, -1, SEEK_CUR); { break; }
-    case MPC_INPUT_PIPE: {
-      
-      if (!i->buffer) { ungetc(c, i->file); break; }
-      
-      if (i->buffer && mpc_input_buffer_in_range(i)) {
-        break;
-      } else {
-        ungetc(c, i->file); 
-      }
-    }
-    default: { break; }
-  }
-  return 0;
+static int mpc_input_buffer_in_range(mpc_input_t *i) {
+  return i->pos < i->buffer_pos + i->buffer_len;
 }
 
-static int mpc_input_success(mpc_input_t *i, char c, char **o) {
+static void mpc_input_buffer_reserve(mpc_input_t *i, long n) {
   
-  if (i->type == MPC_INPUT_PIPE &&
-      i->buffer &&
-      !mpc_input_buffer_in_range(i)) {
-    
-    i->buffer = realloc(i->buffer, strlen(i->buffer) + 2);
-    i->buffer[strlen(i->buffer) + 1] = '\0';
-    i->buffer[strlen(i->buffer) + 0] = c;
-  }
+  long keep;
   
-  i->last = c;
-  i->state.pos++;
-  i->state.col++;
+  if (i->buffer_slots - i->buffer_len >= n) { return; }
   
-  if (c == '\n') {
-    i->state.col = 0;
-    i->state.row++;
+  keep = (i->marks_num > 0 ? i->marks[0] : i->pos) - i->buffer_pos;
+  if (keep > 0) {
+    mpc_input_lines_add(i, i->buffer, i->buffer_pos, i->buffer_pos + keep);
+    memmove(i->buffer, i->buffer + keep, i->buffer_len - keep);
+    i->buffer_pos += keep;
+    i->buffer_len -= keep;
+    mpc_input_lines_drop(i, i->buffer_pos);
   }
   
-  if (o) {
-    (*o) = malloc(2);
-    (*o)[0] = c;
-    (*o)[1] = '\0';
+  if (i->buffer_len * 2 >= i->buffer_slots || i->buffer_slots - i->buffer_len < n) {
+    i->buffer_slots = i->buffer_slots ? i->buffer_slots * 2 : 512;
+    while (i->buffer_slots - i->buffer_len < n) { i->buffer_slots *= 2; }
+    i->buffer = realloc(i->buffer, i->buffer_slots);
   }
-  
-  return 1;
 }
 
-static int mpc_input_any(mpc_input_t *i, char **o) {
-  char x = mpc_input_getc(i);
-  if (mpc_input_terminated(i)) { return 0; }
-  return mpc_input_success(i, x, o);
-}
+#ifdef MPC_PREFETCH
 
-static int mpc_input_char(mpc_input_t *i, char c, char **o) {
-  char x = mpc_input_getc(i);
-  if (mpc_input_terminated(i)) { return 0; }
+static int mpc_input_prefetch_fill(mpc_input_t *i) {
+  
+  mpc_input_prefetch_t *f = i->prefetch;
+  long n;
+  
+  pthread_mutex_lock(&f->lock);
+  while (f->count == 0 && !f->ended) {
+    pthread_cond_wait(&f->cond, &f->lock);
+  }
+  if (f->count == 0) {
+    pthread_mutex_unlock(&f->lock);
+    i->ended = 1;
+    return 0;
+  }
+  pthread_mutex_unlock(&f->lock);
+  
+  n = f->lens[f->head];
+  mpc_input_buffer_reserve(i, n);
+  memcpy(i->buffer + i->buffer_len, f->blocks[f->head], n);
+  i->buffer_len += n;
+  
+  pthread_mutex_lock(&f->lock);
+  f->head = (f->head + 1) % MPC_INPUT_PREFETCH_BLOCKS;
+  f->count--;
+  pthread_cond_signal(&f->cond);
+  pthread_mutex_unlock(&f->lock);
+  
+  return 1;
+}
+
+#endif
+
+static int mpc_input_buffer_read(mpc_input_t *i) {
+  
+  int c;
+  long n;
+  
+  if (i->ended) { return 0; }
+  
+#ifdef MPC_PREFETCH
+  if (i->prefetch) { return mpc_input_prefetch_fill(i); }
+#endif
+  
+  /* Stdio pipes are read a character at a time to only consume what is needed */
+  if (i->file) {
+    c = getc(i->file);
+    if (c == EOF) { i->ended = 1; return 0; }
+    mpc_input_buffer_reserve(i, 1);
+    i->buffer[i->buffer_len++] = c;
+    return 1;
+  }
+  
+  mpc_input_buffer_reserve(i, MPC_INPUT_BLOCK_SIZE);
+  n = (long)i->source.read(i->source.data, i->buffer + i->buffer_len, i->buffer_slots - i->buffer_len);
+  if (n <= 0) { i->ended = 1; return 0; }
+  i->buffer_len += n;
+  return 1;
+}
+
+static int mpc_input_buffer_fill(mpc_input_t *i) {
+  
+  int r = mpc_input_buffer_in_range(i) || mpc_input_buffer_read(i);
+  
+  i->window = i->buffer;
+  i->window_pos = i->buffer_pos;
+  i->window_end = i->buffer_pos + i->buffer_len;
+  return r;
+}
+
+static long mpc_input_source_read(mpc_input_t *i, char *buffer, long length) {
+  
+  long n, total = 0;
+  
+  if (i->file) { return (long)fread(buffer, 1, length, i->file); }
+  
+  while (total < length) {
+    n = (long)i->source.read(i->source.data, buffer + total, length - total);
+    if (n <= 0) { break; }
+    total += n;
+  }
+  
+  return total;
+}
+
+static int mpc_input_source_seek(mpc_input_t *i, long offset) {
+  if (i->file) {
+    clearerr(i->file);
+    return fseek(i->file, i->file_start + offset, SEEK_SET);
+  } else {
+    return i->source.seek(i->source.data, offset);
+  }
+}
+
+static mpc_input_page_t *mpc_input_page_load(mpc_input_t *i, long index) {
+  
+  int j;
+  long offset = index * MPC_INPUT_PAGE_SIZE;
+  mpc_input_page_t *pg = &i->pages[0];
+  
+  for (j = 0; j < MPC_INPUT_PAGES; j++) {
+    if (i->pages[j].index == index) { return &i->pages[j]; }
+    if (i->pages[j].used < pg->used) { pg = &i->pages[j]; }
+  }
+  
+  if (pg->data == NULL) { pg->data = malloc(MPC_INPUT_PAGE_SIZE); }
+  
+  pg->index = index;
+  pg->len = 0;
+  
+  if (i->source.size && offset >= i->source.size(i->source.data)) { return pg; }
+  
+  /* Only seek when not already there so unseekable files still work sequentially */
+  if (i->file_pos != offset && mpc_input_source_seek(i, offset) != 0) {
+    i->error = "Unable to seek input!";
+    i->file_pos = -1;
+    pg->index = -1;
+    return pg;
+  }
+  
+  pg->len = mpc_input_source_read(i, pg->data, MPC_INPUT_PAGE_SIZE);
+  i->file_pos = offset + pg->len;
+  mpc_input_lines_add(i, pg->data, offset, offset + pg->len);
+  
+  return pg;
+}
+
+static int mpc_input_page_fill(mpc_input_t *i) {
+  
+  long index = i->pos / MPC_INPUT_PAGE_SIZE;
+  
+  if (i->page->index != index) {
+    i->page = mpc_input_page_load(i, index);
+    i->page->used = ++i->page_tick;
+  }
+  
+  i->window = i->page->data;
+  i->window_pos = index * MPC_INPUT_PAGE_SIZE;
+  i->window_end = i->window_pos + i->page->len;
+  return i->pos < i->window_end;
+}
+
+static int mpc_input_segment_in_range(mpc_input_t *i, int j) {
+  return i->pos >= i->segments_pos[j] && i->pos < i->segments_pos[j+1];
+}
+
+static int mpc_input_segment_fill(mpc_input_t *i) {
+  
+  int lo, hi, mid;
+  
+  if (i->pos >= i->length) { return 0; }
+  
+  if (mpc_input_segment_in_range(i, i->segment)) {
+    /* Already there */
+  } else if (i->segment + 1 < i->segments_num && mpc_input_segment_in_range(i, i->segment + 1)) {
+    /* Usually we have only stepped onto the next buffer */
+    i->segment++;
+  } else {
+    /* Find the last buffer starting at or before the cursor */
+    lo = 0;
+    hi = i->segments_num - 1;
+    while (lo < hi) {
+      mid = lo + (hi - lo + 1) / 2;
+      if (i->segments_pos[mid] <= i->pos) { lo = mid; } else { hi = mid - 1; }
+    }
+    i->segment = lo;
+  }
+  
+  i->window = i->segments[i->segment].iov_base;
+  i->window_pos = i->segments_pos[i->segment];
+  i->window_end = i->segments_pos[i->segment+1];
+  return 1;
+}
+
+static void mpc_input_lines_scan(mpc_input_t *i) {
+  
+  int j;
+  long end;
+  
+  switch (i->type) {
+    
+    case MPC_INPUT_STRING:
+    case MPC_INPUT_MMAP:
+      mpc_input_lines_add(i, i->string, 0, i->pos);
+      break;
+    
+    case MPC_INPUT_PIPE:
+      end = i->buffer_pos + i->buffer_len;
+      mpc_input_lines_add(i, i->buffer, i->buffer_pos, i->pos < end ? i->pos : end);
+      break;
+    
+    case MPC_INPUT_IOV:
+      for (j = i->lines_segment; j < i->segments_num && i->segments_pos[j] < i->pos; j++) {
+        end = i->segments_pos[j+1] < i->pos ? i->segments_pos[j+1] : i->pos;
+        mpc_input_lines_add(i, i->segments[j].iov_base, i->segments_pos[j], end);
+        i->lines_segment = j;
+      }
+      break;
+    
+    default: break;
+  }
+  
+}
+
+static mpc_state_t mpc_input_state(mpc_input_t *i) {
+  
+  mpc_state_t s;
+  long lo, hi, mid, k;
+  
+  mpc_input_lines_scan(i);
+  
+  /* Positions are usually asked for close to the last one, so try that row first */
+  k = i->lines_hint;
+  if (k > i->lines_num
+  || (k > 0 && i->lines[k-1] >= i->pos)
+  || (k < i->lines_num && i->lines[k] < i->pos)) {
+    lo = 0; hi = i->lines_num;
+    while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      if (i->lines[mid] < i->pos) { lo = mid + 1; } else { hi = mid; }
+    }
+    k = lo;
+  }
+  
+  i->lines_hint = k;
+  
+  s.pos = i->pos;
+  s.row = i->lines_base + k;
+  s.col = i->pos - (k > 0 ? i->lines[k-1] : i->lines_last) - 1;
+  return s;
+}
+
+/*
+** Every kind of input keeps a window onto the
+** contiguous run of bytes around the cursor. For
+** strings and mapped files this is the whole input,
+** for other kinds it is the current page, buffer or
+** segment. Reading a character is then the same for
+** all inputs and the kind of input only matters when
+** the cursor leaves the window.
+*/
+
+static int mpc_input_window_fill(mpc_input_t *i) {
+  switch (i->type) {
+    case MPC_INPUT_FILE: return mpc_input_page_fill(i);
+    case MPC_INPUT_PIPE: return mpc_input_buffer_fill(i);
+    case MPC_INPUT_IOV:  return mpc_input_segment_fill(i);
+    default: return 0;
+  }
+}
+
+static int mpc_input_next(mpc_input_t *i, char *x) {
+  
+  if ((i->pos < i->window_pos || i->pos >= i->window_end)
+  &&  !mpc_input_window_fill(i)) { return 0; }
+  
+  *x = i->window[i->pos - i->window_pos];
+  return 1;
+}
+
+static char mpc_input_peekc(mpc_input_t *i) {
+  char x;
+  return mpc_input_next(i, &x) ? x : '\0';
+}
+
+static int mpc_input_failure(mpc_input_t *i, char c) {
+  (void) i; (void) c;
+  return 0;
+}
+
+static int mpc_input_success(mpc_input_t *i, char c, char **o) {
+  
+  i->last = c;
+  i->pos++;
+  
+  if (o) {
+    (*o) = malloc(2);
+    (*o)[0] = c;
+    (*o)[1] = '\0';
+  }
+  
+  return 1;
+}
+
+static int mpc_input_any(mpc_input_t *i, char **o) {
+  char x;
+  if (!mpc_input_next(i, &x)) { return 0; }
+  return mpc_input_success(i, x, o);
+}
+
+static int mpc_input_char(mpc_input_t *i, char c, char **o) {
+  char x;
+  if (!mpc_input_next(i, &x)) { return 0; }
   return x == c ? mpc_input_success(i, x, o) : mpc_input_failure(i, x);
 }
 
 static int mpc_input_range(mpc_input_t *i, char c, char d, char **o) {
-  char x = mpc_input_getc(i);
-  if (mpc_input_terminated(i)) { return 0; }
+  char x;
+  if (!mpc_input_next(i, &x)) { return 0; }
   return x >= c && x <= d ? mpc_input_success(i, x, o) : mpc_input_failure(i, x);  
 }
 
 static int mpc_input_oneof(mpc_input_t *i, const char *c, char **o) {
-  char x = mpc_input_getc(i);
-  if (mpc_input_terminated(i)) { return 0; }
-  return strchr(c, x) != 0 ? mpc_input_success(i, x, o) : mpc_input_failure(i, x);  
+  char x;
+  if (!mpc_input_next(i, &x)) { return 0; }
+  return x != '\0' && strchr(c, x) != 0 ? mpc_input_success(i, x, o) : mpc_input_failure(i, x);  
 }
 
 static int mpc_input_noneof(mpc_input_t *i, const char *c, char **o) {
-  char x = mpc_input_getc(i);
-  if (mpc_input_terminated(i)) { return 0; }
-  return strchr(c, x) == 0 ? mpc_input_success(i, x, o) : mpc_input_failure(i, x);  
+  char x;
+  if (!mpc_input_next(i, &x)) { return 0; }
+  return x == '\0' || strchr(c, x) == 0 ? mpc_input_success(i, x, o) : mpc_input_failure(i, x);  
 }
 
 static int mpc_input_satisfy(mpc_input_t *i, int(*cond)(char), char **o) {
-  char x = mpc_input_getc(i);
-  if (mpc_input_terminated(i)) { return 0; }
+  char x;
+  if (!mpc_input_next(i, &x)) { return 0; }
   return cond(x) ? mpc_input_success(i, x, o) : mpc_input_failure(i, x);  
 }
 
 static int mpc_input_string(mpc_input_t *i, const char *c, char **o) {
   
-  char *co = NULL;
   const char *x = c;
 
   mpc_input_mark(i);
   while (*x) {
-    if (mpc_input_char(i, *x, &co)) {
-      free(co);
-    } else {
+    if (!mpc_input_char(i, *x, NULL)) {
       mpc_input_rewind(i);
       return 0;
     }
@@ -643,8 +1404,10 @@ static int mpc_input_string(mpc_input_t *i, const char *c, char **o) {
   }
   mpc_input_unmark(i);
   
-  *o = malloc(strlen(c) + 1);
-  strcpy(*o, c);
+  if (o) {
+    *o = malloc(strlen(c) + 1);
+    strcpy(*o, c);
+  }
   return 1;
 }
 
@@ -684,7 +1447,12 @@ enum {
   MPC_TYPE_COUNT     = 22,
   
   MPC_TYPE_OR        = 23,
-  MPC_TYPE_AND       = 24
+  MPC_TYPE_AND       = 24,
+  
+  MPC_TYPE_PACKRAT   = 25,
+  MPC_TYPE_MEMO      = 26,
+  MPC_TYPE_LIMIT     = 27,
+  MPC_TYPE_RECOVER   = 28
 };
 
 typedef struct { char *m; } mpc_pdata_fail_t;
@@ -700,8 +1468,11 @@ typedef struct { mpc_parser_t *x; mpc_apply_to_t f; void *d; } mpc_pdata_apply_t
 typedef struct { mpc_parser_t *x; } mpc_pdata_predict_t;
 typedef struct { mpc_parser_t *x; mpc_dtor_t dx; mpc_ctor_t lf; } mpc_pdata_not_t;
 typedef struct { int n; mpc_fold_t f; mpc_parser_t *x; mpc_dtor_t dx; } mpc_pdata_repeat_t;
-typedef struct { int n; mpc_parser_t **xs; } mpc_pdata_or_t;
-typedef struct { int n; mpc_fold_t f; mpc_parser_t **xs; mpc_dtor_t *dxs;  } mpc_pdata_and_t;
+typedef struct { int n; mpc_parser_t **xs; struct mpc_dispatch_t *dispatch; } mpc_pdata_or_t;
+typedef struct { int n; mpc_fold_t f; mpc_parser_t **xs; mpc_dtor_t *dxs; unsigned long unmarked; } mpc_pdata_and_t;
+typedef struct { mpc_parser_t *x; mpc_apply_t clone; mpc_dtor_t dx; } mpc_pdata_memo_t;
+typedef struct { mpc_parser_t *x; mpc_dtor_t dx; mpc_limits_t *l; } mpc_pdata_limit_t;
+typedef struct { mpc_parser_t *xs[2]; mpc_dtor_t dx; mpc_apply_t f; } mpc_pdata_recover_t;
 
 typedef union {
   mpc_pdata_fail_t fail;
@@ -719,1717 +1490,4745 @@ typedef union {
   mpc_pdata_repeat_t repeat;
   mpc_pdata_and_t and;
   mpc_pdata_or_t or;
+  mpc_pdata_memo_t memo;
+  mpc_pdata_limit_t limit;
+  mpc_pdata_recover_t recover;
 } mpc_pdata_t;
 
+struct mpc_search_t;
+
 struct mpc_parser_t {
   char retained;
   char *name;
   char type;
   mpc_pdata_t data;
+  struct mpc_search_t *search;
+  struct mpc_generation_t *generation;
 };
 
 /*
-** Stack Type
+** Dispatch Tables
+**
+** Built for `mpc_or` parsers by `mpc_analyse`. Sets
+** of bytes are bitsets with one extra bit for the
+** end of the input. `skip` holds a set for each of
+** the alternatives, marking the symbols with which
+** it is sure to fail straight away with the error in
+** `errs`. `none` is where every alternative fails,
+** and the `mpc_or` as a whole fails with `err`.
+**
+** Each parser reached by `mpc_analyse` points at a
+** generation shared by its grammar, and redefining a
+** parser bumps it, which makes any older tables out
+** of date. The same goes for `mpc_and` parsers which
+** have been found not to need a mark, whose
+** `unmarked` is the generation at which that was
+** found, or zero. Grammars analysed separately count
+** separately, so threads building their own grammars
+** don't touch any shared state. If an analysis finds
+** parsers from several grammars these are merged,
+** the others pointing `into` the one kept.
 */
 
-typedef struct {
-
-  int parsers_num;
-  int parsers_slots;
-  mpc_parser_t **parsers;
-  int *states;
+#define MPC_SET_END 256
+#define MPC_SET_BYTES 33
 
-  int results_num;
-  int results_slots;
-  mpc_result_t *results;
-  int *returns;
-  
+typedef struct mpc_dispatch_t {
+  unsigned long generation;
+  int n;
+  unsigned char none[MPC_SET_BYTES];
+  unsigned char *skip;
+  mpc_err_t **errs;
   mpc_err_t *err;
-  
-} mpc_stack_t;
+} mpc_dispatch_t;
 
-static mpc_stack_t *mpc_stack_new(const char *filename) {
-  mpc_stack_t *s = malloc(sizeof(mpc_stack_t));
-  
-  s->parsers_num = 0;
-  s->parsers_slots = 0;
-  s->parsers = NULL;
-  s->states = NULL;
-  
-  s->results_num = 0;
-  s->results_slots = 0;
-  s->results = NULL;
-  s->returns = NULL;
-  
-  s->err = mpc_err_fail(filename, mpc_state_invalid(), "Unknown Error");
-  
-  return s;
-}
+typedef struct mpc_generation_t {
+  unsigned long value;
+  int refs;
+  struct mpc_generation_t *into;
+} mpc_generation_t;
 
-static void mpc_stack_err(mpc_stack_t *s, mpc_err_t* e) {
-  mpc_err_t *errs[2];
-  errs[0] = s->err;
-  errs[1] = e;
-  s->err = mpc_err_or(errs, 2);
+static mpc_generation_t *mpc_generation_find(mpc_generation_t *g) {
+  while (g && g->into) { g = g->into; }
+  return g;
 }
 
-static int mpc_stack_terminate(mpc_stack_t *s, mpc_result_t *r) {
-  int success = s->returns[0];
-  
-  if (success) {
-    r->output = s->results[0].output;
-    mpc_err_delete(s->err);
-  } else {
-    mpc_stack_err(s, s->results[0].error);
-    r->error = s->err;
+static void mpc_generation_release(mpc_generation_t *g) {
+  mpc_generation_t *into;
+  while (g && --g->refs == 0) {
+    into = g->into;
+    free(g);
+    g = into;
   }
-  
-  free(s->parsers);
-  free(s->states);
-  free(s->results);
-  free(s->returns);
-  free(s);
-  
-  return success;
 }
 
-/* Stack Parser Stuff */
-
-static void mpc_stack_set_state(mpc_stack_t *s, int x) {
-  s->states[s->parsers_num-1] = x;
+static void mpc_generation_set(mpc_parser_t *p, mpc_generation_t *g) {
+  g->refs++;
+  mpc_generation_release(p->generation);
+  p->generation = g;
 }
 
-static void mpc_stack_parsers_reserve_more(mpc_stack_t *s) {
-  if (s->parsers_num > s->parsers_slots) {
-    s->parsers_slots = ceil((s->parsers_slots+1) * 1.5);
-    s->parsers = realloc(s->parsers, sizeof(mpc_parser_t*) * s->parsers_slots);
-    s->states = realloc(s->states, sizeof(int) * s->parsers_slots);
-  }
+static unsigned long mpc_generation_of(mpc_parser_t *p) {
+  mpc_generation_t *g = mpc_generation_find(p->generation);
+  return g ? g->value : 0;
 }
 
-static void mpc_stack_parsers_reserve_less(mpc_stack_t *s) {
-  if (s->parsers_slots > pow(s->parsers_num+1, 1.5)) {
-    s->parsers_slots = floor((s->parsers_slots-1) * (1.0/1.5));
-    s->parsers = realloc(s->parsers, sizeof(mpc_parser_t*) * s->parsers_slots);
-    s->states = realloc(s->states, sizeof(int) * s->parsers_slots);
-  }
+static void mpc_generation_bump(mpc_parser_t *p) {
+  mpc_generation_t *g = mpc_generation_find(p->generation);
+  if (g) { g->value++; }
 }
 
-static void mpc_stack_pushp(mpc_stack_t *s, mpc_parser_t *p) {
-  s->parsers_num++;
-  mpc_stack_parsers_reserve_more(s);
-  s->parsers[s->parsers_num-1] = p;
-  s->states[s->parsers_num-1] = 0;
+static int mpc_set_has(const unsigned char *s, int c) {
+  return (s[c >> 3] >> (c & 7)) & 1;
 }
 
-static void mpc_stack_popp(mpc_stack_t *s, mpc_parser_t **p, int *st) {
-  *p = s->parsers[s->parsers_num-1];
-  *st = s->states[s->parsers_num-1];
-  s->parsers_num--;
-  mpc_stack_parsers_reserve_less(s);
+static void mpc_set_add(unsigned char *s, int c) {
+  s[c >> 3] = (unsigned char)(s[c >> 3] | (1 << (c & 7)));
 }
 
-static void mpc_stack_peepp(mpc_stack_t *s, mpc_parser_t **p, int *st) {
-  *p = s->parsers[s->parsers_num-1];
-  *st = s->states[s->parsers_num-1];
+/* The next byte, or `MPC_SET_END` at the end of the input */
+static int mpc_input_symbol(mpc_input_t *i) {
+  char x;
+  return mpc_input_next(i, &x) ? (unsigned char)x : MPC_SET_END;
 }
 
-static int mpc_stack_empty(mpc_stack_t *s) {
-  return s->parsers_num == 0;
+static void mpc_dispatch_delete(mpc_dispatch_t *d) {
+  
+  int j;
+  
+  if (d == NULL) { return; }
+  
+  for (j = 0; j < d->n; j++) {
+    if (d->errs[j]) { mpc_err_delete(d->errs[j]); }
+  }
+  if (d->err) { mpc_err_delete(d->err); }
+  
+  free(d->skip);
+  free(d->errs);
+  free(d);
 }
 
-/* Stack Result Stuff */
+/*
+** Memoization
+**
+** Inside `mpc_packrat` the result of each retained
+** parser is remembered against the position it was
+** run from, so when backtracking tries it again at
+** the same position the result is copied out of the
+** table instead of being parsed again. Parsers made
+** with `mpc_memo` remember their own results in the
+** same table. Entries also keep the end position and
+** any errors merged into the stack while the parser
+** ran, so that using a remembered result is
+** indistinguishable from the real parse.
+**
+** The input can never be rewound to before its
+** first mark so entries behind that are thrown away
+** whenever the table fills up. Entries of `mpc_memo`
+** parsers are also thrown away once they are more
+** than `MPC_MEMO_WINDOW` bytes behind the input, so
+** the table stays small on long inputs.
+*/
 
-static mpc_result_t mpc_result_err(mpc_err_t *e) {
-  mpc_result_t r;
-  r.error = e;
-  return r;
-}
+#define MPC_MEMO_WINDOW 4096
 
-static mpc_result_t mpc_result_out(mpc_val_t *x) {
-  mpc_result_t r;
-  r.output = x;
-  return r;
-}
+/* A failure taken off the stack along with its labels, defined with the stack */
+typedef struct mpc_memo_fail_t mpc_memo_fail_t;
+
+typedef struct mpc_memo_entry_t {
+  mpc_parser_t *p;
+  long pos;
+  long end;
+  char last;
+  int success;
+  mpc_val_t *output;
+  mpc_memo_fail_t *fail;
+  mpc_memo_fail_t *err;
+  int recovered_num;
+  int recovered_kept;
+  mpc_err_t **recovered;
+  struct mpc_memo_entry_t *next;
+} mpc_memo_entry_t;
+
+typedef struct {
+  mpc_parser_t *p;
+  long pos;
+  int depth;
+  int recovered;
+  mpc_memo_fail_t *err;
+} mpc_memo_frame_t;
 
-static void mpc_stack_results_reserve_more(mpc_stack_t *s) {
-  if (s->results_num > s->results_slots) {
-    s->results_slots = ceil((s->results_slots + 1) * 1.5);
-    s->results = realloc(s->results, sizeof(mpc_result_t) * s->results_slots);
-    s->returns = realloc(s->returns, sizeof(int) * s->results_slots);
+typedef struct {
+  
+  int packrat;
+  int match;
+  mpc_apply_t clone;
+  mpc_dtor_t dtor;
+  
+  unsigned long entries_num;
+  unsigned long buckets_num;
+  mpc_memo_entry_t **buckets;
+  
+  int frames_num;
+  int frames_slots;
+  mpc_memo_frame_t *frames;
+  
+} mpc_memo_t;
+
+static mpc_memo_t *mpc_memo_new(int match) {
+  mpc_memo_t *m = malloc(sizeof(mpc_memo_t));
+  m->packrat = 0;
+  m->match = match;
+  m->clone = NULL;
+  m->dtor = NULL;
+  m->entries_num = 0;
+  m->buckets_num = 256;
+  m->buckets = calloc(m->buckets_num, sizeof(mpc_memo_entry_t*));
+  m->frames_num = 0;
+  m->frames_slots = 0;
+  m->frames = NULL;
+  return m;
+}
+
+/* When only matching there are no results to copy or delete */
+static mpc_val_t *mpc_memo_clone(mpc_memo_t *m, mpc_memo_entry_t *e, mpc_val_t *x) {
+  if (m->match) { return NULL; }
+  return e->p->type == MPC_TYPE_MEMO ? e->p->data.memo.clone(x) : m->clone(x);
+}
+
+static void mpc_memo_entry_delete(mpc_memo_t *m, mpc_memo_entry_t *e) {
+  int j;
+  mpc_dtor_t dtor = e->p->type == MPC_TYPE_MEMO ? e->p->data.memo.dx : m->dtor;
+  if (e->success && !m->match) { dtor(e->output); }
+  free(e->fail);
+  free(e->err);
+  for (j = 0; j < e->recovered_num; j++) { mpc_err_delete(e->recovered[j]); }
+  free(e->recovered);
+  free(e);
+}
+
+static void mpc_memo_delete(mpc_memo_t *m) {
+  
+  unsigned long j;
+  mpc_memo_entry_t *e, *n;
+  
+  for (j = 0; j < m->buckets_num; j++) {
+    for (e = m->buckets[j]; e; e = n) {
+      n = e->next;
+      mpc_memo_entry_delete(m, e);
+    }
   }
+  
+  free(m->buckets);
+  free(m->frames);
+  free(m);
 }
 
-static void mpc_stack_results_reserve_less(mpc_stack_t *s) {
-  if ( s->results_slots > pow(s->results_num+1, 1.5)) {
-    s->results_slots = floor((s->results_slots-1) * (1.0/1.5));
-    s->results = realloc(s->results, sizeof(mpc_result_t) * s->results_slots);
-    s->returns = realloc(s->returns, sizeof(int) * s->results_slots);
-  }
+static unsigned long mpc_memo_hash(mpc_memo_t *m, mpc_parser_t *p, long pos) {
+  unsigned long h = ((unsigned long)(size_t)p >> 4) ^ ((unsigned long)pos * 2654435761UL);
+  return h & (m->buckets_num - 1);
 }
 
-static void mpc_stack_pushr(mpc_stack_t *s, mpc_result_t x, int r) {
-  s->results_num++;
-  mpc_stack_results_reserve_more(s);
-  s->results[s->results_num-1] = x;
-  s->returns[s->results_num-1] = r;
+static mpc_memo_entry_t *mpc_memo_find(mpc_memo_t *m, mpc_parser_t *p, long pos) {
+  mpc_memo_entry_t *e = m->buckets[mpc_memo_hash(m, p, pos)];
+  while (e && (e->p != p || e->pos != pos)) { e = e->next; }
+  return e;
 }
 
-static int mpc_stack_popr(mpc_stack_t *s, mpc_result_t *x) {
-  int r;
-  *x = s->results[s->results_num-1];
-  r = s->returns[s->results_num-1];
-  s->results_num--;
-  mpc_stack_results_reserve_less(s);
-  return r;
+static int mpc_memo_expired(mpc_memo_t *m, mpc_memo_entry_t *e, long limit, long pos) {
+  if (e->pos < limit) { return 1; }
+  if (e->p->type == MPC_TYPE_MEMO) { return e->pos < pos - MPC_MEMO_WINDOW; }
+  return !m->packrat;
 }
 
-static int mpc_stack_peekr(mpc_stack_t *s, mpc_result_t *x) {
-  *x = s->results[s->results_num-1];
-  return s->returns[s->results_num-1];
+static void mpc_memo_prune(mpc_memo_t *m, long limit, long pos) {
+  
+  unsigned long j;
+  mpc_memo_entry_t **e, *d;
+  
+  for (j = 0; j < m->buckets_num; j++) {
+    e = &m->buckets[j];
+    while (*e) {
+      if (mpc_memo_expired(m, *e, limit, pos)) {
+        d = *e;
+        *e = d->next;
+        mpc_memo_entry_delete(m, d);
+        m->entries_num--;
+      } else {
+        e = &(*e)->next;
+      }
+    }
+  }
 }
 
-static void mpc_stack_popr_err(mpc_stack_t *s, int n) {
-  mpc_result_t x;
-  while (n) {
-    mpc_stack_popr(s, &x);
-    mpc_stack_err(s, x.error);
-    n--;
+static void mpc_memo_grow(mpc_memo_t *m) {
+  
+  unsigned long j, h, old_num = m->buckets_num;
+  mpc_memo_entry_t **old = m->buckets, *e, *n;
+  
+  m->buckets_num *= 2;
+  m->buckets = calloc(m->buckets_num, sizeof(mpc_memo_entry_t*));
+  
+  for (j = 0; j < old_num; j++) {
+    for (e = old[j]; e; e = n) {
+      n = e->next;
+      h = mpc_memo_hash(m, e->p, e->pos);
+      e->next = m->buckets[h];
+      m->buckets[h] = e;
+    }
   }
+  
+  free(old);
 }
 
-static void mpc_stack_popr_out(mpc_stack_t *s, int n, mpc_dtor_t *ds) {
-  mpc_result_t x;
-  while (n) {
-    mpc_stack_popr(s, &x);
-    ds[n-1](x.output);
-    n--;
+static void mpc_memo_add(mpc_memo_t *m, mpc_memo_entry_t *e, long limit, long pos) {
+  
+  unsigned long h;
+  
+  if (m->entries_num >= m->buckets_num) {
+    mpc_memo_prune(m, limit, pos);
+    if (m->entries_num * 2 >= m->buckets_num) { mpc_memo_grow(m); }
   }
+  
+  h = mpc_memo_hash(m, e->p, e->pos);
+  e->next = m->buckets[h];
+  m->buckets[h] = e;
+  m->entries_num++;
 }
 
-static void mpc_stack_popr_out_single(mpc_stack_t *s, int n, mpc_dtor_t dx) {
-  mpc_result_t x;
-  while (n) {
-    mpc_stack_popr(s, &x);
-    dx(x.output);
-    n--;
+static void mpc_memo_push(mpc_memo_t *m, mpc_parser_t *p, long pos, int depth, int recovered, mpc_memo_fail_t *err) {
+  
+  if (m->frames_num == m->frames_slots) {
+    m->frames_slots = m->frames_slots ? m->frames_slots * 2 : 16;
+    m->frames = realloc(m->frames, sizeof(mpc_memo_frame_t) * m->frames_slots);
   }
+  
+  m->frames[m->frames_num].p = p;
+  m->frames[m->frames_num].pos = pos;
+  m->frames[m->frames_num].depth = depth;
+  m->frames[m->frames_num].recovered = recovered;
+  m->frames[m->frames_num].err = err;
+  m->frames_num++;
 }
 
-static void mpc_stack_popr_n(mpc_stack_t *s, int n) {
-  mpc_result_t x;
-  while (n) {
-    mpc_stack_popr(s, &x);
-    n--;
-  }
-}
-
-static mpc_val_t *mpc_stack_merger_out(mpc_stack_t *s, int n, mpc_fold_t f) {
-  mpc_val_t *x = f(n, (mpc_val_t**)(&s->results[s->results_num-n]));
-  mpc_stack_popr_n(s, n);
-  return x;
-}
+/*
+** Stack Type
+**
+** Most failures are thrown away when the parser
+** backtracks, so while parsing they are not made
+** into `mpc_err_t` objects. Instead each failed
+** result has a small `mpc_fail_t` record kept on
+** its own stack in the same order as the results.
+** The expected labels of a record are pointers to
+** strings owned by the parsers or the stack, so
+** failing, and merging failures together, does no
+** allocation once the stack has grown. Failures
+** merged in from discarded branches are kept the
+** same way in `err`, and an `mpc_err_t` is only made
+** once the whole parse has failed. The memo table
+** keeps its failures as records too, copied off the
+** stack with their labels.
+*/
 
-static mpc_err_t *mpc_stack_merger_err(mpc_stack_t *s, int n) {
-  mpc_err_t *x = mpc_err_or((mpc_err_t**)(&s->results[s->results_num-n]), n);
-  mpc_stack_popr_n(s, n);
-  return x;
-}
+typedef struct {
+  mpc_state_t state;
+  char recieved;
+  const char *failure;
+  int labels;
+  int labels_num;
+} mpc_fail_t;
+
+struct mpc_memo_fail_t {
+  mpc_fail_t fail;
+  const char **labels;
+};
 
 /*
-** This is rather pleasant. The core parsing routine
-** is written in about 200 lines of C.
-**
-** I also love the way in which each parsing type
-** concisely matches some construct or pattern.
-**
-** Particularly nice are the `or` and `and`
-** types which have a broken but mirrored structure
-** with return value and error reflected.
-**
-** When this function was written in recursive form
-** it looked pretty nice. But I've since switched
-** it around to an awkward while loop. It was an
-** unfortunate change for code simplicity but it
-** is noble in the name of performance (and 
-** not smashing the stack).
+** Each frame keeps a parser next to how far through
+** it is, and the frames and results only ever grow,
+** doubling in size, so deep nesting doesn't realloc
+** over and over as it goes up and down. Results are
+** kept in an array of their own so folds can be
+** passed them directly.
 **
-** But it is now a pretty ugly beast...
+** Frames also keep how many errors had been
+** recovered from when they were pushed. When a frame
+** fails, those recovered from since are only kept
+** until parsing carries on, so errors found in a
+** branch that is backtracked out of are dropped, but
+** if the whole parse fails they are still reported.
 */
 
-#define MPC_CONTINUE(st, x) mpc_stack_set_state(stk, st); mpc_stack_pushp(stk, x); continue
-#define MPC_SUCCESS(x) mpc_stack_popp(stk, &p, &st); mpc_stack_pushr(stk, mpc_result_out(x), 1); continue
-#define MPC_FAILURE(x) mpc_stack_popp(stk, &p, &st); mpc_stack_pushr(stk, mpc_result_err(x), 0); continue
-#define MPC_PRIMITIVE(x, f) if (f) { MPC_SUCCESS(x); } else { MPC_FAILURE(mpc_err_fail(i->filename, i->state, "Incorrect Input")); }
+typedef struct {
+  mpc_parser_t *parser;
+  int state;
+  int recovered;
+} mpc_frame_t;
+
+typedef struct {
+
+  int frames_num;
+  int frames_slots;
+  mpc_frame_t *frames;
 
-int mpc_parse_input(mpc_input_t *i, mpc_parser_t *init, mpc_result_t *final) {
+  int results_num;
+  int results_slots;
+  mpc_result_t *results;
+  int *returns;
   
-  /* Stack */
-  int st = 0;
-  mpc_parser_t *p = NULL;
-  mpc_stack_t *stk = mpc_stack_new(i->filename);
+  int fails_num;
+  int fails_slots;
+  mpc_fail_t *fails;
   
-  /* Variables */
-  char *s;
-  mpc_result_t r;
-
-  /* Go! */
-  mpc_stack_pushp(stk, init);
+  int labels_num;
+  int labels_slots;
+  const char **labels;
   
-  while (!mpc_stack_empty(stk)) {
-    
-    mpc_stack_peepp(stk, &p, &st);
-    
-    switch (p->type) {
-      
-      /* Basic Parsers */
+  mpc_fail_t err;
+  int err_slots;
+  const char **err_labels;
+  
+  int sets_words;
+  unsigned long *set;
+  unsigned long *err_set;
+  int scratch_slots;
+  char *scratch;
+  mpc_labels_t label_ptrs;
+  mpc_labels_t label_texts;
+  int composites_num;
+  int composites_slots;
+  char **composites;
+  
+  const char *filename;
+  mpc_memo_t *memo;
+  
+  int match;
+  
+  mpc_limits_t *limits;
+  unsigned long steps;
+  const char *limited;
+  
+  int recover;
+  int recovered_num;
+  int recovered_kept;
+  mpc_err_t **recovered;
+  
+  int quiet;
+  
+} mpc_stack_t;
 
-      case MPC_TYPE_ANY:       MPC_PRIMITIVE(s, mpc_input_any(i, &s));
-      case MPC_TYPE_SINGLE:    MPC_PRIMITIVE(s, mpc_input_char(i, p->data.single.x, &s));
-      case MPC_TYPE_RANGE:     MPC_PRIMITIVE(s, mpc_input_range(i, p->data.range.x, p->data.range.y, &s));
-      case MPC_TYPE_ONEOF:     MPC_PRIMITIVE(s, mpc_input_oneof(i, p->data.string.x, &s));
-      case MPC_TYPE_NONEOF:    MPC_PRIMITIVE(s, mpc_input_noneof(i, p->data.string.x, &s));
-      case MPC_TYPE_SATISFY:   MPC_PRIMITIVE(s, mpc_input_satisfy(i, p->data.satisfy.f, &s));
-      case MPC_TYPE_STRING:    MPC_PRIMITIVE(s, mpc_input_string(i, p->data.string.x, &s));
-      
-      /* Other parsers */
-      
-      case MPC_TYPE_UNDEFINED: MPC_FAILURE(mpc_err_fail(i->filename, i->state, "Parser Undefined!"));      
-      case MPC_TYPE_PASS:      MPC_SUCCESS(NULL);
-      case MPC_TYPE_FAIL:      MPC_FAILURE(mpc_err_fail(i->filename, i->state, p->data.fail.m));
-      case MPC_TYPE_LIFT:      MPC_SUCCESS(p->data.lift.lf());
-      case MPC_TYPE_LIFT_VAL:  MPC_SUCCESS(p->data.lift.x);
-      case MPC_TYPE_STATE:     MPC_SUCCESS(mpc_state_copy(i->state));
-      
-      case MPC_TYPE_ANCHOR:
-        if (mpc_input_anchor(i, p->data.anchor.f)) {
-          MPC_SUCCESS(NULL);
-        } else {
-          MPC_FAILURE(mpc_err_new(i->filename, i->state, "anchor", mpc_input_peekc(i)));
-        }
-      
-      /* Application Parsers */
-      
-      case MPC_TYPE_EXPECT:
-        if (st == 0) { MPC_CONTINUE(1, p->data.expect.x); }
-        if (st == 1) {
-          if (mpc_stack_popr(stk, &r)) {
-            MPC_SUCCESS(r.output);
-          } else {
-            mpc_err_delete(r.error); 
-            MPC_FAILURE(mpc_err_new(i->filename, i->state, p->data.expect.m, mpc_input_peekc(i)));
-          }
-        }
-      
-      case MPC_TYPE_APPLY:
-        if (st == 0) { MPC_CONTINUE(1, p->data.apply.x); }
-        if (st == 1) {
-          if (mpc_stack_popr(stk, &r)) {
-            MPC_SUCCESS(p->data.apply.f(r.output));
-          } else {
-            MPC_FAILURE(r.error);
-          }
-        }
-      
-      case MPC_TYPE_APPLY_TO:
-        if (st == 0) { MPC_CONTINUE(1, p->data.apply_to.x); }
-        if (st == 1) {
-          if (mpc_stack_popr(stk, &r)) {
-            MPC_SUCCESS(p->data.apply_to.f(r.output, p->data.apply_to.d));
-          } else {
-            MPC_FAILURE(r.error);
-          }
-        }
-      
-      case MPC_TYPE_PREDICT:
-        if (st == 0) { mpc_input_backtrack_disable(i); MPC_CONTINUE(1, p->data.predict.x); }
-        if (st == 1) {
-          mpc_input_backtrack_enable(i);
-          mpc_stack_popp(stk, &p, &st);
-          continue;
-        }
-      
-      /* Optional Parsers */
-      
-      /* TODO: Update Not Error Message */
-      
-      case MPC_TYPE_NOT:
-        if (st == 0) { mpc_input_mark(i); MPC_CONTINUE(1, p->data.not.x); }
-        if (st == 1) {
-          if (mpc_stack_popr(stk, &r)) {
-            mpc_input_rewind(i);
-            p->data.not.dx(r.output);
-            MPC_FAILURE(mpc_err_new(i->filename, i->state, "opposite", mpc_input_peekc(i)));
-          } else {
-            mpc_input_unmark(i);
-            mpc_stack_err(stk, r.error);
-            MPC_SUCCESS(p->data.not.lf());
-          }
-        }
-      
-      case MPC_TYPE_MAYBE:
-        if (st == 0) { MPC_CONTINUE(1, p->data.not.x); }
-        if (st == 1) {
-          if (mpc_stack_popr(stk, &r)) {
-            MPC_SUCCESS(r.output);
-          } else {
-            mpc_stack_err(stk, r.error);
-            MPC_SUCCESS(p->data.not.lf());
-          }
-        }
-      
-      /* Repeat Parsers */
-      
-      case MPC_TYPE_MANY:
-        if (st == 0) { MPC_CONTINUE(st+1, p->data.repeat.x); }
-        if (st >  0) {
-          if (mpc_stack_peekr(stk, &r)) {
-            MPC_CONTINUE(st+1, p->data.repeat.x);
-          } else {
-            mpc_stack_popr(stk, &r);
-            mpc_stack_err(stk, r.error);
-            MPC_SUCCESS(mpc_stack_merger_out(stk, st-1, p->data.repeat.f));
-          }
-        }
-      
-      case MPC_TYPE_MANY1:
-        if (st == 0) { MPC_CONTINUE(st+1, p->data.repeat.x); }
-        if (st >  0) {
-          if (mpc_stack_peekr(stk, &r)) {
-            MPC_CONTINUE(st+1, p->data.repeat.x);
-          } else {
-            if (st == 1) {
-              mpc_stack_popr(stk, &r);
-              MPC_FAILURE(mpc_err_many1(r.error));
-            } else {
-              mpc_stack_popr(stk, &r);
-              mpc_stack_err(stk, r.error);
-              MPC_SUCCESS(mpc_stack_merger_out(stk, st-1, p->data.repeat.f));
-            }
-          }
-        }
-      
-      case MPC_TYPE_COUNT:
-        if (st == 0) { mpc_input_mark(i); MPC_CONTINUE(st+1, p->data.repeat.x); }
-        if (st >  0) {
-          if (mpc_stack_peekr(stk, &r)) {
-            MPC_CONTINUE(st+1, p->data.repeat.x);
-          } else {
-            if (st != (p->data.repeat.n+1)) {
-              mpc_stack_popr(stk, &r);
-              mpc_stack_popr_out_single(stk, st-1, p->data.repeat.dx);
-              mpc_input_rewind(i);
-              MPC_FAILURE(mpc_err_count(r.error, p->data.repeat.n));
-            } else {
-              mpc_stack_popr(stk, &r);
-              mpc_stack_err(stk, r.error);
-              mpc_input_unmark(i);
-              MPC_SUCCESS(mpc_stack_merger_out(stk, st-1, p->data.repeat.f));
-            }
-          }
-        }
-        
-      /* Combinatory Parsers */
-      
-      case MPC_TYPE_OR:
-        
-        if (p->data.or.n == 0) { MPC_SUCCESS(NULL); }
-        
-        if (st == 0) { MPC_CONTINUE(st+1, p->data.or.xs[st]); }
-        if (st <= p->data.or.n) {
-          if (mpc_stack_peekr(stk, &r)) {
-            mpc_stack_popr(stk, &r);
-            mpc_stack_popr_err(stk, st-1);
-            MPC_SUCCESS(r.output);
-          }
-          if (st <  p->data.or.n) { MPC_CONTINUE(st+1, p->data.or.xs[st]); }
-          if (st == p->data.or.n) { MPC_FAILURE(mpc_stack_merger_err(stk, p->data.or.n)); }
-        }
-      
-      case MPC_TYPE_AND:
-        
-        if (p->data.and.n == 0) { MPC_SUCCESS(p->data.and.f(0, NULL)); }
-        
-        if (st == 0) { mpc_input_mark(i); MPC_CONTINUE(st+1, p->data.and.xs[st]); }
-        if (st <= p->data.and.n) {
-          if (!mpc_stack_peekr(stk, &r)) {
-            mpc_input_rewind(i);
-            mpc_stack_popr(stk, &r);
-            mpc_stack_popr_out(stk, st-1, p->data.and.dxs);
-            MPC_FAILURE(r.error);
-          }
-          if (st <  p->data.and.n) { MPC_CONTINUE(st+1, p->data.and.xs[st]); }
-          if (st == p->data.and.n) { mpc_input_unmark(i); MPC_SUCCESS(mpc_stack_merger_out(stk, p->data.and.n, p->data.and.f)); }
-        }
-      
-      /* End */
-      
-      default:
-        
-        MPC_FAILURE(mpc_err_fail(i->filename, i->state, "Unknown Parser Type Id!"));
-    }
+/* Gets a stack ready for a new parse, keeping the space it has allocated */
+static void mpc_stack_reset(mpc_stack_t *s, const char *filename, int match) {
+  
+  s->frames_num = 0;
+  s->results_num = 0;
+  s->fails_num = 0;
+  s->labels_num = 0;
+  
+  s->err.state = mpc_state_invalid();
+  s->err.recieved = ' ';
+  s->err.failure = "Unknown Error";
+  s->err.labels = 0;
+  s->err.labels_num = 0;
+  
+  if (s->sets_words) {
+    memset(s->set, 0, sizeof(unsigned long) * (unsigned)s->sets_words);
+    memset(s->err_set, 0, sizeof(unsigned long) * (unsigned)s->sets_words);
   }
+  mpc_labels_clear(&s->label_ptrs);
+  mpc_labels_clear(&s->label_texts);
+  while (s->composites_num) { free(s->composites[--s->composites_num]); }
+  
+  s->filename = filename;
+  s->memo = NULL;
+  s->match = match;
+  
+  s->limits = NULL;
+  s->steps = 0;
+  s->limited = NULL;
   
-  return mpc_stack_terminate(stk, final);
+  s->recover = 0;
+  s->recovered_num = 0;
+  s->recovered_kept = 0;
+  s->recovered = NULL;
   
+  s->quiet = 0;
 }
 
-#undef MPC_CONTINUE
-#undef MPC_SUCCESS
-#undef MPC_FAILURE
-#undef MPC_PRIMITIVE
-
-int mpc_parse(const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r) {
-  int x;
-  mpc_input_t *i = mpc_input_new_string(filename, string);
-  x = mpc_parse_input(i, p, r);
-  mpc_input_delete(i);
-  return x;
+static mpc_stack_t *mpc_stack_new(const char *filename, int match) {
+  mpc_stack_t *s = malloc(sizeof(mpc_stack_t));
+  
+  s->frames_slots = 0;
+  s->frames = NULL;
+  
+  s->results_slots = 0;
+  s->results = NULL;
+  s->returns = NULL;
+  
+  s->fails_slots = 0;
+  s->fails = NULL;
+  
+  s->labels_slots = 0;
+  s->labels = NULL;
+  
+  s->err_slots = 0;
+  s->err_labels = NULL;
+  
+  s->sets_words = 0;
+  s->set = NULL;
+  s->err_set = NULL;
+  s->scratch_slots = 0;
+  s->scratch = NULL;
+  memset(&s->label_ptrs, 0, sizeof(mpc_labels_t));
+  memset(&s->label_texts, 0, sizeof(mpc_labels_t));
+  s->composites_num = 0;
+  s->composites_slots = 0;
+  s->composites = NULL;
+  
+  mpc_stack_reset(s, filename, match);
+  
+  return s;
 }
 
-int mpc_parse_file(const char *filename, FILE *file, mpc_parser_t *p, mpc_result_t *r) {
-  int x;
-  mpc_input_t *i = mpc_input_new_file(filename, file);
-  x = mpc_parse_input(i, p, r);
-  mpc_input_delete(i);
-  return x;
+static void mpc_stack_delete(mpc_stack_t *s) {
+  free(s->frames);
+  free(s->results);
+  free(s->returns);
+  free(s->fails);
+  free(s->labels);
+  free(s->err_labels);
+  free(s->set);
+  free(s->err_set);
+  free(s->scratch);
+  mpc_labels_free(&s->label_ptrs);
+  mpc_labels_free(&s->label_texts);
+  while (s->composites_num) { free(s->composites[--s->composites_num]); }
+  free(s->composites);
+  free(s);
 }
 
-int mpc_parse_pipe(const char *filename, FILE *pipe, mpc_parser_t *p, mpc_result_t *r) {
-  int x;
-  mpc_input_t *i = mpc_input_new_pipe(filename, pipe);
-  x = mpc_parse_input(i, p, r);
-  mpc_input_delete(i);
-  return x;
+/* Stack Failure Stuff */
+
+static void mpc_stack_labels_reserve(const char ***labels, int *slots, int n) {
+  if (n > *slots) {
+    while (n > *slots) { *slots = *slots ? *slots * 2 : 16; }
+    *labels = realloc(*labels, sizeof(char*) * (unsigned)*slots);
+  }
 }
 
-int mpc_parse_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r) {
+static void mpc_stack_fail_push(mpc_stack_t *s, mpc_state_t state, char recieved, const char *failure) {
   
-  FILE *f = fopen(filename, "rb");
-  int res;
+  mpc_fail_t *f;
   
-  if (f == NULL) {
-    r->output = NULL;
-    r->error = mpc_err_fail(filename, mpc_state_new(), "Unable to open file!");
-    return 0;
+  if (s->fails_num == s->fails_slots) {
+    s->fails_slots = s->fails_slots ? s->fails_slots * 2 : 16;
+    s->fails = realloc(s->fails, sizeof(mpc_fail_t) * (unsigned)s->fails_slots);
   }
   
-  res = mpc_parse_file(filename, f, p, r);
-  fclose(f);
-  return res;
+  f = &s->fails[s->fails_num++];
+  f->state = state;
+  f->recieved = recieved;
+  f->failure = failure;
+  f->labels = s->labels_num;
+  f->labels_num = 0;
+}
+
+static void mpc_stack_fail_label(mpc_stack_t *s, const char *label) {
+  mpc_stack_labels_reserve(&s->labels, &s->labels_slots, s->labels_num + 1);
+  s->labels[s->labels_num++] = label;
+  s->fails[s->fails_num-1].labels_num++;
+}
+
+static void mpc_stack_fail_pop(mpc_stack_t *s) {
+  s->fails_num--;
+  s->labels_num = s->fails[s->fails_num].labels;
+}
+
+static void mpc_stack_expected(mpc_stack_t *s, mpc_input_t *i, const char *label) {
+  mpc_stack_fail_push(s, mpc_input_state(i), mpc_input_peekc(i), NULL);
+  mpc_stack_fail_label(s, label);
+}
+
+static void mpc_stack_failure(mpc_stack_t *s, mpc_input_t *i, const char *failure) {
+  mpc_stack_fail_push(s, mpc_input_state(i), ' ', failure);
 }
 
 /*
-** Building a Parser
+** Sets of labels are bitsets indexed by label id.
+** Bits are cleared again label by label rather than
+** by clearing the whole set, as only a few are ever
+** set at once.
 */
 
-static void mpc_undefine_unretained(mpc_parser_t *p, int force);
+#define MPC_SET_WORD_BITS (8 * (int)sizeof(unsigned long))
 
-static void mpc_undefine_or(mpc_parser_t *p) {
+static void mpc_stack_sets_reserve(mpc_stack_t *s) {
   
-  int i;
-  for (i = 0; i < p->data.or.n; i++) {
-    mpc_undefine_unretained(p->data.or.xs[i], 0);
-  }
-  free(p->data.or.xs);
+  int words = s->label_texts.num / MPC_SET_WORD_BITS + 1;
   
+  if (words > s->sets_words) {
+    s->set = realloc(s->set, sizeof(unsigned long) * (unsigned)words);
+    s->err_set = realloc(s->err_set, sizeof(unsigned long) * (unsigned)words);
+    memset(s->set + s->sets_words, 0, sizeof(unsigned long) * (unsigned)(words - s->sets_words));
+    memset(s->err_set + s->sets_words, 0, sizeof(unsigned long) * (unsigned)(words - s->sets_words));
+    s->sets_words = words;
+  }
 }
 
-static void mpc_undefine_and(mpc_parser_t *p) {
+/* The id of `label` in this parse, which is the same for every label with the same text */
+static int mpc_stack_label_id(mpc_stack_t *s, const char *label) {
   
-  int i;
-  for (i = 0; i < p->data.and.n; i++) {
-    mpc_undefine_unretained(p->data.and.xs[i], 0);
+  unsigned long k, h = mpc_labels_find(&s->label_ptrs, label, 0, -1);
+  
+  if (s->label_ptrs.ids[h] == -1) {
+    k = mpc_labels_find(&s->label_texts, label, 1, s->label_texts.num);
+    s->label_ptrs.ids[h] = s->label_texts.ids[k];
+    mpc_stack_sets_reserve(s);
   }
-  free(p->data.and.xs);
-  free(p->data.and.dxs);
   
+  return s->label_ptrs.ids[h];
 }
 
-static void mpc_undefine_unretained(mpc_parser_t *p, int force) {
+/* Returns a label with the text of `x` which lasts until the stack is reset */
+static const char *mpc_stack_label_copy(mpc_stack_t *s, const char *x) {
   
-  if (p->retained && !force) { return; }
+  char *y;
+  unsigned long h = mpc_labels_find(&s->label_texts, x, 1, s->label_texts.num);
   
-  switch (p->type) {
-    
-    case MPC_TYPE_FAIL: free(p->data.fail.m); break;
-    
-    case MPC_TYPE_ONEOF: 
-    case MPC_TYPE_NONEOF:
-    case MPC_TYPE_STRING:
-      free(p->data.string.x); 
-      break;
-    
-    case MPC_TYPE_APPLY:    mpc_undefine_unretained(p->data.apply.x, 0);    break;
-    case MPC_TYPE_APPLY_TO: mpc_undefine_unretained(p->data.apply_to.x, 0); break;
-    case MPC_TYPE_PREDICT:  mpc_undefine_unretained(p->data.predict.x, 0);  break;
-    
-    case MPC_TYPE_MAYBE:
-    case MPC_TYPE_NOT:
-      mpc_undefine_unretained(p->data.not.x, 0);
-      break;
-    
-    case MPC_TYPE_EXPECT:
-      mpc_undefine_unretained(p->data.expect.x, 0);
-      free(p->data.expect.m);
-      break;
-      
-    case MPC_TYPE_MANY:
-    case MPC_TYPE_MANY1:
-    case MPC_TYPE_COUNT:
-      mpc_undefine_unretained(p->data.repeat.x, 0);
-      break;
-    
-    case MPC_TYPE_OR:  mpc_undefine_or(p);  break;
-    case MPC_TYPE_AND: mpc_undefine_and(p); break;
-    
-    default: break;
-  }
+  if (s->label_texts.keys[h] != x) { return s->label_texts.keys[h]; }
   
-  if (!force) {
-    free(p->name);
-    free(p);
+  if (s->composites_num == s->composites_slots) {
+    s->composites_slots = s->composites_slots ? s->composites_slots * 2 : 16;
+    s->composites = realloc(s->composites, sizeof(char*) * (unsigned)s->composites_slots);
   }
   
+  y = malloc(strlen(x) + 1);
+  strcpy(y, x);
+  s->composites[s->composites_num++] = y;
+  s->label_texts.keys[h] = y;
+  mpc_stack_sets_reserve(s);
+  return y;
 }
 
-void mpc_delete(mpc_parser_t *p) {
-  if (p->retained) {
+/* Adds `label` to the set `*set`, returning if it was already there */
+static int mpc_stack_set_label(mpc_stack_t *s, unsigned long **set, const char *label) {
+  int id = mpc_stack_label_id(s, label);
+  unsigned long bit = 1UL << (id % MPC_SET_WORD_BITS);
+  if ((*set)[id / MPC_SET_WORD_BITS] & bit) { return 1; }
+  (*set)[id / MPC_SET_WORD_BITS] |= bit;
+  return 0;
+}
 
-    if (p->type != MPC_TYPE_UNDEFINED) {
-      mpc_undefine_unretained(p, 0);
-    } 
-    
-    free(p->name);
-    free(p);
+static void mpc_stack_set_unlabel(mpc_stack_t *s, unsigned long **set, const char *label) {
+  int id = mpc_stack_label_id(s, label);
+  (*set)[id / MPC_SET_WORD_BITS] &= ~(1UL << (id % MPC_SET_WORD_BITS));
+}
+
+/* Merges the failures from the discarded branch on top into `err` */
+static void mpc_stack_err(mpc_stack_t *s) {
+  
+  int j;
+  mpc_fail_t *f = &s->fails[s->fails_num-1];
+  const char **labels = s->labels + f->labels;
+  
+  if (f->state.pos > s->err.state.pos) {
+    for (j = 0; j < s->err.labels_num; j++) { mpc_stack_set_unlabel(s, &s->err_set, s->err_labels[j]); }
+    s->err = *f;
+    s->err.labels_num = 0;
+  } else if (f->state.pos < s->err.state.pos || s->err.failure) {
+    mpc_stack_fail_pop(s);
+    return;
+  }
   
+  if (f->failure) {
+    s->err.failure = f->failure;
   } else {
-    mpc_undefine_unretained(p, 0);  
+    s->err.recieved = f->recieved;
+    for (j = 0; j < f->labels_num; j++) {
+      if (mpc_stack_set_label(s, &s->err_set, labels[j])) { continue; }
+      mpc_stack_labels_reserve(&s->err_labels, &s->err_slots, s->err.labels_num + 1);
+      s->err_labels[s->err.labels_num++] = labels[j];
+    }
   }
+  
+  mpc_stack_fail_pop(s);
 }
 
-static void mpc_soft_delete(mpc_val_t *x) {
-  mpc_undefine_unretained(x, 0);
+static void mpc_stack_err_clear(mpc_stack_t *s) {
+  int j;
+  for (j = 0; j < s->err.labels_num; j++) { mpc_stack_set_unlabel(s, &s->err_set, s->err_labels[j]); }
+  s->err.state = mpc_state_invalid();
+  s->err.state.pos = -2;
+  s->err.failure = NULL;
+  s->err.labels_num = 0;
 }
 
-static mpc_parser_t *mpc_undefined(void) {
-  mpc_parser_t *p = calloc(1, sizeof(mpc_parser_t));
-  p->retained = 0;
-  p->type = MPC_TYPE_UNDEFINED;
-  p->name = NULL;
-  return p;
+static int mpc_stack_err_empty(mpc_stack_t *s) {
+  return s->err.state.pos == -2;
 }
 
-mpc_parser_t *mpc_new(const char *name) {
-  mpc_parser_t *p = mpc_undefined();
-  p->retained = 1;
-  p->name = realloc(p->name, strlen(name) + 1);
-  strcpy(p->name, name);
-  return p;
+/* Pushes `err` as a failure of its own, so it can be merged into some other */
+static void mpc_stack_err_push(mpc_stack_t *s) {
+  int j;
+  mpc_stack_fail_push(s, s->err.state, s->err.recieved, s->err.failure);
+  for (j = 0; j < s->err.labels_num; j++) {
+    mpc_stack_fail_label(s, s->err_labels[j]);
+  }
 }
 
-mpc_parser_t *mpc_undefine(mpc_parser_t *p) {
-  mpc_undefine_unretained(p, 1);
-  p->type = MPC_TYPE_UNDEFINED;
-  return p;
+/* Merges the `n` failures on top into one in the same way as `mpc_err_or` */
+static void mpc_stack_fail_or(mpc_stack_t *s, int n) {
+  
+  int j, k;
+  mpc_fail_t x, *fs = &s->fails[s->fails_num-n];
+  
+  x.state = mpc_state_invalid();
+  for (j = 0; j < n; j++) {
+    if (fs[j].state.pos > x.state.pos) { x.state = fs[j].state; }
+  }
+  
+  x.recieved = ' ';
+  x.failure = NULL;
+  x.labels = fs[0].labels;
+  x.labels_num = 0;
+  
+  /* Labels are only ever moved down the label stack */
+  for (j = 0; j < n; j++) {
+    
+    if (fs[j].state.pos < x.state.pos) { continue; }
+    if (fs[j].failure) { x.failure = fs[j].failure; break; }
+    
+    x.recieved = fs[j].recieved;
+    for (k = 0; k < fs[j].labels_num; k++) {
+      if (mpc_stack_set_label(s, &s->set, s->labels[fs[j].labels + k])) { continue; }
+      s->labels[x.labels + x.labels_num] = s->labels[fs[j].labels + k];
+      x.labels_num++;
+    }
+  }
+  
+  for (j = 0; j < x.labels_num; j++) { mpc_stack_set_unlabel(s, &s->set, s->labels[x.labels + j]); }
+  
+  s->fails_num -= n - 1;
+  s->fails[s->fails_num-1] = x;
+  s->labels_num = x.labels + x.labels_num;
 }
 
-mpc_parser_t *mpc_define(mpc_parser_t *p, mpc_parser_t *a) {
+/* Replaces the labels of the failure on top with one in the same way as `mpc_err_repeat` */
+static void mpc_stack_fail_repeat(mpc_stack_t *s, const char *prefix) {
   
-  if (p->retained) {
-    p->type = a->type;
-    p->data = a->data;
-  } else {
-    mpc_parser_t *a2 = mpc_failf("Attempt to assign to Unretained Parser!");
-    p->type = a2->type;
-    p->data = a2->data;
-    free(a2);
+  int j, length;
+  mpc_fail_t *f = &s->fails[s->fails_num-1];
+  const char **labels = s->labels + f->labels;
+  
+  length = (int)strlen(prefix) + 1;
+  for (j = 0; j < f->labels_num; j++) {
+    length += (int)strlen(labels[j]) + (int)strlen(", ");
   }
   
-  free(a);
-  return p;  
+  if (length > s->scratch_slots) {
+    s->scratch_slots = length;
+    s->scratch = realloc(s->scratch, (unsigned)s->scratch_slots);
+  }
+  
+  strcpy(s->scratch, prefix);
+  for (j = 0; j < f->labels_num; j++) {
+    strcat(s->scratch, labels[j]);
+    if (j <  f->labels_num-2) { strcat(s->scratch, ", "); }
+    if (j == f->labels_num-2) { strcat(s->scratch, " or "); }
+  }
+  
+  s->labels_num = f->labels;
+  f->labels_num = 0;
+  mpc_stack_fail_label(s, mpc_stack_label_copy(s, s->scratch));
 }
 
-void mpc_cleanup(int n, ...) {
-  int i;
-  mpc_parser_t **list = malloc(sizeof(mpc_parser_t*) * n);
+static void mpc_stack_fail_many1(mpc_stack_t *s) {
+  mpc_stack_fail_repeat(s, "one or more of ");
+}
+
+static void mpc_stack_fail_count(mpc_stack_t *s, int n) {
+  char prefix[32];
+  sprintf(prefix, "%i of ", n);
+  mpc_stack_fail_repeat(s, prefix);
+}
+
+static mpc_err_t *mpc_stack_fail_err(mpc_stack_t *s, mpc_fail_t *f, const char **labels) {
   
-  va_list va;
-  va_start(va, n);
-  for (i = 0; i < n; i++) { list[i] = va_arg(va, mpc_parser_t*); }
-  for (i = 0; i < n; i++) { mpc_undefine(list[i]); }
-  for (i = 0; i < n; i++) { mpc_delete(list[i]); }  
-  va_end(va);  
+  int j;
+  mpc_err_t *x = f->failure
+    ? mpc_err_fail(s->filename, f->state, f->failure)
+    : mpc_err_new(s->filename, f->state, "", f->recieved);
+  
+  for (j = 0; j < x->expected_num; j++) { free(x->expected[j]); }
+  x->expected_num = f->labels_num;
+  x->expected = realloc(x->expected, sizeof(char*) * (unsigned)(f->labels_num + 1));
+  for (j = 0; j < f->labels_num; j++) {
+    x->expected[j] = malloc(strlen(labels[j]) + 1);
+    strcpy(x->expected[j], labels[j]);
+  }
+  
+  return x;
+}
 
-  free(list);
+/* The failures merged into `err` as an `mpc_err_t`, or `NULL` if there are none */
+static mpc_err_t *mpc_stack_err_get(mpc_stack_t *s) {
+  if (mpc_stack_err_empty(s)) { return NULL; }
+  return mpc_stack_fail_err(s, &s->err, s->err_labels);
 }
 
-mpc_parser_t *mpc_pass(void) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_PASS;
-  return p;
+/* Deletes the errors recovered from in branches which have since failed */
+static void mpc_stack_recovered_drop(mpc_stack_t *s) {
+  while (s->recovered_num > s->recovered_kept) {
+    mpc_err_delete(s->recovered[--s->recovered_num]);
+  }
 }
 
-mpc_parser_t *mpc_fail(const char *m) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_FAIL;
-  p->data.fail.m = malloc(strlen(m) + 1);
-  strcpy(p->data.fail.m, m);
-  return p;
+/* Records the failure on top as an error that was recovered from */
+static void mpc_stack_recover(mpc_stack_t *s) {
+  mpc_stack_recovered_drop(s);
+  mpc_stack_err(s);
+  s->recovered = realloc(s->recovered, sizeof(mpc_err_t*) * (unsigned)(s->recovered_num + 1));
+  s->recovered[s->recovered_num++] = mpc_stack_err_get(s);
+  s->recovered_kept = s->recovered_num;
+  mpc_stack_err_clear(s);
 }
 
-/*
-** As `snprintf` is not ANSI standard this 
-** function `mpc_failf` should be considered
-** unsafe.
-**
-** You have a few options if this is going to be
-** trouble.
-**
-** - Ensure the format string does not exceed
-**   the buffer length using precision specifiers
-**   such as `%.512s`.
-**
-** - Patch this function in your code base to 
-**   use `snprintf` or whatever variant your
-**   system supports.
-**
-** - Avoid it altogether.
-**
-*/
+/* Adds `x` to the text skipped while recovering, which is the result on top */
+static void mpc_stack_skipped(mpc_stack_t *s, char *x) {
+  char **skipped = (char**)&s->results[s->results_num-1].output;
+  *skipped = realloc(*skipped, strlen(*skipped) + strlen(x) + 1);
+  strcat(*skipped, x);
+  free(x);
+}
 
-mpc_parser_t *mpc_failf(const char *fmt, ...) {
-  
-  va_list va;
-  char *buffer;
+/* Copies `f` and its labels off the stack, to be freed with `free` */
+static mpc_memo_fail_t *mpc_stack_fail_save(mpc_fail_t *f, const char **labels) {
+  mpc_memo_fail_t *x = malloc(sizeof(mpc_memo_fail_t) + sizeof(char*) * (unsigned)f->labels_num);
+  x->fail = *f;
+  x->labels = (const char**)(x + 1);
+  if (f->labels_num) { memcpy(x->labels, labels, sizeof(char*) * (unsigned)f->labels_num); }
+  return x;
+}
 
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_FAIL;
+/* The failures merged into `err` copied off the stack, or `NULL` if there are none */
+static mpc_memo_fail_t *mpc_stack_err_save(mpc_stack_t *s) {
+  if (mpc_stack_err_empty(s)) { return NULL; }
+  return mpc_stack_fail_save(&s->err, s->err_labels);
+}
+
+/* Pushes a failure copied off the stack earlier */
+static void mpc_stack_fail_load(mpc_stack_t *s, mpc_memo_fail_t *x) {
+  int j;
+  mpc_stack_fail_push(s, x->fail.state, x->fail.recieved, x->fail.failure);
+  for (j = 0; j < x->fail.labels_num; j++) {
+    mpc_stack_fail_label(s, x->labels[j]);
+  }
+}
+
+static int mpc_stack_terminate(mpc_stack_t *s, mpc_result_t *r) {
+  int success = s->returns[0];
   
-  va_start(va, fmt);
-  buffer = malloc(2048);
-  vsprintf(buffer, fmt, va);
-  va_end(va);
+  if (success) {
+    r->output = s->results[0].output;
+    mpc_stack_recovered_drop(s);
+  } else if (s->quiet) {
+    /* The failure was only wanted as a yes or no */
+    r->error = NULL;
+  } else {
+    /* Running out of something, or input failing, is the only error worth reporting */
+    if (s->limited) {
+      mpc_stack_err_clear(s);
+      s->fails[s->fails_num-1].failure = s->limited;
+    }
+    mpc_stack_err(s);
+    r->error = mpc_stack_err_get(s);
+  }
   
-  buffer = realloc(buffer, strlen(buffer) + 1);
-  p->data.fail.m = buffer;
-  return p;
+  if (s->memo) { mpc_memo_delete(s->memo); s->memo = NULL; }
+  
+  return success;
+}
 
+/* Stack Parser Stuff */
+
+static void mpc_stack_set_state(mpc_stack_t *s, int x) {
+  s->frames[s->frames_num-1].state = x;
 }
 
-mpc_parser_t *mpc_lift_val(mpc_val_t *x) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_LIFT_VAL;
-  p->data.lift.x = x;
-  return p;
+static void mpc_stack_pushp(mpc_stack_t *s, mpc_parser_t *p) {
+  mpc_frame_t *f;
+  if (s->frames_num == s->frames_slots) {
+    s->frames_slots = s->frames_slots ? s->frames_slots * 2 : 64;
+    s->frames = realloc(s->frames, sizeof(mpc_frame_t) * (unsigned)s->frames_slots);
+  }
+  if (s->recovered_kept < s->recovered_num) { mpc_stack_recovered_drop(s); }
+  f = &s->frames[s->frames_num++];
+  f->parser = p;
+  f->state = 0;
+  f->recovered = s->recovered_num;
 }
 
-mpc_parser_t *mpc_lift(mpc_ctor_t lf) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_LIFT;
-  p->data.lift.lf = lf;
-  return p;
+static void mpc_stack_popp(mpc_stack_t *s, mpc_parser_t **p, int *st) {
+  mpc_frame_t *f = &s->frames[--s->frames_num];
+  *p = f->parser;
+  *st = f->state;
 }
 
-mpc_parser_t *mpc_anchor(int(*f)(char,char)) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_ANCHOR;
-  p->data.anchor.f = f;
-  return p;
+/* Pops a frame which failed, so the errors recovered from while it ran aren't kept */
+static void mpc_stack_popp_failed(mpc_stack_t *s, mpc_parser_t **p, int *st) {
+  mpc_frame_t *f = &s->frames[s->frames_num-1];
+  if (f->recovered < s->recovered_kept) { s->recovered_kept = f->recovered; }
+  mpc_stack_popp(s, p, st);
 }
 
-mpc_parser_t *mpc_state(void) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_STATE;
-  return p;
+static void mpc_stack_peepp(mpc_stack_t *s, mpc_parser_t **p, int *st) {
+  mpc_frame_t *f = &s->frames[s->frames_num-1];
+  *p = f->parser;
+  *st = f->state;
 }
 
-mpc_parser_t *mpc_expect(mpc_parser_t *a, const char *expected) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_EXPECT;
-  p->data.expect.x = a;
-  p->data.expect.m = malloc(strlen(expected) + 1);
-  strcpy(p->data.expect.m, expected);
-  return p;
+static int mpc_stack_empty(mpc_stack_t *s) {
+  return s->frames_num == 0;
 }
 
-/*
-** As `snprintf` is not ANSI standard this 
-** function `mpc_expectf` should be considered
-** unsafe.
-**
-** You have a few options if this is going to be
+/* Stack Result Stuff */
+
+static mpc_result_t mpc_result_err(mpc_err_t *e) {
+  mpc_result_t r;
+  r.error = e;
+  return r;
+}
+
+static mpc_result_t mpc_result_out(mpc_val_t *x) {
+  mpc_result_t r;
+  r.output = x;
+  return r;
+}
+
+static void mpc_stack_pushr(mpc_stack_t *s, mpc_result_t x, int r) {
+  if (s->results_num == s->results_slots) {
+    s->results_slots = s->results_slots ? s->results_slots * 2 : 64;
+    s->results = realloc(s->results, sizeof(mpc_result_t) * (unsigned)s->results_slots);
+    s->returns = realloc(s->returns, sizeof(int) * (unsigned)s->results_slots);
+  }
+  s->results[s->results_num] = x;
+  s->returns[s->results_num] = r;
+  s->results_num++;
+}
+
+static int mpc_stack_popr(mpc_stack_t *s, mpc_result_t *x) {
+  int r;
+  *x = s->results[s->results_num-1];
+  r = s->returns[s->results_num-1];
+  s->results_num--;
+  return r;
+}
+
+static int mpc_stack_peekr(mpc_stack_t *s, mpc_result_t *x) {
+  *x = s->results[s->results_num-1];
+  return s->returns[s->results_num-1];
+}
+
+static void mpc_stack_popr_err(mpc_stack_t *s, int n) {
+  mpc_result_t x;
+  while (n) {
+    mpc_stack_popr(s, &x);
+    mpc_stack_err(s);
+    n--;
+  }
+}
+
+static void mpc_stack_popr_out(mpc_stack_t *s, int n, mpc_dtor_t *ds) {
+  mpc_result_t x;
+  while (n) {
+    mpc_stack_popr(s, &x);
+    if (!s->match) { ds[n-1](x.output); }
+    n--;
+  }
+}
+
+static void mpc_stack_popr_out_single(mpc_stack_t *s, int n, mpc_dtor_t dx) {
+  mpc_result_t x;
+  while (n) {
+    mpc_stack_popr(s, &x);
+    if (!s->match) { dx(x.output); }
+    n--;
+  }
+}
+
+static void mpc_stack_popr_n(mpc_stack_t *s, int n) {
+  mpc_result_t x;
+  while (n) {
+    mpc_stack_popr(s, &x);
+    n--;
+  }
+}
+
+static mpc_val_t *mpc_stack_merger_out(mpc_stack_t *s, int n, mpc_fold_t f) {
+  mpc_val_t *x = s->match ? NULL : f(n, (mpc_val_t**)(&s->results[s->results_num-n]));
+  mpc_stack_popr_n(s, n);
+  return x;
+}
+
+static void mpc_stack_merger_err(mpc_stack_t *s, int n) {
+  mpc_stack_fail_or(s, n);
+  mpc_stack_popr_n(s, n);
+}
+
+/* Stack Dispatch Stuff */
+
+/* The strings of dispatch errors last as long as the parser so aren't copied */
+static void mpc_stack_fail_instance(mpc_stack_t *s, mpc_err_t *t, mpc_input_t *i) {
+  int j;
+  mpc_stack_fail_push(s, mpc_input_state(i), t->failure ? ' ' : mpc_input_peekc(i), t->failure);
+  for (j = 0; j < t->expected_num; j++) {
+    mpc_stack_fail_label(s, t->expected[j]);
+  }
+}
+
+static mpc_dispatch_t *mpc_or_dispatch(mpc_parser_t *p) {
+  mpc_dispatch_t *d = p->data.or.dispatch;
+  return d && d->generation == mpc_generation_of(p) ? d : NULL;
+}
+
+static int mpc_or_none(mpc_parser_t *p, mpc_input_t *i) {
+  mpc_dispatch_t *d = mpc_or_dispatch(p);
+  return d && d->err && mpc_set_has(d->none, mpc_input_symbol(i));
+}
+
+/* Fails the alternatives from `st` on which can't start here, returning the next to run */
+static int mpc_stack_or_skip(mpc_stack_t *s, mpc_input_t *i, mpc_parser_t *p, int st) {
+  
+  int c;
+  mpc_dispatch_t *d = mpc_or_dispatch(p);
+  
+  if (d == NULL) { return st; }
+  
+  c = mpc_input_symbol(i);
+  while (st < d->n && mpc_set_has(d->skip + MPC_SET_BYTES * st, c)) {
+    mpc_stack_fail_instance(s, d->errs[st], i);
+    mpc_stack_pushr(s, mpc_result_err(NULL), 0);
+    st++;
+  }
+  
+  return st;
+}
+
+static int mpc_and_marks(mpc_parser_t *p) {
+  return p->data.and.unmarked == 0 || p->data.and.unmarked != mpc_generation_of(p);
+}
+
+/* Stack Memo Stuff */
+
+static long mpc_input_rewind_limit(mpc_input_t *i) {
+  return i->marks_num > 0 ? i->marks[0] : i->pos;
+}
+
+/* Puts back copies of the errors `e` recovered from, dropping them again if they weren't kept */
+static void mpc_stack_memo_recovered(mpc_stack_t *s, mpc_memo_entry_t *e) {
+  int j, start = s->recovered_num;
+  s->recovered = realloc(s->recovered, sizeof(mpc_err_t*) * (unsigned)(s->recovered_num + e->recovered_num));
+  for (j = 0; j < e->recovered_num; j++) {
+    s->recovered[s->recovered_num++] = mpc_err_copy(e->recovered[j]);
+  }
+  s->recovered_kept = start + e->recovered_kept;
+}
+
+static int mpc_stack_memo_find(mpc_stack_t *s, mpc_input_t *i, mpc_parser_t *p) {
+  
+  int st;
+  mpc_memo_entry_t *e;
+  
+  if (s->memo == NULL) { s->memo = mpc_memo_new(s->match); }
+  
+  e = mpc_memo_find(s->memo, p, i->pos);
+  if (e == NULL) {
+    /* Collect the errors merged while `p` runs separately so they can be remembered */
+    mpc_memo_push(s->memo, p, i->pos, s->frames_num, s->recovered_num, mpc_stack_err_save(s));
+    mpc_stack_err_clear(s);
+    return 0;
+  }
+  
+  i->pos = e->end;
+  i->last = e->last;
+  if (e->err) { mpc_stack_fail_load(s, e->err); mpc_stack_err(s); }
+  if (e->recovered_num) { mpc_stack_memo_recovered(s, e); }
+  
+  mpc_stack_popp(s, &p, &st);
+  if (e->success) {
+    mpc_stack_pushr(s, mpc_result_out(mpc_memo_clone(s->memo, e, e->output)), 1);
+  } else {
+    mpc_stack_fail_load(s, e->fail);
+    mpc_stack_pushr(s, mpc_result_err(NULL), 0);
+  }
+  
+  return 1;
+}
+
+static void mpc_stack_memo_add(mpc_stack_t *s, mpc_input_t *i) {
+  
+  int j, empty;
+  mpc_result_t r;
+  mpc_fail_t *t;
+  mpc_memo_frame_t *f;
+  mpc_memo_entry_t *e;
+  mpc_memo_t *m = s->memo;
+  
+  while (m->frames_num > 0 && m->frames[m->frames_num-1].depth > s->frames_num) {
+    
+    f = &m->frames[--m->frames_num];
+    
+    e = malloc(sizeof(mpc_memo_entry_t));
+    e->p = f->p;
+    e->pos = f->pos;
+    e->end = i->pos;
+    e->last = i->last;
+    e->success = mpc_stack_peekr(s, &r);
+    e->output = NULL;
+    e->fail = NULL;
+    if (e->success) {
+      e->output = mpc_memo_clone(m, e, r.output);
+    } else {
+      t = &s->fails[s->fails_num-1];
+      e->fail = mpc_stack_fail_save(t, s->labels + t->labels);
+    }
+    e->err = mpc_stack_err_save(s);
+    
+    e->recovered_num = s->recovered_num - f->recovered;
+    e->recovered_kept = s->recovered_kept - f->recovered;
+    e->recovered = NULL;
+    if (e->recovered_num) {
+      e->recovered = malloc(sizeof(mpc_err_t*) * (unsigned)e->recovered_num);
+      for (j = 0; j < e->recovered_num; j++) {
+        e->recovered[j] = mpc_err_copy(s->recovered[f->recovered + j]);
+      }
+    }
+    
+    mpc_memo_add(m, e, mpc_input_rewind_limit(i), i->pos);
+    
+    /* Put back the failures from before and merge those made since into them */
+    empty = mpc_stack_err_empty(s);
+    if (!empty) { mpc_stack_err_push(s); }
+    mpc_stack_err_clear(s);
+    if (f->err) {
+      mpc_stack_fail_load(s, f->err);
+      mpc_stack_err(s);
+      free(f->err);
+    }
+    if (!empty) { mpc_stack_err(s); }
+  }
+}
+
+/* Stack Limit Stuff */
+
+/*
+** Once a limit is passed every parser fails as soon
+** as it starts, so whatever is running unwinds as
+** usual, deleting any partial results, and none of
+** the input after is looked at. The same happens
+** when the input can't be read, such as when a File
+** or Source fails to seek.
+*/
+
+static unsigned long mpc_stack_bytes(mpc_stack_t *s, mpc_input_t *i) {
+  
+  unsigned long n = 0;
+  
+  n += (unsigned long)s->frames_slots * sizeof(mpc_frame_t);
+  n += (unsigned long)s->results_slots * (sizeof(mpc_result_t) + sizeof(int));
+  n += (unsigned long)s->fails_slots * sizeof(mpc_fail_t);
+  n += (unsigned long)(s->labels_slots + s->err_slots) * sizeof(char*);
+  n += (unsigned long)s->sets_words * 2 * sizeof(unsigned long);
+  
+  if (s->memo) {
+    n += s->memo->entries_num * sizeof(mpc_memo_entry_t);
+    n += s->memo->buckets_num * sizeof(mpc_memo_entry_t*);
+    n += (unsigned long)s->memo->frames_slots * sizeof(mpc_memo_frame_t);
+  }
+  
+  n += (unsigned long)i->buffer_slots;
+  n += (unsigned long)i->lines_slots * sizeof(long);
+  n += (unsigned long)i->marks_slots * (sizeof(long) + sizeof(char));
+  
+  return n;
+}
+
+static const char *mpc_stack_limited(mpc_stack_t *s, mpc_input_t *i) {
+  
+  mpc_limits_t *l = s->limits;
+  
+  s->steps++;
+  
+  if (s->limited) { return s->limited; }
+  
+  if (i->error) {
+    s->limited = i->error;
+  } else if (l->steps && s->steps > l->steps) {
+    s->limited = "Step limit exceeded";
+  } else if (l->depth && (unsigned long)s->frames_num > l->depth) {
+    s->limited = "Depth limit exceeded";
+  } else if (l->buffer && (unsigned long)i->buffer_slots > l->buffer) {
+    s->limited = "Buffer limit exceeded";
+  } else if (l->memory && mpc_stack_bytes(s, i) > l->memory) {
+    s->limited = "Memory limit exceeded";
+  }
+  
+  return s->limited;
+}
+
+/*
+** This is rather pleasant. The core parsing routine
+** is written in about 200 lines of C.
+**
+** I also love the way in which each parsing type
+** concisely matches some construct or pattern.
+**
+** Particularly nice are the `or` and `and`
+** types which have a broken but mirrored structure
+** with return value and error reflected.
+**
+** When this function was written in recursive form
+** it looked pretty nice. But I've since switched
+** it around to an awkward while loop. It was an
+** unfortunate change for code simplicity but it
+** is noble in the name of performance (and 
+** not smashing the stack).
+**
+** But it is now a pretty ugly beast...
+*/
+
+/*
+** With threaded dispatch every parser type has its
+** own label and each one jumps straight to the next
+** parser on the stack, so the branch predictor sees
+** one indirect jump per type rather than one jump
+** shared by all of them. While memoization is on,
+** the stack and table need checking first so control
+** goes back round the loop instead.
+*/
+
+#ifdef MPC_USE_THREADED
+#define MPC_CASE(t) case MPC_TYPE_##t: mpc_op_##t
+#define MPC_NEXT \
+  if (mpc_stack_empty(stk) || stk->memo || stk->limits || i->error) { continue; } \
+  mpc_stack_peepp(stk, &p, &st); \
+  if ((unsigned char)p->type >= sizeof(mpc_dispatch) / sizeof(mpc_dispatch[0])) { continue; } \
+  goto *mpc_dispatch[(unsigned char)p->type]
+#else
+#define MPC_CASE(t) case MPC_TYPE_##t
+#define MPC_NEXT continue
+#endif
+
+#define MPC_CONTINUE(st, x) mpc_stack_set_state(stk, st); mpc_stack_pushp(stk, x); MPC_NEXT
+#define MPC_SUCCESS(x) mpc_stack_popp(stk, &p, &st); mpc_stack_pushr(stk, mpc_result_out(x), 1); MPC_NEXT
+#define MPC_FAILED mpc_stack_popp_failed(stk, &p, &st); mpc_stack_pushr(stk, mpc_result_err(NULL), 0); MPC_NEXT
+#define MPC_FAILURE(x) x; MPC_FAILED
+#define MPC_PRIMITIVE(x, f) if (f) { MPC_SUCCESS(x); } else { MPC_FAILURE(mpc_stack_failure(stk, i, "Incorrect Input")); }
+
+/*
+** When `match` is set no outputs are made. Every
+** result is `NULL`, and folds, applies, constructors
+** and destructors are not called at all.
+*/
+
+/*
+** When `es` is set parsers made with `mpc_recover`
+** record errors there and skip past them.
+*/
+
+static int mpc_parse_input_stack(mpc_input_t *i, mpc_stack_t *stk, mpc_parser_t *init, mpc_result_t *final, mpc_err_t ***es, int *n) {
+  
+  /* Stack */
+  int st = 0;
+  int match = stk->match;
+  mpc_parser_t *p = NULL;
+  
+  /* Variables */
+  char *s = NULL;
+  char **so = match ? NULL : &s;
+  mpc_result_t r;
+  int x;
+  
+#ifdef MPC_USE_THREADED
+  static const void *const mpc_dispatch[] = {
+    &&mpc_op_UNDEFINED, &&mpc_op_PASS, &&mpc_op_FAIL, &&mpc_op_LIFT,
+    &&mpc_op_LIFT_VAL, &&mpc_op_EXPECT, &&mpc_op_ANCHOR, &&mpc_op_STATE,
+    &&mpc_op_ANY, &&mpc_op_SINGLE, &&mpc_op_ONEOF, &&mpc_op_NONEOF,
+    &&mpc_op_RANGE, &&mpc_op_SATISFY, &&mpc_op_STRING, &&mpc_op_APPLY,
+    &&mpc_op_APPLY_TO, &&mpc_op_PREDICT, &&mpc_op_NOT, &&mpc_op_MAYBE,
+    &&mpc_op_MANY, &&mpc_op_MANY1, &&mpc_op_COUNT, &&mpc_op_OR,
+    &&mpc_op_AND, &&mpc_op_PACKRAT, &&mpc_op_MEMO,
+    &&mpc_op_LIMIT, &&mpc_op_RECOVER
+  };
+#endif
+
+  stk->recover = es != NULL;
+  
+  /* Go! */
+  mpc_stack_pushp(stk, init);
+  
+  while (!mpc_stack_empty(stk)) {
+    
+    if (stk->memo) { mpc_stack_memo_add(stk, i); }
+    
+    mpc_stack_peepp(stk, &p, &st);
+    
+    if ((stk->limits || i->error) && mpc_stack_limited(stk, i) && st == 0) {
+      MPC_FAILURE(mpc_stack_failure(stk, i, stk->limited));
+    }
+    
+    if (stk->memo && stk->memo->packrat && st == 0 && p->retained && mpc_stack_memo_find(stk, i, p)) { continue; }
+    
+    switch (p->type) {
+      
+      /* Basic Parsers */
+
+      MPC_CASE(ANY):           MPC_PRIMITIVE(s, mpc_input_any(i, so));
+      MPC_CASE(SINGLE):        MPC_PRIMITIVE(s, mpc_input_char(i, p->data.single.x, so));
+      MPC_CASE(RANGE):         MPC_PRIMITIVE(s, mpc_input_range(i, p->data.range.x, p->data.range.y, so));
+      MPC_CASE(ONEOF):         MPC_PRIMITIVE(s, mpc_input_oneof(i, p->data.string.x, so));
+      MPC_CASE(NONEOF):        MPC_PRIMITIVE(s, mpc_input_noneof(i, p->data.string.x, so));
+      MPC_CASE(SATISFY):       MPC_PRIMITIVE(s, mpc_input_satisfy(i, p->data.satisfy.f, so));
+      MPC_CASE(STRING):        MPC_PRIMITIVE(s, mpc_input_string(i, p->data.string.x, so));
+      
+      /* Other parsers */
+      
+      MPC_CASE(UNDEFINED):     MPC_FAILURE(mpc_stack_failure(stk, i, "Parser Undefined!"));      
+      MPC_CASE(PASS):          MPC_SUCCESS(NULL);
+      MPC_CASE(FAIL):          MPC_FAILURE(mpc_stack_failure(stk, i, p->data.fail.m));
+      MPC_CASE(LIFT):          MPC_SUCCESS(match ? NULL : p->data.lift.lf());
+      MPC_CASE(LIFT_VAL):      MPC_SUCCESS(p->data.lift.x);
+      MPC_CASE(STATE):         MPC_SUCCESS(match ? NULL : mpc_state_copy(mpc_input_state(i)));
+      
+      MPC_CASE(ANCHOR):
+        if (mpc_input_anchor(i, p->data.anchor.f)) {
+          MPC_SUCCESS(NULL);
+        } else {
+          MPC_FAILURE(mpc_stack_expected(stk, i, "anchor"));
+        }
+      
+      /* Application Parsers */
+      
+      MPC_CASE(EXPECT):
+        if (st == 0) { MPC_CONTINUE(1, p->data.expect.x); }
+        if (st == 1) {
+          if (mpc_stack_popr(stk, &r)) {
+            MPC_SUCCESS(r.output);
+          } else {
+            mpc_stack_fail_pop(stk);
+            MPC_FAILURE(mpc_stack_expected(stk, i, p->data.expect.m));
+          }
+        }
+      
+      MPC_CASE(APPLY):
+        if (st == 0) { MPC_CONTINUE(1, p->data.apply.x); }
+        if (st == 1) {
+          if (mpc_stack_popr(stk, &r)) {
+            MPC_SUCCESS(match ? NULL : p->data.apply.f(r.output));
+          } else {
+            MPC_FAILED;
+          }
+        }
+      
+      MPC_CASE(APPLY_TO):
+        if (st == 0) { MPC_CONTINUE(1, p->data.apply_to.x); }
+        if (st == 1) {
+          if (mpc_stack_popr(stk, &r)) {
+            MPC_SUCCESS(match ? NULL : p->data.apply_to.f(r.output, p->data.apply_to.d));
+          } else {
+            MPC_FAILED;
+          }
+        }
+      
+      MPC_CASE(PREDICT):
+        if (st == 0) { mpc_input_backtrack_disable(i); MPC_CONTINUE(1, p->data.predict.x); }
+        if (st == 1) {
+          mpc_input_backtrack_enable(i);
+          mpc_stack_popp(stk, &p, &st);
+          MPC_NEXT;
+        }
+      
+      MPC_CASE(PACKRAT):
+        if (st == 0) {
+          if (stk->memo == NULL) { stk->memo = mpc_memo_new(stk->match); }
+          if (!stk->memo->packrat) {
+            stk->memo->packrat = stk->frames_num;
+            stk->memo->clone = p->data.memo.clone;
+            stk->memo->dtor = p->data.memo.dx;
+          }
+          MPC_CONTINUE(1, p->data.memo.x);
+        }
+        if (stk->memo->packrat == stk->frames_num) {
+          stk->memo->packrat = 0;
+          mpc_memo_prune(stk->memo, mpc_input_rewind_limit(i), i->pos);
+        }
+        mpc_stack_popp(stk, &p, &st);
+        MPC_NEXT;
+      
+      /* The outermost limits apply, and stay in place once passed */
+      MPC_CASE(LIMIT):
+        if (st == 0) {
+          if (stk->limits == NULL) { stk->limits = p->data.limit.l; stk->steps = 0; }
+          MPC_CONTINUE(1, p->data.limit.x);
+        }
+        if (stk->limits == p->data.limit.l && !stk->limited) { stk->limits = NULL; }
+        if (!stk->limited) {
+          mpc_stack_popp(stk, &p, &st);
+          MPC_NEXT;
+        }
+        if (mpc_stack_popr(stk, &r)) {
+          if (!match) { p->data.limit.dx(r.output); }
+        } else {
+          mpc_stack_fail_pop(stk);
+        }
+        MPC_FAILURE(mpc_stack_failure(stk, i, stk->limited));
+      
+      /* Failures right at the start aren't recovered from, so repeats still end normally */
+      MPC_CASE(RECOVER):
+        if (st == 0) { MPC_CONTINUE(1, p->data.recover.xs[0]); }
+        if (st == 1) {
+          if (mpc_stack_popr(stk, &r)) { MPC_SUCCESS(r.output); }
+          if (!stk->recover || stk->fails[stk->fails_num-1].state.pos <= i->pos) { MPC_FAILED; }
+          mpc_stack_recover(stk);
+          mpc_stack_pushr(stk, mpc_result_out(match ? NULL : mpcf_ctor_str()), 1);
+          MPC_CONTINUE(2, p->data.recover.xs[1]);
+        }
+        if (mpc_stack_popr(stk, &r)) {
+          if (!match) { p->data.recover.dx(r.output); }
+          mpc_stack_popr(stk, &r);
+          MPC_SUCCESS(match ? NULL : p->data.recover.f(r.output));
+        }
+        mpc_stack_fail_pop(stk);
+        if (mpc_input_any(i, so)) {
+          if (!match) { mpc_stack_skipped(stk, s); }
+          MPC_CONTINUE(2, p->data.recover.xs[1]);
+        }
+        mpc_stack_popr(stk, &r);
+        MPC_SUCCESS(match ? NULL : p->data.recover.f(r.output));
+      
+      MPC_CASE(MEMO):
+        if (st == 0) {
+          /* Retained parsers are already looked up in packrat mode */
+          if (!(p->retained && stk->memo && stk->memo->packrat) && mpc_stack_memo_find(stk, i, p)) { MPC_NEXT; }
+          MPC_CONTINUE(1, p->data.memo.x);
+        }
+        mpc_stack_popp(stk, &p, &st);
+        MPC_NEXT;
+      
+      /* Optional Parsers */
+      
+      /* TODO: Update Not Error Message */
+      
+      MPC_CASE(NOT):
+        if (st == 0) { mpc_input_mark(i); MPC_CONTINUE(1, p->data.not.x); }
+        if (st == 1) {
+          if (mpc_stack_popr(stk, &r)) {
+            mpc_input_rewind(i);
+            if (!match) { p->data.not.dx(r.output); }
+            MPC_FAILURE(mpc_stack_expected(stk, i, "opposite"));
+          } else {
+            mpc_input_unmark(i);
+            mpc_stack_err(stk);
+            MPC_SUCCESS(match ? NULL : p->data.not.lf());
+          }
+        }
+      
+      MPC_CASE(MAYBE):
+        if (st == 0) { MPC_CONTINUE(1, p->data.not.x); }
+        if (st == 1) {
+          if (mpc_stack_popr(stk, &r)) {
+            MPC_SUCCESS(r.output);
+          } else {
+            mpc_stack_err(stk);
+            MPC_SUCCESS(match ? NULL : p->data.not.lf());
+          }
+        }
+      
+      /* Repeat Parsers */
+      
+      MPC_CASE(MANY):
+        if (st == 0) { MPC_CONTINUE(st+1, p->data.repeat.x); }
+        if (st >  0) {
+          if (mpc_stack_peekr(stk, &r)) {
+            MPC_CONTINUE(st+1, p->data.repeat.x);
+          } else {
+            mpc_stack_popr(stk, &r);
+            mpc_stack_err(stk);
+            MPC_SUCCESS(mpc_stack_merger_out(stk, st-1, p->data.repeat.f));
+          }
+        }
+      
+      MPC_CASE(MANY1):
+        if (st == 0) { MPC_CONTINUE(st+1, p->data.repeat.x); }
+        if (st >  0) {
+          if (mpc_stack_peekr(stk, &r)) {
+            MPC_CONTINUE(st+1, p->data.repeat.x);
+          } else {
+            if (st == 1) {
+              mpc_stack_popr(stk, &r);
+              MPC_FAILURE(mpc_stack_fail_many1(stk));
+            } else {
+              mpc_stack_popr(stk, &r);
+              mpc_stack_err(stk);
+              MPC_SUCCESS(mpc_stack_merger_out(stk, st-1, p->data.repeat.f));
+            }
+          }
+        }
+      
+      MPC_CASE(COUNT):
+        if (st == 0) { mpc_input_mark(i); MPC_CONTINUE(st+1, p->data.repeat.x); }
+        if (st >  0) {
+          if (mpc_stack_peekr(stk, &r)) {
+            MPC_CONTINUE(st+1, p->data.repeat.x);
+          } else {
+            if (st != (p->data.repeat.n+1)) {
+              mpc_stack_popr(stk, &r);
+              mpc_stack_popr_out_single(stk, st-1, p->data.repeat.dx);
+              mpc_input_rewind(i);
+              MPC_FAILURE(mpc_stack_fail_count(stk, p->data.repeat.n));
+            } else {
+              mpc_stack_popr(stk, &r);
+              mpc_stack_err(stk);
+              mpc_input_unmark(i);
+              MPC_SUCCESS(mpc_stack_merger_out(stk, st-1, p->data.repeat.f));
+            }
+          }
+        }
+        
+      /* Combinatory Parsers */
+      
+      MPC_CASE(OR):
+        
+        if (p->data.or.n == 0) { MPC_SUCCESS(NULL); }
+        
+        if (st == 0 && mpc_or_none(p, i)) { MPC_FAILURE(mpc_stack_fail_instance(stk, p->data.or.dispatch->err, i)); }
+        if (st >  0 && mpc_stack_peekr(stk, &r)) {
+          mpc_stack_popr(stk, &r);
+          mpc_stack_popr_err(stk, st-1);
+          MPC_SUCCESS(r.output);
+        }
+        
+        st = mpc_stack_or_skip(stk, i, p, st);
+        if (st <  p->data.or.n) { MPC_CONTINUE(st+1, p->data.or.xs[st]); }
+        if (st == p->data.or.n) { MPC_FAILURE(mpc_stack_merger_err(stk, p->data.or.n)); }
+      
+      MPC_CASE(AND):
+        
+        if (p->data.and.n == 0) { MPC_SUCCESS(match ? NULL : p->data.and.f(0, NULL)); }
+        
+        if (st == 0) { if (mpc_and_marks(p)) { mpc_input_mark(i); } MPC_CONTINUE(st+1, p->data.and.xs[st]); }
+        if (st <= p->data.and.n) {
+          if (!mpc_stack_peekr(stk, &r)) {
+            if (mpc_and_marks(p)) { mpc_input_rewind(i); }
+            mpc_stack_popr(stk, &r);
+            mpc_stack_popr_out(stk, st-1, p->data.and.dxs);
+            MPC_FAILED;
+          }
+          if (st <  p->data.and.n) { MPC_CONTINUE(st+1, p->data.and.xs[st]); }
+          if (st == p->data.and.n) {
+            if (mpc_and_marks(p)) { mpc_input_unmark(i); }
+            MPC_SUCCESS(mpc_stack_merger_out(stk, p->data.and.n, p->data.and.f));
+          }
+        }
+      
+      /* End */
+      
+      default:
+        
+        MPC_FAILURE(mpc_stack_failure(stk, i, "Unknown Parser Type Id!"));
+    }
+  }
+  
+  x = mpc_stack_terminate(stk, final);
+  
+  /* The errors recovered from are handed over */
+  if (es) {
+    if (stk->recovered_num == 0) { free(stk->recovered); stk->recovered = NULL; }
+    *es = stk->recovered;
+    *n = stk->recovered_num;
+    stk->recovered = NULL;
+  }
+  
+  return x;
+  
+}
+
+#undef MPC_CONTINUE
+#undef MPC_SUCCESS
+#undef MPC_FAILURE
+#undef MPC_FAILED
+#undef MPC_PRIMITIVE
+#undef MPC_CASE
+#undef MPC_NEXT
+
+static int mpc_parse_input_run(mpc_input_t *i, mpc_parser_t *init, mpc_result_t *final, int match, mpc_err_t ***es, int *n) {
+  mpc_stack_t *stk = mpc_stack_new(i->filename, match);
+  int x = mpc_parse_input_stack(i, stk, init, final, es, n);
+  mpc_stack_delete(stk);
+  return x;
+}
+
+int mpc_parse_input(mpc_input_t *i, mpc_parser_t *init, mpc_result_t *final) {
+  return mpc_parse_input_run(i, init, final, 0, NULL, NULL);
+}
+
+int mpc_parse(const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r) {
+  return mpc_parse_n(filename, string, strlen(string), p, r);
+}
+
+int mpc_parse_n(const char *filename, const char *string, size_t length, mpc_parser_t *p, mpc_result_t *r) {
+  int x;
+  mpc_input_t *i = mpc_input_new_string(filename, string, (long)length);
+  x = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  return x;
+}
+
+int mpc_parse_prefix(const char *filename, const char *string, size_t length, size_t *offset, mpc_parser_t *p, mpc_result_t *r) {
+  
+  int x;
+  mpc_input_t *i;
+  
+  if (*offset > length) {
+    r->output = NULL;
+    r->error = mpc_err_fail(filename, mpc_state_new(), "Offset past end of input!");
+    return 0;
+  }
+  
+  /* The whole buffer is the input, so positions and anchors see what comes before */
+  i = mpc_input_new_string(filename, string, (long)length);
+  i->pos = (long)*offset;
+  i->last = *offset > 0 ? string[*offset-1] : '\0';
+  x = mpc_parse_input(i, p, r);
+  if (x) { *offset = (size_t)i->pos; }
+  mpc_input_delete(i);
+  return x;
+}
+
+int mpc_parse_file(const char *filename, FILE *file, mpc_parser_t *p, mpc_result_t *r) {
+  int x;
+  mpc_input_t *i = mpc_input_new_mmap(filename, file);
+  if (i == NULL) { i = mpc_input_new_file(filename, file); }
+  x = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  return x;
+}
+
+int mpc_parse_pipe(const char *filename, FILE *pipe, mpc_parser_t *p, mpc_result_t *r) {
+  int x;
+  mpc_input_t *i = mpc_input_new_pipe(filename, pipe);
+  x = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  return x;
+}
+
+int mpc_parse_prefetch(const char *filename, FILE *file, mpc_parser_t *p, mpc_result_t *r) {
+  int x;
+  mpc_input_t *i = mpc_input_new_prefetch(filename, file);
+  x = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  return x;
+}
+
+int mpc_parse_source(const char *filename, mpc_source_t *s, mpc_parser_t *p, mpc_result_t *r) {
+  int x;
+  mpc_input_t *i = mpc_input_new_source(filename, s);
+  x = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  return x;
+}
+
+int mpc_match(const char *filename, const char *string, mpc_parser_t *p, mpc_err_t **e) {
+  return mpc_match_n(filename, string, strlen(string), p, e);
+}
+
+int mpc_match_n(const char *filename, const char *string, size_t length, mpc_parser_t *p, mpc_err_t **e) {
+  int x;
+  mpc_result_t r;
+  mpc_input_t *i = mpc_input_new_string(filename, string, (long)length);
+  x = mpc_parse_input_run(i, p, &r, 1, NULL, NULL);
+  if (!x && e) { *e = r.error; }
+  if (!x && !e) { mpc_err_delete(r.error); }
+  mpc_input_delete(i);
+  return x;
+}
+
+int mpc_parse_recover(const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r, mpc_err_t ***es, int *n) {
+  int x;
+  mpc_input_t *i = mpc_input_new_string(filename, string, (long)strlen(string));
+  x = mpc_parse_input_run(i, p, r, 0, es, n);
+  mpc_input_delete(i);
+  return x;
+}
+
+int mpc_parse_recover_file(const char *filename, FILE *file, mpc_parser_t *p, mpc_result_t *r, mpc_err_t ***es, int *n) {
+  int x;
+  mpc_input_t *i = mpc_input_new_mmap(filename, file);
+  if (i == NULL) { i = mpc_input_new_file(filename, file); }
+  x = mpc_parse_input_run(i, p, r, 0, es, n);
+  mpc_input_delete(i);
+  return x;
+}
+
+int mpc_parse_recover_pipe(const char *filename, FILE *pipe, mpc_parser_t *p, mpc_result_t *r, mpc_err_t ***es, int *n) {
+  int x;
+  mpc_input_t *i = mpc_input_new_pipe(filename, pipe);
+  x = mpc_parse_input_run(i, p, r, 0, es, n);
+  mpc_input_delete(i);
+  return x;
+}
+
+/*
+** A context keeps the input and stacks of one parse
+** for the next, along with all the space they have
+** grown to, so once it has warmed up parsing many
+** small strings allocates nothing but the results.
+*/
+
+struct mpc_ctx_t {
+  mpc_input_t *input;
+  mpc_stack_t *stack;
+};
+
+mpc_ctx_t *mpc_ctx_new(void) {
+  mpc_ctx_t *c = malloc(sizeof(mpc_ctx_t));
+  c->input = mpc_input_new_string("", "", 0);
+  c->stack = mpc_stack_new("", 0);
+  return c;
+}
+
+void mpc_ctx_delete(mpc_ctx_t *c) {
+  mpc_input_delete(c->input);
+  mpc_stack_delete(c->stack);
+  free(c);
+}
+
+static int mpc_ctx_run(mpc_ctx_t *c, const char *filename, const char *string, size_t length, mpc_parser_t *p, mpc_result_t *r, int match) {
+  mpc_input_reset_string(c->input, filename, string, (long)length);
+  mpc_stack_reset(c->stack, c->input->filename, match);
+  return mpc_parse_input_stack(c->input, c->stack, p, r, NULL, NULL);
+}
+
+int mpc_ctx_parse(mpc_ctx_t *c, const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r) {
+  return mpc_ctx_run(c, filename, string, strlen(string), p, r, 0);
+}
+
+int mpc_ctx_parse_n(mpc_ctx_t *c, const char *filename, const char *string, size_t length, mpc_parser_t *p, mpc_result_t *r) {
+  return mpc_ctx_run(c, filename, string, length, p, r, 0);
+}
+
+int mpc_ctx_match(mpc_ctx_t *c, const char *filename, const char *string, mpc_parser_t *p, mpc_err_t **e) {
+  return mpc_ctx_match_n(c, filename, string, strlen(string), p, e);
+}
+
+int mpc_ctx_match_n(mpc_ctx_t *c, const char *filename, const char *string, size_t length, mpc_parser_t *p, mpc_err_t **e) {
+  mpc_result_t r;
+  int x = mpc_ctx_run(c, filename, string, length, p, &r, 1);
+  if (!x && e) { *e = r.error; }
+  if (!x && !e) { mpc_err_delete(r.error); }
+  return x;
+}
+
+#ifdef MPC_POSIX
+
+int mpc_parse_iov(const char *filename, const struct iovec *iov, int n, mpc_parser_t *p, mpc_result_t *r) {
+  int x;
+  mpc_input_t *i = mpc_input_new_iov(filename, iov, n);
+  x = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  return x;
+}
+
+#endif
+
+int mpc_parse_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r) {
+  
+  FILE *f = fopen(filename, "rb");
+  int res;
+  
+  if (f == NULL) {
+    r->output = NULL;
+    r->error = mpc_err_fail(filename, mpc_state_new(), "Unable to open file!");
+    return 0;
+  }
+  
+  res = mpc_parse_file(filename, f, p, r);
+  fclose(f);
+  return res;
+}
+
+/*
+** Building a Parser
+*/
+
+static void mpc_undefine_unretained(mpc_parser_t *p, int force);
+
+static void mpc_undefine_or(mpc_parser_t *p) {
+  
+  int i;
+  for (i = 0; i < p->data.or.n; i++) {
+    mpc_undefine_unretained(p->data.or.xs[i], 0);
+  }
+  free(p->data.or.xs);
+  mpc_dispatch_delete(p->data.or.dispatch);
+  
+}
+
+static void mpc_undefine_and(mpc_parser_t *p) {
+  
+  int i;
+  for (i = 0; i < p->data.and.n; i++) {
+    mpc_undefine_unretained(p->data.and.xs[i], 0);
+  }
+  free(p->data.and.xs);
+  free(p->data.and.dxs);
+  
+}
+
+static void mpc_undefine_unretained(mpc_parser_t *p, int force) {
+  
+  if (p->retained && !force) { return; }
+  
+  free(p->search);
+  p->search = NULL;
+  
+  switch (p->type) {
+    
+    case MPC_TYPE_FAIL: free(p->data.fail.m); break;
+    
+    case MPC_TYPE_ONEOF: 
+    case MPC_TYPE_NONEOF:
+    case MPC_TYPE_STRING:
+      free(p->data.string.x); 
+      break;
+    
+    case MPC_TYPE_APPLY:    mpc_undefine_unretained(p->data.apply.x, 0);    break;
+    case MPC_TYPE_APPLY_TO: mpc_undefine_unretained(p->data.apply_to.x, 0); break;
+    case MPC_TYPE_PREDICT:  mpc_undefine_unretained(p->data.predict.x, 0);  break;
+    case MPC_TYPE_PACKRAT:
+    case MPC_TYPE_MEMO:
+      mpc_undefine_unretained(p->data.memo.x, 0);
+      break;
+    
+    case MPC_TYPE_LIMIT:
+      mpc_undefine_unretained(p->data.limit.x, 0);
+      free(p->data.limit.l);
+      break;
+    
+    case MPC_TYPE_RECOVER:
+      mpc_undefine_unretained(p->data.recover.xs[0], 0);
+      mpc_undefine_unretained(p->data.recover.xs[1], 0);
+      break;
+    
+    case MPC_TYPE_MAYBE:
+    case MPC_TYPE_NOT:
+      mpc_undefine_unretained(p->data.not.x, 0);
+      break;
+    
+    case MPC_TYPE_EXPECT:
+      mpc_undefine_unretained(p->data.expect.x, 0);
+      free(p->data.expect.m);
+      break;
+      
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+    case MPC_TYPE_COUNT:
+      mpc_undefine_unretained(p->data.repeat.x, 0);
+      break;
+    
+    case MPC_TYPE_OR:  mpc_undefine_or(p);  break;
+    case MPC_TYPE_AND: mpc_undefine_and(p); break;
+    
+    default: break;
+  }
+  
+  if (!force) {
+    mpc_generation_release(p->generation);
+    free(p->name);
+    free(p);
+  }
+  
+}
+
+void mpc_delete(mpc_parser_t *p) {
+  if (p->retained) {
+
+    if (p->type != MPC_TYPE_UNDEFINED) {
+      mpc_undefine_unretained(p, 0);
+    } 
+    
+    free(p->search);
+    mpc_generation_release(p->generation);
+    free(p->name);
+    free(p);
+  
+  } else {
+    mpc_undefine_unretained(p, 0);  
+  }
+}
+
+static void mpc_soft_delete(mpc_val_t *x) {
+  mpc_undefine_unretained(x, 0);
+}
+
+static mpc_parser_t *mpc_undefined(void) {
+  mpc_parser_t *p = calloc(1, sizeof(mpc_parser_t));
+  p->retained = 0;
+  p->type = MPC_TYPE_UNDEFINED;
+  p->name = NULL;
+  return p;
+}
+
+mpc_parser_t *mpc_new(const char *name) {
+  mpc_parser_t *p = mpc_undefined();
+  p->retained = 1;
+  p->name = realloc(p->name, strlen(name) + 1);
+  strcpy(p->name, name);
+  return p;
+}
+
+mpc_parser_t *mpc_undefine(mpc_parser_t *p) {
+  if (p->type != MPC_TYPE_UNDEFINED) { mpc_generation_bump(p); }
+  mpc_undefine_unretained(p, 1);
+  p->type = MPC_TYPE_UNDEFINED;
+  return p;
+}
+
+mpc_parser_t *mpc_define(mpc_parser_t *p, mpc_parser_t *a) {
+  
+  if (p->type != MPC_TYPE_UNDEFINED) { mpc_generation_bump(p); }
+  
+  if (p->retained) {
+    free(p->search);
+    p->search = NULL;
+    p->type = a->type;
+    p->data = a->data;
+  } else {
+    mpc_parser_t *a2 = mpc_failf("Attempt to assign to Unretained Parser!");
+    p->type = a2->type;
+    p->data = a2->data;
+    free(a2);
+  }
+  
+  free(a->search);
+  mpc_generation_release(a->generation);
+  free(a);
+  return p;  
+}
+
+void mpc_cleanup(int n, ...) {
+  int i;
+  mpc_parser_t **list = malloc(sizeof(mpc_parser_t*) * n);
+  
+  va_list va;
+  va_start(va, n);
+  for (i = 0; i < n; i++) { list[i] = va_arg(va, mpc_parser_t*); }
+  
+  /* These are being deleted so need not make any tables out of date */
+  for (i = 0; i < n; i++) {
+    mpc_undefine_unretained(list[i], 1);
+    list[i]->type = MPC_TYPE_UNDEFINED;
+  }
+  for (i = 0; i < n; i++) { mpc_delete(list[i]); }  
+  va_end(va);  
+
+  free(list);
+}
+
+mpc_parser_t *mpc_pass(void) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_PASS;
+  return p;
+}
+
+mpc_parser_t *mpc_fail(const char *m) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_FAIL;
+  p->data.fail.m = malloc(strlen(m) + 1);
+  strcpy(p->data.fail.m, m);
+  return p;
+}
+
+/*
+** As `snprintf` is not ANSI standard this 
+** function `mpc_failf` should be considered
+** unsafe.
+**
+** You have a few options if this is going to be
+** trouble.
+**
+** - Ensure the format string does not exceed
+**   the buffer length using precision specifiers
+**   such as `%.512s`.
+**
+** - Patch this function in your code base to 
+**   use `snprintf` or whatever variant your
+**   system supports.
+**
+** - Avoid it altogether.
+**
+*/
+
+mpc_parser_t *mpc_failf(const char *fmt, ...) {
+  
+  va_list va;
+  char *buffer;
+
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_FAIL;
+  
+  va_start(va, fmt);
+  buffer = malloc(2048);
+  vsprintf(buffer, fmt, va);
+  va_end(va);
+  
+  buffer = realloc(buffer, strlen(buffer) + 1);
+  p->data.fail.m = buffer;
+  return p;
+
+}
+
+mpc_parser_t *mpc_lift_val(mpc_val_t *x) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_LIFT_VAL;
+  p->data.lift.x = x;
+  return p;
+}
+
+mpc_parser_t *mpc_lift(mpc_ctor_t lf) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_LIFT;
+  p->data.lift.lf = lf;
+  return p;
+}
+
+mpc_parser_t *mpc_anchor(int(*f)(char,char)) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_ANCHOR;
+  p->data.anchor.f = f;
+  return p;
+}
+
+mpc_parser_t *mpc_state(void) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_STATE;
+  return p;
+}
+
+mpc_parser_t *mpc_expect(mpc_parser_t *a, const char *expected) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_EXPECT;
+  p->data.expect.x = a;
+  p->data.expect.m = malloc(strlen(expected) + 1);
+  strcpy(p->data.expect.m, expected);
+  return p;
+}
+
+/*
+** As `snprintf` is not ANSI standard this 
+** function `mpc_expectf` should be considered
+** unsafe.
+**
+** You have a few options if this is going to be
 ** trouble.
 **
-** - Ensure the format string does not exceed
-**   the buffer length using precision specifiers
-**   such as `%.512s`.
+** - Ensure the format string does not exceed
+**   the buffer length using precision specifiers
+**   such as `%.512s`.
+**
+** - Patch this function in your code base to 
+**   use `snprintf` or whatever variant your
+**   system supports.
+**
+** - Avoid it altogether.
+**
+*/
+
+mpc_parser_t *mpc_expectf(mpc_parser_t *a, const char *fmt, ...) {
+  va_list va;
+  char *buffer;
+
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_EXPECT;
+  
+  va_start(va, fmt);
+  buffer = malloc(2048);
+  vsprintf(buffer, fmt, va);
+  va_end(va);
+  
+  buffer = realloc(buffer, strlen(buffer) + 1);
+  p->data.expect.x = a;
+  p->data.expect.m = buffer;
+  return p;
+}
+
+/*
+** Basic Parsers
+*/
+
+mpc_parser_t *mpc_any(void) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_ANY;
+  return mpc_expect(p, "any character");
+}
+
+mpc_parser_t *mpc_char(char c) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_SINGLE;
+  p->data.single.x = c;
+  return mpc_expectf(p, "'%c'", c);
+}
+
+mpc_parser_t *mpc_range(char s, char e) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_RANGE;
+  p->data.range.x = s;
+  p->data.range.y = e;
+  return mpc_expectf(p, "character between '%c' and '%c'", s, e);
+}
+
+mpc_parser_t *mpc_oneof(const char *s) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_ONEOF;
+  p->data.string.x = malloc(strlen(s) + 1);
+  strcpy(p->data.string.x, s);
+  return mpc_expectf(p, "one of '%s'", s);
+}
+
+mpc_parser_t *mpc_noneof(const char *s) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_NONEOF;
+  p->data.string.x = malloc(strlen(s) + 1);
+  strcpy(p->data.string.x, s);
+  return mpc_expectf(p, "one of '%s'", s);
+
+}
+
+mpc_parser_t *mpc_satisfy(int(*f)(char)) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_SATISFY;
+  p->data.satisfy.f = f;
+  return mpc_expectf(p, "character satisfying function %p", f);
+}
+
+mpc_parser_t *mpc_string(const char *s) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_STRING;
+  p->data.string.x = malloc(strlen(s) + 1);
+  strcpy(p->data.string.x, s);
+  return mpc_expectf(p, "\"%s\"", s);
+}
+
+/*
+** Core Parsers
+*/
+
+mpc_parser_t *mpc_apply(mpc_parser_t *a, mpc_apply_t f) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_APPLY;
+  p->data.apply.x = a;
+  p->data.apply.f = f;
+  return p;
+}
+
+mpc_parser_t *mpc_apply_to(mpc_parser_t *a, mpc_apply_to_t f, void *x) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_APPLY_TO;
+  p->data.apply_to.x = a;
+  p->data.apply_to.f = f;
+  p->data.apply_to.d = x;
+  return p;
+}
+
+mpc_parser_t *mpc_predictive(mpc_parser_t *a) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_PREDICT;
+  p->data.predict.x = a;
+  return p;
+}
+
+mpc_parser_t *mpc_packrat(mpc_parser_t *a, mpc_apply_t clone, mpc_dtor_t da) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_PACKRAT;
+  p->data.memo.x = a;
+  p->data.memo.clone = clone;
+  p->data.memo.dx = da;
+  return p;
+}
+
+mpc_parser_t *mpc_memo(mpc_parser_t *a, mpc_apply_t clone, mpc_dtor_t da) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_MEMO;
+  p->data.memo.x = a;
+  p->data.memo.clone = clone;
+  p->data.memo.dx = da;
+  return p;
+}
+
+mpc_parser_t *mpc_limit(mpc_parser_t *a, mpc_dtor_t da, const mpc_limits_t *l) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_LIMIT;
+  p->data.limit.x = a;
+  p->data.limit.dx = da;
+  p->data.limit.l = malloc(sizeof(mpc_limits_t));
+  *p->data.limit.l = *l;
+  return p;
+}
+
+mpc_parser_t *mpc_recover(mpc_parser_t *a, mpc_parser_t *sync, mpc_dtor_t ds, mpc_apply_t f) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_RECOVER;
+  p->data.recover.xs[0] = a;
+  p->data.recover.xs[1] = sync;
+  p->data.recover.dx = ds;
+  p->data.recover.f = f;
+  return p;
+}
+
+mpc_parser_t *mpc_not_lift(mpc_parser_t *a, mpc_dtor_t da, mpc_ctor_t lf) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_NOT;
+  p->data.not.x = a;
+  p->data.not.dx = da;
+  p->data.not.lf = lf;
+  return p;
+}
+
+mpc_parser_t *mpc_not(mpc_parser_t *a, mpc_dtor_t da) {
+  return mpc_not_lift(a, da, mpcf_ctor_null);
+}
+
+mpc_parser_t *mpc_maybe_lift(mpc_parser_t *a, mpc_ctor_t lf) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_MAYBE;
+  p->data.not.x = a;
+  p->data.not.lf = lf;
+  return p;
+}
+
+mpc_parser_t *mpc_maybe(mpc_parser_t *a) {
+  return mpc_maybe_lift(a, mpcf_ctor_null);
+}
+
+mpc_parser_t *mpc_many(mpc_fold_t f, mpc_parser_t *a) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_MANY;
+  p->data.repeat.x = a;
+  p->data.repeat.f = f;
+  return p;
+}
+
+mpc_parser_t *mpc_many1(mpc_fold_t f, mpc_parser_t *a) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_MANY1;
+  p->data.repeat.x = a;
+  p->data.repeat.f = f;
+  return p;
+}
+
+mpc_parser_t *mpc_count(int n, mpc_fold_t f, mpc_parser_t *a, mpc_dtor_t da) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_COUNT;
+  p->data.repeat.n = n;
+  p->data.repeat.f = f;
+  p->data.repeat.x = a;
+  p->data.repeat.dx = da;
+  return p;
+}
+
+mpc_parser_t *mpc_or(int n, ...) {
+
+  int i;
+  va_list va;
+
+  mpc_parser_t *p = mpc_undefined();
+  
+  p->type = MPC_TYPE_OR;
+  p->data.or.n = n;
+  p->data.or.xs = malloc(sizeof(mpc_parser_t*) * n);
+  p->data.or.dispatch = NULL;
+  
+  va_start(va, n);  
+  for (i = 0; i < n; i++) {
+    p->data.or.xs[i] = va_arg(va, mpc_parser_t*);
+  }
+  va_end(va);
+  
+  return p;
+}
+
+mpc_parser_t *mpc_and(int n, mpc_fold_t f, ...) {
+
+  int i;
+  va_list va;
+
+  mpc_parser_t *p = mpc_undefined();
+  
+  p->type = MPC_TYPE_AND;
+  p->data.and.n = n;
+  p->data.and.unmarked = 0;
+  p->data.and.f = f;
+  p->data.and.xs = malloc(sizeof(mpc_parser_t*) * n);
+  p->data.and.dxs = malloc(sizeof(mpc_dtor_t) * (n-1));
+
+  va_start(va, f);  
+  for (i = 0; i < n; i++) {
+    p->data.and.xs[i] = va_arg(va, mpc_parser_t*);
+  }
+  for (i = 0; i < (n-1); i++) {
+    p->data.and.dxs[i] = va_arg(va, mpc_dtor_t);
+  }  
+  va_end(va);
+  
+  return p;
+}
+
+/*
+** Common Parsers
+*/
+
+static int mpc_soi_anchor(char prev, char next) { (void) next; return (prev == '\0'); }
+static int mpc_eoi_anchor(char prev, char next) { (void) prev; return (next == '\0'); }
+
+mpc_parser_t *mpc_soi(void) { return mpc_expect(mpc_anchor(mpc_soi_anchor), "start of input"); }
+mpc_parser_t *mpc_eoi(void) { return mpc_expect(mpc_anchor(mpc_eoi_anchor), "end of input"); }
+
+static int mpc_boundary_anchor(char prev, char next) {
+  const char* word = "abcdefghijklmnopqrstuvwxyz"
+                     "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                     "0123456789_";
+  if ( strchr(word, next) &&  prev == '\0') { return 1; }
+  if ( strchr(word, prev) &&  next == '\0') { return 1; }
+  if ( strchr(word, next) && !strchr(word, prev)) { return 1; }
+  if (!strchr(word, next) &&  strchr(word, prev)) { return 1; }
+  return 0;
+}
+
+mpc_parser_t *mpc_boundary(void) { return mpc_expect(mpc_anchor(mpc_boundary_anchor), "boundary"); }
+
+mpc_parser_t *mpc_whitespace(void) { return mpc_expect(mpc_oneof(" \f\n\r\t\v"), "whitespace"); }
+mpc_parser_t *mpc_whitespaces(void) { return mpc_expect(mpc_many(mpcf_strfold, mpc_whitespace()), "spaces"); }
+mpc_parser_t *mpc_blank(void) { return mpc_expect(mpc_apply(mpc_whitespaces(), mpcf_free), "whitespace"); }
+
+mpc_parser_t *mpc_newline(void) { return mpc_expect(mpc_char('\n'), "newline"); }
+mpc_parser_t *mpc_tab(void) { return mpc_expect(mpc_char('\t'), "tab"); }
+mpc_parser_t *mpc_escape(void) { return mpc_and(2, mpcf_strfold, mpc_char('\\'), mpc_any(), free); }
+
+mpc_parser_t *mpc_digit(void) { return mpc_expect(mpc_oneof("0123456789"), "digit"); }
+mpc_parser_t *mpc_hexdigit(void) { return mpc_expect(mpc_oneof("0123456789ABCDEFabcdef"), "hex digit"); }
+mpc_parser_t *mpc_octdigit(void) { return mpc_expect(mpc_oneof("01234567"), "oct digit"); }
+mpc_parser_t *mpc_digits(void) { return mpc_expect(mpc_many1(mpcf_strfold, mpc_digit()), "digits"); }
+mpc_parser_t *mpc_hexdigits(void) { return mpc_expect(mpc_many1(mpcf_strfold, mpc_hexdigit()), "hex digits"); }
+mpc_parser_t *mpc_octdigits(void) { return mpc_expect(mpc_many1(mpcf_strfold, mpc_octdigit()), "oct digits"); }
+
+mpc_parser_t *mpc_lower(void) { return mpc_expect(mpc_oneof("abcdefghijklmnopqrstuvwxyz"), "lowercase letter"); }
+mpc_parser_t *mpc_upper(void) { return mpc_expect(mpc_oneof("ABCDEFGHIJKLMNOPQRSTUVWXYZ"), "uppercase letter"); }
+mpc_parser_t *mpc_alpha(void) { return mpc_expect(mpc_oneof("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"), "letter"); }
+mpc_parser_t *mpc_underscore(void) { return mpc_expect(mpc_char('_'), "underscore"); }
+mpc_parser_t *mpc_alphanum(void) { return mpc_expect(mpc_or(3, mpc_alpha(), mpc_digit(), mpc_underscore()), "alphanumeric"); }
+
+mpc_parser_t *mpc_int(void) { return mpc_expect(mpc_apply(mpc_digits(), mpcf_int), "integer"); }
+mpc_parser_t *mpc_hex(void) { return mpc_expect(mpc_apply(mpc_hexdigits(), mpcf_hex), "hexadecimal"); }
+mpc_parser_t *mpc_oct(void) { return mpc_expect(mpc_apply(mpc_octdigits(), mpcf_oct), "octadecimal"); }
+mpc_parser_t *mpc_number(void) { return mpc_expect(mpc_or(3, mpc_int(), mpc_hex(), mpc_oct()), "number"); }
+
+mpc_parser_t *mpc_real(void) {
+
+  /* [+-]?\d+(\.\d+)?([eE][+-]?[0-9]+)? */
+  
+  mpc_parser_t *p0, *p1, *p2, *p30, *p31, *p32, *p3;
+  
+  p0 = mpc_maybe_lift(mpc_oneof("+-"), mpcf_ctor_str);
+  p1 = mpc_digits();
+  p2 = mpc_maybe_lift(mpc_and(2, mpcf_strfold, mpc_char('.'), mpc_digits(), free), mpcf_ctor_str);
+  p30 = mpc_oneof("eE");
+  p31 = mpc_maybe_lift(mpc_oneof("+-"), mpcf_ctor_str);
+  p32 = mpc_digits();
+  p3 = mpc_maybe_lift(mpc_and(3, mpcf_strfold, p30, p31, p32, free, free), mpcf_ctor_str);
+  
+  return mpc_expect(mpc_and(4, mpcf_strfold, p0, p1, p2, p3, free, free, free), "real");
+
+}
+
+mpc_parser_t *mpc_float(void) {
+  return mpc_expect(mpc_apply(mpc_real(), mpcf_float), "float");
+}
+
+mpc_parser_t *mpc_char_lit(void) {
+  return mpc_expect(mpc_between(mpc_or(2, mpc_escape(), mpc_any()), free, "'", "'"), "char");
+}
+
+mpc_parser_t *mpc_string_lit(void) {
+  mpc_parser_t *strchar = mpc_or(2, mpc_escape(), mpc_noneof("\""));
+  return mpc_expect(mpc_between(mpc_many(mpcf_strfold, strchar), free, "\"", "\""), "string");
+}
+
+mpc_parser_t *mpc_regex_lit(void) {  
+  mpc_parser_t *regexchar = mpc_or(2, mpc_escape(), mpc_noneof("/"));
+  return mpc_expect(mpc_between(mpc_many(mpcf_strfold, regexchar), free, "/", "/"), "regex");
+}
+
+mpc_parser_t *mpc_ident(void) {
+  mpc_parser_t *p0, *p1; 
+  p0 = mpc_or(2, mpc_alpha(), mpc_underscore());
+  p1 = mpc_many(mpcf_strfold, mpc_alphanum()); 
+  return mpc_and(2, mpcf_strfold, p0, p1, free);
+}
+
+/*
+** Useful Parsers
+*/
+
+mpc_parser_t *mpc_startwith(mpc_parser_t *a) { return mpc_and(2, mpcf_snd, mpc_soi(), a, mpcf_dtor_null); }
+mpc_parser_t *mpc_endwith(mpc_parser_t *a, mpc_dtor_t da) { return mpc_and(2, mpcf_fst, a, mpc_eoi(), da); }
+mpc_parser_t *mpc_whole(mpc_parser_t *a, mpc_dtor_t da) { return mpc_and(3, mpcf_snd, mpc_soi(), a, mpc_eoi(), mpcf_dtor_null, da); }
+
+mpc_parser_t *mpc_stripl(mpc_parser_t *a) { return mpc_and(2, mpcf_snd, mpc_blank(), a, mpcf_dtor_null); }
+mpc_parser_t *mpc_stripr(mpc_parser_t *a) { return mpc_and(2, mpcf_fst, a, mpc_blank(), mpcf_dtor_null); }
+mpc_parser_t *mpc_strip(mpc_parser_t *a) { return mpc_and(3, mpcf_snd, mpc_blank(), a, mpc_blank(), mpcf_dtor_null, mpcf_dtor_null); }
+mpc_parser_t *mpc_tok(mpc_parser_t *a) { return mpc_and(2, mpcf_fst, a, mpc_blank(), mpcf_dtor_null); }
+mpc_parser_t *mpc_sym(const char *s) { return mpc_tok(mpc_string(s)); }
+
+mpc_parser_t *mpc_total(mpc_parser_t *a, mpc_dtor_t da) { return mpc_whole(mpc_strip(a), da); }
+
+mpc_parser_t *mpc_between(mpc_parser_t *a, mpc_dtor_t ad, const char *o, const char *c) {
+  return mpc_and(3, mpcf_snd_free,
+    mpc_string(o), a, mpc_string(c),
+    free, ad);
+}
+
+mpc_parser_t *mpc_parens(mpc_parser_t *a, mpc_dtor_t ad)   { return mpc_between(a, ad, "(", ")"); }
+mpc_parser_t *mpc_braces(mpc_parser_t *a, mpc_dtor_t ad)   { return mpc_between(a, ad, "<", ">"); }
+mpc_parser_t *mpc_brackets(mpc_parser_t *a, mpc_dtor_t ad) { return mpc_between(a, ad, "{", "}"); }
+mpc_parser_t *mpc_squares(mpc_parser_t *a, mpc_dtor_t ad)  { return mpc_between(a, ad, "[", "]"); }
+
+mpc_parser_t *mpc_tok_between(mpc_parser_t *a, mpc_dtor_t ad, const char *o, const char *c) {
+  return mpc_and(3, mpcf_snd_free,
+    mpc_sym(o), mpc_tok(a), mpc_sym(c),
+    free, ad);
+}
+
+mpc_parser_t *mpc_tok_parens(mpc_parser_t *a, mpc_dtor_t ad)   { return mpc_tok_between(a, ad, "(", ")"); }
+mpc_parser_t *mpc_tok_braces(mpc_parser_t *a, mpc_dtor_t ad)   { return mpc_tok_between(a, ad, "<", ">"); }
+mpc_parser_t *mpc_tok_brackets(mpc_parser_t *a, mpc_dtor_t ad) { return mpc_tok_between(a, ad, "{", "}"); }
+mpc_parser_t *mpc_tok_squares(mpc_parser_t *a, mpc_dtor_t ad)  { return mpc_tok_between(a, ad, "[", "]"); }
+
+/*
+** Regular Expression Parsers
+*/
+
+/*
+** So here is a cute bootstrapping.
+**
+** I'm using the previously defined
+** mpc constructs and functions to
+** parse the user regex string and
+** construct a parser from it.
+**
+** As it turns out lots of the standard
+** mpc functions look a lot like `fold`
+** functions and so can be used indirectly
+** by many of the parsing functions to build
+** a parser directly - as we are parsing.
+**
+** This is certainly something that
+** would be less elegant/interesting 
+** in a two-phase parser which first
+** builds an AST and then traverses it
+** to generate the object.
 **
-** - Patch this function in your code base to 
-**   use `snprintf` or whatever variant your
-**   system supports.
+** This whole thing acts as a great
+** case study for how trivial it can be
+** to write a great parser in a few
+** lines of code using mpc.
+*/
+
+/*
 **
-** - Avoid it altogether.
+**  ### Regular Expression Grammar
+**
+**      <regex> : <term> | (<term> "|" <regex>)
+**     
+**      <term> : <factor>*
 **
+**      <factor> : <base>
+**               | <base> "*"
+**               | <base> "+"
+**               | <base> "?"
+**               | <base> "{" <digits> "}"
+**           
+**      <base> : <char>
+**             | "\" <char>
+**             | "(" <regex> ")"
+**             | "[" <range> "]"
 */
 
-mpc_parser_t *mpc_expectf(mpc_parser_t *a, const char *fmt, ...) {
-  va_list va;
-  char *buffer;
+static mpc_val_t *mpcf_re_or(int n, mpc_val_t **xs) {
+  (void) n;
+  if (xs[1] == NULL) { return xs[0]; }
+  else { return mpc_or(2, xs[0], xs[1]); }
+}
 
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_EXPECT;
+static mpc_val_t *mpcf_re_and(int n, mpc_val_t **xs) {
+  int i;
+  mpc_parser_t *p = mpc_lift(mpcf_ctor_str);
+  for (i = 0; i < n; i++) {
+    p = mpc_and(2, mpcf_strfold, p, xs[i], free);
+  }
+  return p;
+}
+
+static mpc_val_t *mpcf_re_repeat(int n, mpc_val_t **xs) {
+  int num;
+  (void) n;
+  if (xs[1] == NULL) { return xs[0]; }
+  if (strcmp(xs[1], "*") == 0) { free(xs[1]); return mpc_many(mpcf_strfold, xs[0]); }
+  if (strcmp(xs[1], "+") == 0) { free(xs[1]); return mpc_many1(mpcf_strfold, xs[0]); }
+  if (strcmp(xs[1], "?") == 0) { free(xs[1]); return mpc_maybe_lift(xs[0], mpcf_ctor_str); }
+  num = *(int*)xs[1];
+  free(xs[1]);
   
-  va_start(va, fmt);
-  buffer = malloc(2048);
-  vsprintf(buffer, fmt, va);
-  va_end(va);
+  return mpc_count(num, mpcf_strfold, xs[0], free);
+}
+
+static mpc_parser_t *mpc_re_escape_char(char c) {
+  switch (c) {
+    case 'a': return mpc_char('\a');
+    case 'f': return mpc_char('\f');
+    case 'n': return mpc_char('\n');
+    case 'r': return mpc_char('\r');
+    case 't': return mpc_char('\t');
+    case 'v': return mpc_char('\v');
+    case 'b': return mpc_and(2, mpcf_snd, mpc_boundary(), mpc_lift(mpcf_ctor_str), free);
+    case 'B': return mpc_not_lift(mpc_boundary(), free, mpcf_ctor_str);
+    case 'A': return mpc_and(2, mpcf_snd, mpc_soi(), mpc_lift(mpcf_ctor_str), free);
+    case 'Z': return mpc_and(2, mpcf_snd, mpc_eoi(), mpc_lift(mpcf_ctor_str), free);
+    case 'd': return mpc_digit();
+    case 'D': return mpc_not_lift(mpc_digit(), free, mpcf_ctor_str);
+    case 's': return mpc_whitespace();
+    case 'S': return mpc_not_lift(mpc_whitespace(), free, mpcf_ctor_str);
+    case 'w': return mpc_alphanum();
+    case 'W': return mpc_not_lift(mpc_alphanum(), free, mpcf_ctor_str);
+    default: return NULL;
+  }
+}
+
+static mpc_val_t *mpcf_re_escape(mpc_val_t *x) {
   
-  buffer = realloc(buffer, strlen(buffer) + 1);
-  p->data.expect.x = a;
-  p->data.expect.m = buffer;
+  char *s = x;
+  mpc_parser_t *p;
+  
+  /* Regex Special Characters */
+  if (s[0] == '.') { free(s); return mpc_any(); }
+  if (s[0] == '^') { free(s); return mpc_and(2, mpcf_snd, mpc_soi(), mpc_lift(mpcf_ctor_str), free); }
+  if (s[0] == '$') { free(s); return mpc_and(2, mpcf_snd, mpc_eoi(), mpc_lift(mpcf_ctor_str), free); }
+  
+  /* Regex Escape */
+  if (s[0] == '\\') {
+    p = mpc_re_escape_char(s[1]);
+    p = (p == NULL) ? mpc_char(s[1]) : p;
+    free(s);
+    return p;
+  }
+  
+  /* Regex Standard */
+  p = mpc_char(s[0]);
+  free(s);
   return p;
 }
 
+static const char *mpc_re_range_escape_char(char c) {
+  switch (c) {
+    case '-': return "-";
+    case 'a': return "\a";
+    case 'f': return "\f";
+    case 'n': return "\n";
+    case 'r': return "\r";
+    case 't': return "\t";
+    case 'v': return "\v";
+    case 'b': return "\b";
+    case 'd': return "0123456789";
+    case 's': return " \f\n\r\t\v";
+    case 'w': return "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
+    default: return NULL;
+  }
+}
+
+static mpc_val_t *mpcf_re_range(mpc_val_t *x) {
+  
+  mpc_parser_t *out;
+  size_t i, j;
+  size_t start, end;
+  const char *tmp = NULL;
+  const char *s = x;
+  int comp = s[0] == '^' ? 1 : 0;
+  char *range = calloc(1,1);
+  
+  if (s[0] == '\0') { free(x); return mpc_fail("Invalid Regex Range Expression"); } 
+  if (s[0] == '^' && 
+      s[1] == '\0') { free(x); return mpc_fail("Invalid Regex Range Expression"); }
+  
+  for (i = comp; i < strlen(s); i++){
+    
+    /* Regex Range Escape */
+    if (s[i] == '\\') {
+      tmp = mpc_re_range_escape_char(s[i+1]);
+      if (tmp != NULL) {
+        range = realloc(range, strlen(range) + strlen(tmp) + 1);
+        strcat(range, tmp);
+      } else {
+        range = realloc(range, strlen(range) + 1 + 1);
+        range[strlen(range) + 1] = '\0';
+        range[strlen(range) + 0] = s[i+1];      
+      }
+      i++;
+    }
+    
+    /* Regex Range...Range */
+    else if (s[i] == '-') {
+      if (s[i+1] == '\0' || i == 0) {
+          range = realloc(range, strlen(range) + strlen("-") + 1);
+          strcat(range, "-");
+      } else {
+        start = s[i-1]+1;
+        end = s[i+1]-1;
+        for (j = start; j <= end; j++) {
+          range = realloc(range, strlen(range) + 1 + 1);
+          range[strlen(range) + 1] = '\0';
+          range[strlen(range) + 0] = j;
+        }        
+      }
+    }
+    
+    /* Regex Range Normal */
+    else {
+      range = realloc(range, strlen(range) + 1 + 1);
+      range[strlen(range) + 1] = '\0';
+      range[strlen(range) + 0] = s[i];
+    }
+  
+  }
+  
+  out = comp == 1 ? mpc_noneof(range) : mpc_oneof(range);
+  
+  free(x);
+  free(range);
+  
+  return out;
+}
+
+mpc_parser_t *mpc_re(const char *re) {
+  
+  char *err_msg;
+  mpc_parser_t *err_out;
+  mpc_result_t r;
+  mpc_parser_t *Regex, *Term, *Factor, *Base, *Range, *RegexEnclose; 
+  
+  Regex  = mpc_new("regex");
+  Term   = mpc_new("term");
+  Factor = mpc_new("factor");
+  Base   = mpc_new("base");
+  Range  = mpc_new("range");
+  
+  mpc_define(Regex, mpc_and(2, mpcf_re_or,
+    Term, 
+    mpc_maybe(mpc_and(2, mpcf_snd_free, mpc_char('|'), Regex, free)),
+    (mpc_dtor_t)mpc_delete
+  ));
+  
+  mpc_define(Term, mpc_many(mpcf_re_and, Factor));
+  
+  mpc_define(Factor, mpc_and(2, mpcf_re_repeat,
+    Base,
+    mpc_or(5,
+      mpc_char('*'), mpc_char('+'), mpc_char('?'),
+      mpc_brackets(mpc_int(), free),
+      mpc_pass()),
+    (mpc_dtor_t)mpc_delete
+  ));
+  
+  mpc_define(Base, mpc_or(4,
+    mpc_parens(Regex, (mpc_dtor_t)mpc_delete),
+    mpc_squares(Range, (mpc_dtor_t)mpc_delete),
+    mpc_apply(mpc_escape(), mpcf_re_escape),
+    mpc_apply(mpc_noneof(")|"), mpcf_re_escape)
+  ));
+  
+  mpc_define(Range, mpc_apply(
+    mpc_many(mpcf_strfold, mpc_or(2, mpc_escape(), mpc_noneof("]"))),
+    mpcf_re_range
+  ));
+  
+  RegexEnclose = mpc_whole(mpc_predictive(Regex), (mpc_dtor_t)mpc_delete);
+  
+  if(!mpc_parse("<mpc_re_compiler>", re, RegexEnclose, &r)) {
+    err_msg = mpc_err_string(r.error);
+    err_out = mpc_failf("Invalid Regex: %s", err_msg);
+    mpc_err_delete(r.error);  
+    free(err_msg);
+    r.output = err_out;
+  }
+  
+  mpc_delete(RegexEnclose);
+  mpc_cleanup(5, Regex, Term, Factor, Base, Range);
+  
+  return r.output;
+  
+}
+
 /*
-** Basic Parsers
+** Common Fold Functions
 */
 
-mpc_parser_t *mpc_any(void) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_ANY;
-  return mpc_expect(p, "any character");
-}
+void mpcf_dtor_null(mpc_val_t *x) { (void) x; return; }
 
-mpc_parser_t *mpc_char(char c) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_SINGLE;
-  p->data.single.x = c;
-  return mpc_expectf(p, "'%c'", c);
+mpc_val_t *mpcf_ctor_null(void) { return NULL; }
+mpc_val_t *mpcf_ctor_str(void) { return calloc(1, 1); }
+mpc_val_t *mpcf_free(mpc_val_t *x) { free(x); return NULL; }
+
+mpc_val_t *mpcf_int(mpc_val_t *x) {
+  int *y = malloc(sizeof(int));
+  *y = strtol(x, NULL, 10);
+  free(x);
+  return y;
 }
 
-mpc_parser_t *mpc_range(char s, char e) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_RANGE;
-  p->data.range.x = s;
-  p->data.range.y = e;
-  return mpc_expectf(p, "character between '%c' and '%c'", s, e);
+mpc_val_t *mpcf_hex(mpc_val_t *x) {
+  int *y = malloc(sizeof(int));
+  *y = strtol(x, NULL, 16);
+  free(x);
+  return y;
 }
 
-mpc_parser_t *mpc_oneof(const char *s) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_ONEOF;
-  p->data.string.x = malloc(strlen(s) + 1);
-  strcpy(p->data.string.x, s);
-  return mpc_expectf(p, "one of '%s'", s);
+mpc_val_t *mpcf_oct(mpc_val_t *x) {
+  int *y = malloc(sizeof(int));
+  *y = strtol(x, NULL, 8);
+  free(x);
+  return y;
 }
 
-mpc_parser_t *mpc_noneof(const char *s) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_NONEOF;
-  p->data.string.x = malloc(strlen(s) + 1);
-  strcpy(p->data.string.x, s);
-  return mpc_expectf(p, "one of '%s'", s);
+mpc_val_t *mpcf_float(mpc_val_t *x) {
+  float *y = malloc(sizeof(float));
+  *y = strtod(x, NULL);
+  free(x);
+  return y;
+}
 
+mpc_val_t *mpcf_strtriml(mpc_val_t *x) {
+  char *s = x;
+  while (isspace(*s)) {
+    memmove(s, s+1, strlen(s));
+  }
+  return s;
 }
 
-mpc_parser_t *mpc_satisfy(int(*f)(char)) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_SATISFY;
-  p->data.satisfy.f = f;
-  return mpc_expectf(p, "character satisfying function %p", f);
+mpc_val_t *mpcf_strtrimr(mpc_val_t *x) {
+  char *s = x;
+  size_t l = strlen(s);
+  while (isspace(s[l-1])) {
+    s[l-1] = '\0'; l--;
+  }
+  return s;
 }
 
-mpc_parser_t *mpc_string(const char *s) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_STRING;
-  p->data.string.x = malloc(strlen(s) + 1);
-  strcpy(p->data.string.x, s);
-  return mpc_expectf(p, "\"%s\"", s);
+mpc_val_t *mpcf_strtrim(mpc_val_t *x) {
+  return mpcf_strtriml(mpcf_strtrimr(x));
 }
 
-/*
-** Core Parsers
-*/
+static const char mpc_escape_input_c[]  = {
+  '\a', '\b', '\f', '\n', '\r',
+  '\t', '\v', '\\', '\'', '\"', '\0'};
+    
+static const char *mpc_escape_output_c[] = {
+  "\\a", "\\b", "\\f", "\\n", "\\r", "\\t", 
+  "\\v", "\\\\", "\\'", "\\\"", "\\0", NULL};
 
-mpc_parser_t *mpc_apply(mpc_parser_t *a, mpc_apply_t f) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_APPLY;
-  p->data.apply.x = a;
-  p->data.apply.f = f;
-  return p;
-}
+static const char mpc_escape_input_raw_re[] = { '/' };
+static const char *mpc_escape_output_raw_re[] = { "\\/", NULL };
 
-mpc_parser_t *mpc_apply_to(mpc_parser_t *a, mpc_apply_to_t f, void *x) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_APPLY_TO;
-  p->data.apply_to.x = a;
-  p->data.apply_to.f = f;
-  p->data.apply_to.d = x;
-  return p;
+static const char mpc_escape_input_raw_cstr[] = { '"' };
+static const char *mpc_escape_output_raw_cstr[] = { "\\\"", NULL };
+
+static const char mpc_escape_input_raw_cchar[] = { '\'' };
+static const char *mpc_escape_output_raw_cchar[] = { "\\'", NULL };
+
+static mpc_val_t *mpcf_escape_new(mpc_val_t *x, const char *input, const char **output) {
+  
+  int i;
+  int found;
+  char buff[2];
+  char *s = x;
+  char *y = calloc(1, 1);
+  
+  while (*s) {
+    
+    i = 0;
+    found = 0;
+
+    while (output[i]) {
+      if (*s == input[i]) {
+        y = realloc(y, strlen(y) + strlen(output[i]) + 1);
+        strcat(y, output[i]);
+        found = 1;
+        break;
+      }
+      i++;
+    }
+    
+    if (!found) {
+      y = realloc(y, strlen(y) + 2);
+      buff[0] = *s; buff[1] = '\0';
+      strcat(y, buff);
+    }
+    
+    s++;
+  }
+  
+  
+  return y;
 }
 
-mpc_parser_t *mpc_predictive(mpc_parser_t *a) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_PREDICT;
-  p->data.predict.x = a;
-  return p;
+static mpc_val_t *mpcf_unescape_new(mpc_val_t *x, const char *input, const char **output) {
+  
+  int i;
+  int found = 0;
+  char buff[2];
+  char *s = x;
+  char *y = calloc(1, 1);
+  
+  while (*s) {
+    
+    i = 0;
+    found = 0;
+    
+    while (output[i]) {
+      if ((*(s+0)) == output[i][0] &&
+          (*(s+1)) == output[i][1]) {
+        y = realloc(y, strlen(y) + 2);
+        buff[0] = input[i]; buff[1] = '\0';
+        strcat(y, buff);
+        found = 1;
+        s++;
+        break;
+      }
+      i++;
+    }
+    
+    if (!found) {
+      y = realloc(y, strlen(y) + 2);
+      buff[0] = *s; buff[1] = '\0';
+      strcat(y, buff);
+    }
+    
+    if (*s == '\0') { break; }
+    else { s++; }
+  }
+  
+  return y;
+  
 }
 
-mpc_parser_t *mpc_not_lift(mpc_parser_t *a, mpc_dtor_t da, mpc_ctor_t lf) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_NOT;
-  p->data.not.x = a;
-  p->data.not.dx = da;
-  p->data.not.lf = lf;
-  return p;
+mpc_val_t *mpcf_escape(mpc_val_t *x) {
+  mpc_val_t *y = mpcf_escape_new(x, mpc_escape_input_c, mpc_escape_output_c);
+  free(x);
+  return y;
 }
 
-mpc_parser_t *mpc_not(mpc_parser_t *a, mpc_dtor_t da) {
-  return mpc_not_lift(a, da, mpcf_ctor_null);
+mpc_val_t *mpcf_unescape(mpc_val_t *x) {
+  mpc_val_t *y = mpcf_unescape_new(x, mpc_escape_input_c, mpc_escape_output_c);
+  free(x);
+  return y;
 }
 
-mpc_parser_t *mpc_maybe_lift(mpc_parser_t *a, mpc_ctor_t lf) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_MAYBE;
-  p->data.not.x = a;
-  p->data.not.lf = lf;
-  return p;
+mpc_val_t *mpcf_escape_regex(mpc_val_t *x) {
+  mpc_val_t *y = mpcf_escape_new(x, mpc_escape_input_raw_re, mpc_escape_output_raw_re);
+  free(x);
+  return y;  
 }
 
-mpc_parser_t *mpc_maybe(mpc_parser_t *a) {
-  return mpc_maybe_lift(a, mpcf_ctor_null);
+mpc_val_t *mpcf_unescape_regex(mpc_val_t *x) {
+  mpc_val_t *y = mpcf_unescape_new(x, mpc_escape_input_raw_re, mpc_escape_output_raw_re);
+  free(x);
+  return y;  
 }
 
-mpc_parser_t *mpc_many(mpc_fold_t f, mpc_parser_t *a) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_MANY;
-  p->data.repeat.x = a;
-  p->data.repeat.f = f;
-  return p;
+mpc_val_t *mpcf_escape_string_raw(mpc_val_t *x) {
+  mpc_val_t *y = mpcf_escape_new(x, mpc_escape_input_raw_cstr, mpc_escape_output_raw_cstr);
+  free(x);
+  return y;
 }
 
-mpc_parser_t *mpc_many1(mpc_fold_t f, mpc_parser_t *a) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_MANY1;
-  p->data.repeat.x = a;
-  p->data.repeat.f = f;
-  return p;
+mpc_val_t *mpcf_unescape_string_raw(mpc_val_t *x) {
+  mpc_val_t *y = mpcf_unescape_new(x, mpc_escape_input_raw_cstr, mpc_escape_output_raw_cstr);
+  free(x);
+  return y;
 }
 
-mpc_parser_t *mpc_count(int n, mpc_fold_t f, mpc_parser_t *a, mpc_dtor_t da) {
-  mpc_parser_t *p = mpc_undefined();
-  p->type = MPC_TYPE_COUNT;
-  p->data.repeat.n = n;
-  p->data.repeat.f = f;
-  p->data.repeat.x = a;
-  p->data.repeat.dx = da;
-  return p;
+mpc_val_t *mpcf_escape_char_raw(mpc_val_t *x) {
+  mpc_val_t *y = mpcf_escape_new(x, mpc_escape_input_raw_cchar, mpc_escape_output_raw_cchar);
+  free(x);
+  return y;
 }
 
-mpc_parser_t *mpc_or(int n, ...) {
+mpc_val_t *mpcf_unescape_char_raw(mpc_val_t *x) {
+  mpc_val_t *y = mpcf_unescape_new(x, mpc_escape_input_raw_cchar, mpc_escape_output_raw_cchar);
+  free(x);
+  return y;
+}
 
-  int i;
-  va_list va;
+mpc_val_t *mpcf_null(int n, mpc_val_t** xs) { (void) n; (void) xs; return NULL; }
+mpc_val_t *mpcf_fst(int n, mpc_val_t **xs) { (void) n; return xs[0]; }
+mpc_val_t *mpcf_snd(int n, mpc_val_t **xs) { (void) n; return xs[1]; }
+mpc_val_t *mpcf_trd(int n, mpc_val_t **xs) { (void) n; return xs[2]; }
 
-  mpc_parser_t *p = mpc_undefined();
-  
-  p->type = MPC_TYPE_OR;
-  p->data.or.n = n;
-  p->data.or.xs = malloc(sizeof(mpc_parser_t*) * n);
-  
-  va_start(va, n);  
+static mpc_val_t *mpcf_nth_free(int n, mpc_val_t **xs, int x) {
+  int i;
   for (i = 0; i < n; i++) {
-    p->data.or.xs[i] = va_arg(va, mpc_parser_t*);
+    if (i != x) { free(xs[i]); }
   }
-  va_end(va);
-  
-  return p;
+  return xs[x];
 }
+ 
+mpc_val_t *mpcf_fst_free(int n, mpc_val_t **xs) { return mpcf_nth_free(n, xs, 0); }
+mpc_val_t *mpcf_snd_free(int n, mpc_val_t **xs) { return mpcf_nth_free(n, xs, 1); }
+mpc_val_t *mpcf_trd_free(int n, mpc_val_t **xs) { return mpcf_nth_free(n, xs, 2); }
 
-mpc_parser_t *mpc_and(int n, mpc_fold_t f, ...) {
-
+mpc_val_t *mpcf_strfold(int n, mpc_val_t **xs) {
   int i;
-  va_list va;
-
-  mpc_parser_t *p = mpc_undefined();
-  
-  p->type = MPC_TYPE_AND;
-  p->data.and.n = n;
-  p->data.and.f = f;
-  p->data.and.xs = malloc(sizeof(mpc_parser_t*) * n);
-  p->data.and.dxs = malloc(sizeof(mpc_dtor_t) * (n-1));
+  char *x = calloc(1, 1);
 
-  va_start(va, f);  
   for (i = 0; i < n; i++) {
-    p->data.and.xs[i] = va_arg(va, mpc_parser_t*);
+    x = realloc(x, strlen(x) + strlen(xs[i]) + 1);
+    strcat(x, xs[i]);
+    free(xs[i]);
   }
-  for (i = 0; i < (n-1); i++) {
-    p->data.and.dxs[i] = va_arg(va, mpc_dtor_t);
-  }  
-  va_end(va);
+  return x;
+}
+
+mpc_val_t *mpcf_maths(int n, mpc_val_t **xs) {
+  int **vs = (int**)xs;
+  (void) n;
   
-  return p;
+  if (strcmp(xs[1], "*") == 0) { *vs[0] *= *vs[2]; }
+  if (strcmp(xs[1], "/") == 0) { *vs[0] /= *vs[2]; }
+  if (strcmp(xs[1], "%") == 0) { *vs[0] %= *vs[2]; }
+  if (strcmp(xs[1], "+") == 0) { *vs[0] += *vs[2]; }
+  if (strcmp(xs[1], "-") == 0) { *vs[0] -= *vs[2]; }
+  
+  free(xs[1]); free(xs[2]);
+  
+  return xs[0];
 }
 
 /*
-** Common Parsers
+** Printing
 */
 
-static int mpc_soi_anchor(char prev, char next) { (void) next; return (prev == '\0'); }
-static int mpc_eoi_anchor(char prev, char next) { (void) prev; return (next == '\0'); }
-
-mpc_parser_t *mpc_soi(void) { return mpc_expect(mpc_anchor(mpc_soi_anchor), "start of input"); }
-mpc_parser_t *mpc_eoi(void) { return mpc_expect(mpc_anchor(mpc_eoi_anchor), "end of input"); }
-
-static int mpc_boundary_anchor(char prev, char next) {
-  const char* word = "abcdefghijklmnopqrstuvwxyz"
-                     "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-                     "0123456789_";
-  if ( strchr(word, next) &&  prev == '\0') { return 1; }
-  if ( strchr(word, prev) &&  next == '\0') { return 1; }
-  if ( strchr(word, next) && !strchr(word, prev)) { return 1; }
-  if (!strchr(word, next) &&  strchr(word, prev)) { return 1; }
-  return 0;
-}
-
-mpc_parser_t *mpc_boundary(void) { return mpc_expect(mpc_anchor(mpc_boundary_anchor), "boundary"); }
-
-mpc_parser_t *mpc_whitespace(void) { return mpc_expect(mpc_oneof(" \f\n\r\t\v"), "whitespace"); }
-mpc_parser_t *mpc_whitespaces(void) { return mpc_expect(mpc_many(mpcf_strfold, mpc_whitespace()), "spaces"); }
-mpc_parser_t *mpc_blank(void) { return mpc_expect(mpc_apply(mpc_whitespaces(), mpcf_free), "whitespace"); }
-
-mpc_parser_t *mpc_newline(void) { return mpc_expect(mpc_char('\n'), "newline"); }
-mpc_parser_t *mpc_tab(void) { return mpc_expect(mpc_char('\t'), "tab"); }
-mpc_parser_t *mpc_escape(void) { return mpc_and(2, mpcf_strfold, mpc_char('\\'), mpc_any(), free); }
-
-mpc_parser_t *mpc_digit(void) { return mpc_expect(mpc_oneof("0123456789"), "digit"); }
-mpc_parser_t *mpc_hexdigit(void) { return mpc_expect(mpc_oneof("0123456789ABCDEFabcdef"), "hex digit"); }
-mpc_parser_t *mpc_octdigit(void) { return mpc_expect(mpc_oneof("01234567"), "oct digit"); }
-mpc_parser_t *mpc_digits(void) { return mpc_expect(mpc_many1(mpcf_strfold, mpc_digit()), "digits"); }
-mpc_parser_t *mpc_hexdigits(void) { return mpc_expect(mpc_many1(mpcf_strfold, mpc_hexdigit()), "hex digits"); }
-mpc_parser_t *mpc_octdigits(void) { return mpc_expect(mpc_many1(mpcf_strfold, mpc_octdigit()), "oct digits"); }
-
-mpc_parser_t *mpc_lower(void) { return mpc_expect(mpc_oneof("abcdefghijklmnopqrstuvwxyz"), "lowercase letter"); }
-mpc_parser_t *mpc_upper(void) { return mpc_expect(mpc_oneof("ABCDEFGHIJKLMNOPQRSTUVWXYZ"), "uppercase letter"); }
-mpc_parser_t *mpc_alpha(void) { return mpc_expect(mpc_oneof("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"), "letter"); }
-mpc_parser_t *mpc_underscore(void) { return mpc_expect(mpc_char('_'), "underscore"); }
-mpc_parser_t *mpc_alphanum(void) { return mpc_expect(mpc_or(3, mpc_alpha(), mpc_digit(), mpc_underscore()), "alphanumeric"); }
+static void mpc_print_unretained(mpc_parser_t *p, int force) {
+  
+  /* TODO: Print Everything Escaped */
+  
+  int i;
+  char *s, *e;
+  char buff[2];
+  
+  if (p->retained && !force) {;
+    if (p->name) { printf("<%s>", p->name); }
+    else { printf("<anon>"); }
+    return;
+  }
+  
+  if (p->type == MPC_TYPE_UNDEFINED) { printf("<?>"); }
+  if (p->type == MPC_TYPE_PASS)   { printf("<:>"); }
+  if (p->type == MPC_TYPE_FAIL)   { printf("<!>"); }
+  if (p->type == MPC_TYPE_LIFT)   { printf("<#>"); }
+  if (p->type == MPC_TYPE_STATE)  { printf("<S>"); }
+  if (p->type == MPC_TYPE_ANCHOR) { printf("<@>"); }
+  if (p->type == MPC_TYPE_EXPECT) {
+    printf("%s", p->data.expect.m);
+    /*mpc_print_unretained(p->data.expect.x, 0);*/
+  }
+  
+  if (p->type == MPC_TYPE_ANY) { printf("<.>"); }
+  if (p->type == MPC_TYPE_SATISFY) { printf("<f>"); }
 
-mpc_parser_t *mpc_int(void) { return mpc_expect(mpc_apply(mpc_digits(), mpcf_int), "integer"); }
-mpc_parser_t *mpc_hex(void) { return mpc_expect(mpc_apply(mpc_hexdigits(), mpcf_hex), "hexadecimal"); }
-mpc_parser_t *mpc_oct(void) { return mpc_expect(mpc_apply(mpc_octdigits(), mpcf_oct), "octadecimal"); }
-mpc_parser_t *mpc_number(void) { return mpc_expect(mpc_or(3, mpc_int(), mpc_hex(), mpc_oct()), "number"); }
+  if (p->type == MPC_TYPE_SINGLE) {
+    buff[0] = p->data.single.x; buff[1] = '\0';
+    s = mpcf_escape_new(
+      buff,
+      mpc_escape_input_c,
+      mpc_escape_output_c);
+    printf("'%s'", s);
+    free(s);
+  }
+  
+  if (p->type == MPC_TYPE_RANGE) {
+    buff[0] = p->data.range.x; buff[1] = '\0';
+    s = mpcf_escape_new(
+      buff,
+      mpc_escape_input_c,
+      mpc_escape_output_c);
+    buff[0] = p->data.range.y; buff[1] = '\0';
+    e = mpcf_escape_new(
+      buff,
+      mpc_escape_input_c,
+      mpc_escape_output_c);
+    printf("[%s-%s]", s, e);
+    free(s);
+    free(e);
+  }
+  
+  if (p->type == MPC_TYPE_ONEOF) {
+    s = mpcf_escape_new(
+      p->data.string.x,
+      mpc_escape_input_c,
+      mpc_escape_output_c);
+    printf("[%s]", s);
+    free(s);
+  }
+  
+  if (p->type == MPC_TYPE_NONEOF) {
+    s = mpcf_escape_new(
+      p->data.string.x,
+      mpc_escape_input_c,
+      mpc_escape_output_c);
+    printf("[^%s]", s);
+    free(s);
+  }
+  
+  if (p->type == MPC_TYPE_STRING) {
+    s = mpcf_escape_new(
+      p->data.string.x,
+      mpc_escape_input_c,
+      mpc_escape_output_c);
+    printf("\"%s\"", s);
+    free(s);
+  }
+  
+  if (p->type == MPC_TYPE_APPLY)    { mpc_print_unretained(p->data.apply.x, 0); }
+  if (p->type == MPC_TYPE_APPLY_TO) { mpc_print_unretained(p->data.apply_to.x, 0); }
+  if (p->type == MPC_TYPE_PREDICT)  { mpc_print_unretained(p->data.predict.x, 0); }
+  if (p->type == MPC_TYPE_PACKRAT)  { mpc_print_unretained(p->data.memo.x, 0); }
+  if (p->type == MPC_TYPE_MEMO)     { mpc_print_unretained(p->data.memo.x, 0); }
+  if (p->type == MPC_TYPE_LIMIT)    { mpc_print_unretained(p->data.limit.x, 0); }
+  if (p->type == MPC_TYPE_RECOVER)  { mpc_print_unretained(p->data.recover.xs[0], 0); }
 
-mpc_parser_t *mpc_real(void) {
+  if (p->type == MPC_TYPE_NOT)   { mpc_print_unretained(p->data.not.x, 0); printf("!"); }
+  if (p->type == MPC_TYPE_MAYBE) { mpc_print_unretained(p->data.not.x, 0); printf("?"); }
 
-  /* [+-]?\d+(\.\d+)?([eE][+-]?[0-9]+)? */
+  if (p->type == MPC_TYPE_MANY)  { mpc_print_unretained(p->data.repeat.x, 0); printf("*"); }
+  if (p->type == MPC_TYPE_MANY1) { mpc_print_unretained(p->data.repeat.x, 0); printf("+"); }
+  if (p->type == MPC_TYPE_COUNT) { mpc_print_unretained(p->data.repeat.x, 0); printf("{%i}", p->data.repeat.n); }
   
-  mpc_parser_t *p0, *p1, *p2, *p30, *p31, *p32, *p3;
+  if (p->type == MPC_TYPE_OR) {
+    printf("(");
+    for(i = 0; i < p->data.or.n-1; i++) {
+      mpc_print_unretained(p->data.or.xs[i], 0);
+      printf(" | ");
+    }
+    mpc_print_unretained(p->data.or.xs[p->data.or.n-1], 0);
+    printf(")");
+  }
   
-  p0 = mpc_maybe_lift(mpc_oneof("+-"), mpcf_ctor_str);
-  p1 = mpc_digits();
-  p2 = mpc_maybe_lift(mpc_and(2, mpcf_strfold, mpc_char('.'), mpc_digits(), free), mpcf_ctor_str);
-  p30 = mpc_oneof("eE");
-  p31 = mpc_maybe_lift(mpc_oneof("+-"), mpcf_ctor_str);
-  p32 = mpc_digits();
-  p3 = mpc_maybe_lift(mpc_and(3, mpcf_strfold, p30, p31, p32, free, free), mpcf_ctor_str);
+  if (p->type == MPC_TYPE_AND) {
+    printf("(");
+    for(i = 0; i < p->data.and.n-1; i++) {
+      mpc_print_unretained(p->data.and.xs[i], 0);
+      printf(" ");
+    }
+    mpc_print_unretained(p->data.and.xs[p->data.and.n-1], 0);
+    printf(")");
+  }
   
-  return mpc_expect(mpc_and(4, mpcf_strfold, p0, p1, p2, p3, free, free, free), "real");
+}
+
+void mpc_print(mpc_parser_t *p) {
+  mpc_print_unretained(p, 1);
+  printf("\n");
+}
+
+/*
+** Parser Graphs
+*/
+
+/*
+** Parsers refer to each other freely so the set of
+** parsers reachable from some root is a graph which
+** may contain cycles. `mpc_graph_t` collects it in
+** breadth first order, giving each parser an index.
+*/
 
+typedef struct {
+  int nodes_num;
+  int nodes_slots;
+  mpc_parser_t **nodes;
+  unsigned long table_num;
+  int *table;
+} mpc_graph_t;
+
+static int mpc_parser_children(mpc_parser_t *p, mpc_parser_t ***xs) {
+  switch (p->type) {
+    case MPC_TYPE_EXPECT:   *xs = &p->data.expect.x;   return 1;
+    case MPC_TYPE_APPLY:    *xs = &p->data.apply.x;    return 1;
+    case MPC_TYPE_APPLY_TO: *xs = &p->data.apply_to.x; return 1;
+    case MPC_TYPE_PREDICT:  *xs = &p->data.predict.x;  return 1;
+    case MPC_TYPE_LIMIT:    *xs = &p->data.limit.x;    return 1;
+    case MPC_TYPE_RECOVER:  *xs = p->data.recover.xs;  return 2;
+    
+    case MPC_TYPE_MAYBE:
+    case MPC_TYPE_NOT:
+      *xs = &p->data.not.x;
+      return 1;
+    
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+    case MPC_TYPE_COUNT:
+      *xs = &p->data.repeat.x;
+      return 1;
+    
+    case MPC_TYPE_PACKRAT:
+    case MPC_TYPE_MEMO:
+      *xs = &p->data.memo.x;
+      return 1;
+    
+    case MPC_TYPE_OR:  *xs = p->data.or.xs;  return p->data.or.n;
+    case MPC_TYPE_AND: *xs = p->data.and.xs; return p->data.and.n;
+    
+    default: return 0;
+  }
 }
 
-mpc_parser_t *mpc_float(void) {
-  return mpc_expect(mpc_apply(mpc_real(), mpcf_float), "float");
+static unsigned long mpc_graph_slot(mpc_graph_t *g, mpc_parser_t *p) {
+  unsigned long h = (((unsigned long)(size_t)p >> 4) * 2654435761UL) & (g->table_num - 1);
+  while (g->table[h] && g->nodes[g->table[h]-1] != p) { h = (h + 1) & (g->table_num - 1); }
+  return h;
 }
 
-mpc_parser_t *mpc_char_lit(void) {
-  return mpc_expect(mpc_between(mpc_or(2, mpc_escape(), mpc_any()), free, "'", "'"), "char");
+static int mpc_graph_index(mpc_graph_t *g, mpc_parser_t *p) {
+  return g->table[mpc_graph_slot(g, p)] - 1;
 }
 
-mpc_parser_t *mpc_string_lit(void) {
-  mpc_parser_t *strchar = mpc_or(2, mpc_escape(), mpc_noneof("\""));
-  return mpc_expect(mpc_between(mpc_many(mpcf_strfold, strchar), free, "\"", "\""), "string");
+static void mpc_graph_add(mpc_graph_t *g, mpc_parser_t *p) {
+  
+  int j;
+  unsigned long h = mpc_graph_slot(g, p);
+  
+  if (g->table[h]) { return; }
+  
+  if (g->nodes_num == g->nodes_slots) {
+    g->nodes_slots *= 2;
+    g->nodes = realloc(g->nodes, sizeof(mpc_parser_t*) * g->nodes_slots);
+  }
+  
+  g->nodes[g->nodes_num++] = p;
+  g->table[h] = g->nodes_num;
+  
+  if ((unsigned long)g->nodes_num * 2 > g->table_num) {
+    free(g->table);
+    g->table_num *= 2;
+    g->table = calloc(g->table_num, sizeof(int));
+    for (j = 0; j < g->nodes_num; j++) {
+      g->table[mpc_graph_slot(g, g->nodes[j])] = j + 1;
+    }
+  }
 }
 
-mpc_parser_t *mpc_regex_lit(void) {  
-  mpc_parser_t *regexchar = mpc_or(2, mpc_escape(), mpc_noneof("/"));
-  return mpc_expect(mpc_between(mpc_many(mpcf_strfold, regexchar), free, "/", "/"), "regex");
+static void mpc_graph_init(mpc_graph_t *g, mpc_parser_t **roots, int n) {
+  
+  int j, k, m;
+  mpc_parser_t **xs;
+  
+  g->nodes_num = 0;
+  g->nodes_slots = 64;
+  g->nodes = malloc(sizeof(mpc_parser_t*) * g->nodes_slots);
+  g->table_num = 128;
+  g->table = calloc(g->table_num, sizeof(int));
+  
+  for (j = 0; j < n; j++) { mpc_graph_add(g, roots[j]); }
+  for (k = 0; k < g->nodes_num; k++) {
+    m = mpc_parser_children(g->nodes[k], &xs);
+    for (j = 0; j < m; j++) { mpc_graph_add(g, xs[j]); }
+  }
 }
 
-mpc_parser_t *mpc_ident(void) {
-  mpc_parser_t *p0, *p1; 
-  p0 = mpc_or(2, mpc_alpha(), mpc_underscore());
-  p1 = mpc_many(mpcf_strfold, mpc_alphanum()); 
-  return mpc_and(2, mpcf_strfold, p0, p1, free);
+static void mpc_graph_free(mpc_graph_t *g) {
+  free(g->nodes);
+  free(g->table);
 }
 
 /*
-** Useful Parsers
+** Analysis
 */
 
-mpc_parser_t *mpc_startwith(mpc_parser_t *a) { return mpc_and(2, mpcf_snd, mpc_soi(), a, mpcf_dtor_null); }
-mpc_parser_t *mpc_endwith(mpc_parser_t *a, mpc_dtor_t da) { return mpc_and(2, mpcf_fst, a, mpc_eoi(), da); }
-mpc_parser_t *mpc_whole(mpc_parser_t *a, mpc_dtor_t da) { return mpc_and(3, mpcf_snd, mpc_soi(), a, mpc_eoi(), mpcf_dtor_null, da); }
+/*
+** `mpc_analyse` works out, for every parser reachable
+** from some root, whether it can succeed without
+** consuming any input and which bytes it can start
+** with (its FIRST set). A parser is called _exact_
+** when it can never succeed without input and, when
+** the next byte is not in its FIRST set, just fails
+** where it is without touching anything else. Then
+** the error it fails with is always the same apart
+** from where it happened, so it is worked out once
+** here as a template.
+**
+** Each `mpc_or` gets a table giving, for each byte
+** and for the end of input, the exact alternatives
+** which cannot start with it. These are not run and
+** their template errors are used in their place, so
+** results and errors are just the same as before.
+** If no alternative can start with the next byte the
+** whole `mpc_or` fails after a single lookup.
+**
+** If a parser which was already defined is changed
+** with `mpc_define` or `mpc_undefine` the tables no
+** longer match the grammar so they are ignored until
+** `mpc_analyse` is run again.
+*/
 
-mpc_parser_t *mpc_stripl(mpc_parser_t *a) { return mpc_and(2, mpcf_snd, mpc_blank(), a, mpcf_dtor_null); }
-mpc_parser_t *mpc_stripr(mpc_parser_t *a) { return mpc_and(2, mpcf_fst, a, mpc_blank(), mpcf_dtor_null); }
-mpc_parser_t *mpc_strip(mpc_parser_t *a) { return mpc_and(3, mpcf_snd, mpc_blank(), a, mpc_blank(), mpcf_dtor_null, mpcf_dtor_null); }
-mpc_parser_t *mpc_tok(mpc_parser_t *a) { return mpc_and(2, mpcf_fst, a, mpc_blank(), mpcf_dtor_null); }
-mpc_parser_t *mpc_sym(const char *s) { return mpc_tok(mpc_string(s)); }
+static int mpc_analyse_accepts(mpc_parser_t *p, char x) {
+  switch (p->type) {
+    case MPC_TYPE_ANY:     return 1;
+    case MPC_TYPE_SINGLE:  return x == p->data.single.x;
+    case MPC_TYPE_RANGE:   return x >= p->data.range.x && x <= p->data.range.y;
+    case MPC_TYPE_ONEOF:   return x != '\0' && strchr(p->data.string.x, x) != 0;
+    case MPC_TYPE_NONEOF:  return x == '\0' || strchr(p->data.string.x, x) == 0;
+    case MPC_TYPE_SATISFY: return p->data.satisfy.f(x);
+    case MPC_TYPE_STRING:  return x == p->data.string.x[0];
+    default: return 0;
+  }
+}
 
-mpc_parser_t *mpc_total(mpc_parser_t *a, mpc_dtor_t da) { return mpc_whole(mpc_strip(a), da); }
+typedef struct {
+  mpc_graph_t g;
+  char *nullable;
+  char *exact;
+  char *infallible;
+  char *dirty;
+  unsigned char *first;
+  mpc_err_t **errs;
+} mpc_analysis_t;
+
+static int mpc_analysis_consumes(mpc_analysis_t *a, mpc_parser_t *p) {
+  
+  int c;
+  unsigned char *first = a->first + MPC_SET_BYTES * mpc_graph_index(&a->g, p);
+  
+  for (c = 0; c < MPC_SET_BYTES; c++) {
+    if (first[c]) { return 1; }
+  }
+  return 0;
+}
 
-mpc_parser_t *mpc_between(mpc_parser_t *a, mpc_dtor_t ad, const char *o, const char *c) {
-  return mpc_and(3, mpcf_snd_free,
-    mpc_string(o), a, mpc_string(c),
-    free, ad);
+static unsigned char *mpc_analysis_first(mpc_analysis_t *a, mpc_parser_t *p) {
+  return a->first + MPC_SET_BYTES * mpc_graph_index(&a->g, p);
 }
 
-mpc_parser_t *mpc_parens(mpc_parser_t *a, mpc_dtor_t ad)   { return mpc_between(a, ad, "(", ")"); }
-mpc_parser_t *mpc_braces(mpc_parser_t *a, mpc_dtor_t ad)   { return mpc_between(a, ad, "<", ">"); }
-mpc_parser_t *mpc_brackets(mpc_parser_t *a, mpc_dtor_t ad) { return mpc_between(a, ad, "{", "}"); }
-mpc_parser_t *mpc_squares(mpc_parser_t *a, mpc_dtor_t ad)  { return mpc_between(a, ad, "[", "]"); }
+static int mpc_analysis_nullable(mpc_analysis_t *a, mpc_parser_t *p) {
+  return a->nullable[mpc_graph_index(&a->g, p)];
+}
 
-mpc_parser_t *mpc_tok_between(mpc_parser_t *a, mpc_dtor_t ad, const char *o, const char *c) {
-  return mpc_and(3, mpcf_snd_free,
-    mpc_sym(o), mpc_tok(a), mpc_sym(c),
-    free, ad);
+static int mpc_analysis_exact(mpc_analysis_t *a, mpc_parser_t *p) {
+  return a->exact[mpc_graph_index(&a->g, p)];
 }
 
-mpc_parser_t *mpc_tok_parens(mpc_parser_t *a, mpc_dtor_t ad)   { return mpc_tok_between(a, ad, "(", ")"); }
-mpc_parser_t *mpc_tok_braces(mpc_parser_t *a, mpc_dtor_t ad)   { return mpc_tok_between(a, ad, "<", ">"); }
-mpc_parser_t *mpc_tok_brackets(mpc_parser_t *a, mpc_dtor_t ad) { return mpc_tok_between(a, ad, "{", "}"); }
-mpc_parser_t *mpc_tok_squares(mpc_parser_t *a, mpc_dtor_t ad)  { return mpc_tok_between(a, ad, "[", "]"); }
+static mpc_err_t *mpc_analysis_err(mpc_analysis_t *a, mpc_parser_t *p) {
+  return mpc_err_copy(a->errs[mpc_graph_index(&a->g, p)]);
+}
 
-/*
-** Regular Expression Parsers
-*/
+/* Adds what can be found out about parser `k` from its children, returning if anything changed */
+static int mpc_analyse_first(mpc_analysis_t *a, int k) {
+  
+  int c, j, n;
+  int nullable = 0, changed = 0;
+  unsigned char first[MPC_SET_BYTES];
+  mpc_parser_t *p = a->g.nodes[k];
+  mpc_parser_t **xs;
+  
+  memset(first, 0, MPC_SET_BYTES);
+  
+  switch (p->type) {
+    
+    case MPC_TYPE_FAIL: break;
+    
+    case MPC_TYPE_ANY:
+    case MPC_TYPE_SINGLE:
+    case MPC_TYPE_RANGE:
+    case MPC_TYPE_ONEOF:
+    case MPC_TYPE_NONEOF:
+    case MPC_TYPE_SATISFY:
+    case MPC_TYPE_STRING:
+      if (p->type == MPC_TYPE_STRING && p->data.string.x[0] == '\0') { nullable = 1; break; }
+      for (c = 0; c < 256; c++) {
+        if (mpc_analyse_accepts(p, (char)c)) { mpc_set_add(first, c); }
+      }
+      break;
+    
+    case MPC_TYPE_PASS:
+    case MPC_TYPE_LIFT:
+    case MPC_TYPE_LIFT_VAL:
+    case MPC_TYPE_STATE:
+    case MPC_TYPE_ANCHOR:
+      nullable = 1;
+      break;
+    
+    case MPC_TYPE_EXPECT:
+    case MPC_TYPE_APPLY:
+    case MPC_TYPE_APPLY_TO:
+    case MPC_TYPE_PREDICT:
+    case MPC_TYPE_PACKRAT:
+    case MPC_TYPE_MEMO:
+    case MPC_TYPE_LIMIT:
+    case MPC_TYPE_RECOVER:
+    case MPC_TYPE_MANY1:
+      mpc_parser_children(p, &xs);
+      nullable = mpc_analysis_nullable(a, xs[0]);
+      memcpy(first, mpc_analysis_first(a, xs[0]), MPC_SET_BYTES);
+      break;
+    
+    case MPC_TYPE_MAYBE:
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_COUNT:
+      mpc_parser_children(p, &xs);
+      nullable = p->type != MPC_TYPE_COUNT || p->data.repeat.n == 0 || mpc_analysis_nullable(a, xs[0]);
+      memcpy(first, mpc_analysis_first(a, xs[0]), MPC_SET_BYTES);
+      break;
+    
+    case MPC_TYPE_OR:
+      nullable = p->data.or.n == 0;
+      for (j = 0; j < p->data.or.n; j++) {
+        nullable = nullable || mpc_analysis_nullable(a, p->data.or.xs[j]);
+        for (c = 0; c < MPC_SET_BYTES; c++) { first[c] |= mpc_analysis_first(a, p->data.or.xs[j])[c]; }
+      }
+      break;
+    
+    case MPC_TYPE_AND:
+      nullable = 1;
+      for (j = 0; j < p->data.and.n && nullable; j++) {
+        nullable = mpc_analysis_nullable(a, p->data.and.xs[j]);
+        for (c = 0; c < MPC_SET_BYTES; c++) { first[c] |= mpc_analysis_first(a, p->data.and.xs[j])[c]; }
+      }
+      break;
+    
+    /* Nothing is known about these so assume the worst */
+    default:
+      nullable = 1;
+      memset(first, 0xFF, MPC_SET_BYTES);
+      break;
+  }
+  
+  n = MPC_SET_BYTES * k;
+  for (c = 0; c < MPC_SET_BYTES; c++) {
+    if (first[c] & ~a->first[n+c]) { a->first[n+c] |= first[c]; changed = 1; }
+  }
+  
+  if (nullable && !a->nullable[k]) { a->nullable[k] = 1; changed = 1; }
+  
+  return changed;
+}
 
 /*
-** So here is a cute bootstrapping.
-**
-** I'm using the previously defined
-** mpc constructs and functions to
-** parse the user regex string and
-** construct a parser from it.
-**
-** As it turns out lots of the standard
-** mpc functions look a lot like `fold`
-** functions and so can be used indirectly
-** by many of the parsing functions to build
-** a parser directly - as we are parsing.
-**
-** This is certainly something that
-** would be less elegant/interesting 
-** in a two-phase parser which first
-** builds an AST and then traverses it
-** to generate the object.
-**
-** This whole thing acts as a great
-** case study for how trivial it can be
-** to write a great parser in a few
-** lines of code using mpc.
+** A parser is _infallible_ if it never fails and
+** _dirty_ if it may fail without putting the input
+** back where it started, which can only happen
+** inside `mpc_predictive`. Parsers not yet defined
+** may become anything so are treated as the worst.
 */
 
+static int mpc_analyse_fallible(mpc_analysis_t *a, int k) {
+  
+  int j, infallible = 0, dirty = 0, changed = 0;
+  mpc_parser_t *p = a->g.nodes[k];
+  mpc_parser_t **xs;
+  
+  switch (p->type) {
+    
+    case MPC_TYPE_PASS:
+    case MPC_TYPE_LIFT:
+    case MPC_TYPE_LIFT_VAL:
+    case MPC_TYPE_STATE:
+    case MPC_TYPE_MAYBE:
+    case MPC_TYPE_MANY:
+      infallible = 1;
+      break;
+    
+    case MPC_TYPE_STRING:
+      infallible = p->data.string.x[0] == '\0';
+      break;
+    
+    case MPC_TYPE_FAIL:
+    case MPC_TYPE_ANCHOR:
+    case MPC_TYPE_ANY:
+    case MPC_TYPE_SINGLE:
+    case MPC_TYPE_RANGE:
+    case MPC_TYPE_ONEOF:
+    case MPC_TYPE_NONEOF:
+    case MPC_TYPE_SATISFY:
+    case MPC_TYPE_NOT:
+    case MPC_TYPE_COUNT:
+      break;
+    
+    case MPC_TYPE_PREDICT:
+      infallible = a->infallible[mpc_graph_index(&a->g, p->data.predict.x)];
+      dirty = mpc_analysis_consumes(a, p->data.predict.x);
+      break;
+    
+    case MPC_TYPE_EXPECT:
+    case MPC_TYPE_APPLY:
+    case MPC_TYPE_APPLY_TO:
+    case MPC_TYPE_PACKRAT:
+    case MPC_TYPE_MEMO:
+    case MPC_TYPE_MANY1:
+      mpc_parser_children(p, &xs);
+      infallible = a->infallible[mpc_graph_index(&a->g, xs[0])];
+      dirty = a->dirty[mpc_graph_index(&a->g, xs[0])];
+      break;
+    
+    case MPC_TYPE_OR:
+      for (j = 0; j < p->data.or.n; j++) {
+        infallible = infallible || a->infallible[mpc_graph_index(&a->g, p->data.or.xs[j])];
+        dirty = dirty || a->dirty[mpc_graph_index(&a->g, p->data.or.xs[j])];
+      }
+      break;
+    
+    /* Puts the input back itself if it needs to */
+    case MPC_TYPE_AND:
+      infallible = 1;
+      for (j = 0; j < p->data.and.n; j++) {
+        infallible = infallible && a->infallible[mpc_graph_index(&a->g, p->data.and.xs[j])];
+      }
+      break;
+    
+    default:
+      dirty = 1;
+      break;
+  }
+  
+  if (infallible && !a->infallible[k]) { a->infallible[k] = 1; changed = 1; }
+  if (dirty && !a->dirty[k]) { a->dirty[k] = 1; changed = 1; }
+  
+  return changed;
+}
+
 /*
-**
-**  ### Regular Expression Grammar
-**
-**      <regex> : <term> | (<term> "|" <regex>)
-**     
-**      <term> : <factor>*
-**
-**      <factor> : <base>
-**               | <base> "*"
-**               | <base> "+"
-**               | <base> "?"
-**               | <base> "{" <digits> "}"
-**           
-**      <base> : <char>
-**             | "\" <char>
-**             | "(" <regex> ")"
-**             | "[" <range> "]"
+** An `mpc_and` only needs to mark the input so it
+** can rewind if it might fail after consuming some.
+** It can't if the first parser which consumes input
+** puts it back when it fails and those after never
+** fail, such as the whitespace after `mpc_tok`.
 */
 
-static mpc_val_t *mpcf_re_or(int n, mpc_val_t **xs) {
-  (void) n;
-  if (xs[1] == NULL) { return xs[0]; }
-  else { return mpc_or(2, xs[0], xs[1]); }
+static int mpc_analyse_unmarked(mpc_analysis_t *a, mpc_parser_t *p) {
+  
+  int j, k;
+  
+  for (k = 0; k < p->data.and.n; k++) {
+    if (mpc_analysis_consumes(a, p->data.and.xs[k])) { break; }
+  }
+  
+  if (k == p->data.and.n) { return 1; }
+  if (a->dirty[mpc_graph_index(&a->g, p->data.and.xs[k])]) { return 0; }
+  
+  for (j = k+1; j < p->data.and.n; j++) {
+    if (!a->infallible[mpc_graph_index(&a->g, p->data.and.xs[j])]) { return 0; }
+  }
+  
+  return 1;
 }
 
-static mpc_val_t *mpcf_re_and(int n, mpc_val_t **xs) {
-  int i;
-  mpc_parser_t *p = mpc_lift(mpcf_ctor_str);
-  for (i = 0; i < n; i++) {
-    p = mpc_and(2, mpcf_strfold, p, xs[i], free);
+/* Skips parsers such as `mpc_state` which always succeed and have no effect on the input */
+static int mpc_analyse_and_start(mpc_parser_t *p) {
+  
+  int j;
+  for (j = 0; j < p->data.and.n; j++) {
+    switch (p->data.and.xs[j]->type) {
+      case MPC_TYPE_PASS:
+      case MPC_TYPE_LIFT:
+      case MPC_TYPE_LIFT_VAL:
+      case MPC_TYPE_STATE:
+        break;
+      default:
+        return j;
+    }
   }
-  return p;
+  return j;
 }
 
-static mpc_val_t *mpcf_re_repeat(int n, mpc_val_t **xs) {
-  int num;
-  (void) n;
-  if (xs[1] == NULL) { return xs[0]; }
-  if (strcmp(xs[1], "*") == 0) { free(xs[1]); return mpc_many(mpcf_strfold, xs[0]); }
-  if (strcmp(xs[1], "+") == 0) { free(xs[1]); return mpc_many1(mpcf_strfold, xs[0]); }
-  if (strcmp(xs[1], "?") == 0) { free(xs[1]); return mpc_maybe_lift(xs[0], mpcf_ctor_str); }
-  num = *(int*)xs[1];
-  free(xs[1]);
+static int mpc_analyse_exact(mpc_analysis_t *a, mpc_parser_t *p) {
   
-  return mpc_count(num, mpcf_strfold, xs[0], free);
+  int j;
+  mpc_parser_t **xs;
+  
+  switch (p->type) {
+    
+    case MPC_TYPE_FAIL:
+    case MPC_TYPE_ANY:
+    case MPC_TYPE_SINGLE:
+    case MPC_TYPE_RANGE:
+    case MPC_TYPE_ONEOF:
+    case MPC_TYPE_NONEOF:
+    case MPC_TYPE_SATISFY:
+      return 1;
+    
+    case MPC_TYPE_STRING:
+      return p->data.string.x[0] != '\0';
+    
+    case MPC_TYPE_EXPECT:
+    case MPC_TYPE_APPLY:
+    case MPC_TYPE_APPLY_TO:
+    case MPC_TYPE_PREDICT:
+    case MPC_TYPE_PACKRAT:
+    case MPC_TYPE_MEMO:
+    case MPC_TYPE_MANY1:
+      mpc_parser_children(p, &xs);
+      return mpc_analysis_exact(a, xs[0]);
+    
+    case MPC_TYPE_COUNT:
+      return p->data.repeat.n > 0 && mpc_analysis_exact(a, p->data.repeat.x);
+    
+    case MPC_TYPE_OR:
+      for (j = 0; j < p->data.or.n; j++) {
+        if (!mpc_analysis_exact(a, p->data.or.xs[j])) { return 0; }
+      }
+      return p->data.or.n > 0;
+    
+    /* The first parser which can fail must fail for the rest not to run */
+    case MPC_TYPE_AND:
+      j = mpc_analyse_and_start(p);
+      return j < p->data.and.n && mpc_analysis_exact(a, p->data.and.xs[j]);
+    
+    default: return 0;
+  }
 }
 
-static mpc_parser_t *mpc_re_escape_char(char c) {
-  switch (c) {
-    case 'a': return mpc_char('\a');
-    case 'f': return mpc_char('\f');
-    case 'n': return mpc_char('\n');
-    case 'r': return mpc_char('\r');
-    case 't': return mpc_char('\t');
-    case 'v': return mpc_char('\v');
-    case 'b': return mpc_and(2, mpcf_snd, mpc_boundary(), mpc_lift(mpcf_ctor_str), free);
-    case 'B': return mpc_not_lift(mpc_boundary(), free, mpcf_ctor_str);
-    case 'A': return mpc_and(2, mpcf_snd, mpc_soi(), mpc_lift(mpcf_ctor_str), free);
-    case 'Z': return mpc_and(2, mpcf_snd, mpc_eoi(), mpc_lift(mpcf_ctor_str), free);
-    case 'd': return mpc_digit();
-    case 'D': return mpc_not_lift(mpc_digit(), free, mpcf_ctor_str);
-    case 's': return mpc_whitespace();
-    case 'S': return mpc_not_lift(mpc_whitespace(), free, mpcf_ctor_str);
-    case 'w': return mpc_alphanum();
-    case 'W': return mpc_not_lift(mpc_alphanum(), free, mpcf_ctor_str);
-    default: return NULL;
+/* The error an exact parser gives when it can't start, mirroring `mpc_parse_input` */
+static mpc_err_t *mpc_analyse_err(mpc_analysis_t *a, mpc_parser_t *p) {
+  
+  int j;
+  mpc_err_t *e, **es;
+  mpc_parser_t **xs;
+  
+  switch (p->type) {
+    
+    case MPC_TYPE_FAIL:   return mpc_err_fail("", mpc_state_invalid(), p->data.fail.m);
+    case MPC_TYPE_EXPECT: return mpc_err_new("", mpc_state_invalid(), p->data.expect.m, ' ');
+    case MPC_TYPE_MANY1:  return mpc_err_many1(mpc_analysis_err(a, p->data.repeat.x));
+    case MPC_TYPE_COUNT:  return mpc_err_count(mpc_analysis_err(a, p->data.repeat.x), p->data.repeat.n);
+    case MPC_TYPE_AND:    return mpc_analysis_err(a, p->data.and.xs[mpc_analyse_and_start(p)]);
+    
+    case MPC_TYPE_APPLY:
+    case MPC_TYPE_APPLY_TO:
+    case MPC_TYPE_PREDICT:
+    case MPC_TYPE_PACKRAT:
+    case MPC_TYPE_MEMO:
+      mpc_parser_children(p, &xs);
+      return mpc_analysis_err(a, xs[0]);
+    
+    case MPC_TYPE_OR:
+      es = malloc(sizeof(mpc_err_t*) * p->data.or.n);
+      for (j = 0; j < p->data.or.n; j++) { es[j] = mpc_analysis_err(a, p->data.or.xs[j]); }
+      e = mpc_err_or(es, p->data.or.n);
+      free(es);
+      return e;
+    
+    default: return mpc_err_fail("", mpc_state_invalid(), "Incorrect Input");
   }
 }
 
-static mpc_val_t *mpcf_re_escape(mpc_val_t *x) {
+static mpc_dispatch_t *mpc_analyse_dispatch(mpc_analysis_t *a, mpc_parser_t *p) {
   
-  char *s = x;
-  mpc_parser_t *p;
+  int c, j, n = p->data.or.n;
+  unsigned char *skip;
+  mpc_parser_t *x;
+  mpc_dispatch_t *d;
   
-  /* Regex Special Characters */
-  if (s[0] == '.') { free(s); return mpc_any(); }
-  if (s[0] == '^') { free(s); return mpc_and(2, mpcf_snd, mpc_soi(), mpc_lift(mpcf_ctor_str), free); }
-  if (s[0] == '$') { free(s); return mpc_and(2, mpcf_snd, mpc_eoi(), mpc_lift(mpcf_ctor_str), free); }
+  for (j = 0; j < n; j++) {
+    if (mpc_analysis_exact(a, p->data.or.xs[j])) { break; }
+  }
+  if (j == n) { return NULL; }
   
-  /* Regex Escape */
-  if (s[0] == '\\') {
-    p = mpc_re_escape_char(s[1]);
-    p = (p == NULL) ? mpc_char(s[1]) : p;
-    free(s);
-    return p;
+  d = malloc(sizeof(mpc_dispatch_t));
+  d->generation = mpc_generation_of(p);
+  d->n = n;
+  d->skip = calloc(n, MPC_SET_BYTES);
+  d->errs = calloc(n, sizeof(mpc_err_t*));
+  d->err = mpc_analysis_exact(a, p) ? mpc_analysis_err(a, p) : NULL;
+  memset(d->none, 0xFF, MPC_SET_BYTES);
+  
+  for (j = 0; j < n; j++) {
+    
+    x = p->data.or.xs[j];
+    skip = d->skip + MPC_SET_BYTES * j;
+    
+    if (mpc_analysis_exact(a, x)) {
+      for (c = 0; c < MPC_SET_BYTES; c++) { skip[c] = (unsigned char)~mpc_analysis_first(a, x)[c]; }
+      mpc_set_add(skip, MPC_SET_END);
+      d->errs[j] = mpc_analysis_err(a, x);
+    }
+    
+    for (c = 0; c < MPC_SET_BYTES; c++) { d->none[c] &= skip[c]; }
   }
   
-  /* Regex Standard */
-  p = mpc_char(s[0]);
-  free(s);
-  return p;
+  return d;
 }
 
-static const char *mpc_re_range_escape_char(char c) {
-  switch (c) {
-    case '-': return "-";
-    case 'a': return "\a";
-    case 'f': return "\f";
-    case 'n': return "\n";
-    case 'r': return "\r";
-    case 't': return "\t";
-    case 'v': return "\v";
-    case 'b': return "\b";
-    case 'd': return "0123456789";
-    case 's': return " \f\n\r\t\v";
-    case 'w': return "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
-    default: return NULL;
-  }
+/* Finds the graph from some roots and works out what each parser is nullable and starts with */
+static void mpc_analysis_init(mpc_analysis_t *a, mpc_parser_t **roots, int n) {
+  
+  int k, changed;
+  
+  mpc_graph_init(&a->g, roots, n);
+  a->nullable = calloc((unsigned)a->g.nodes_num, 1);
+  a->exact = calloc((unsigned)a->g.nodes_num, 1);
+  a->infallible = calloc((unsigned)a->g.nodes_num, 1);
+  a->dirty = calloc((unsigned)a->g.nodes_num, 1);
+  a->first = calloc((unsigned)a->g.nodes_num, MPC_SET_BYTES);
+  a->errs = calloc((unsigned)a->g.nodes_num, sizeof(mpc_err_t*));
+  
+  do {
+    changed = 0;
+    for (k = 0; k < a->g.nodes_num; k++) { changed = mpc_analyse_first(a, k) || changed; }
+  } while (changed);
+  
 }
 
-static mpc_val_t *mpcf_re_range(mpc_val_t *x) {
+static void mpc_analysis_free(mpc_analysis_t *a) {
+  free(a->nullable);
+  free(a->exact);
+  free(a->infallible);
+  free(a->dirty);
+  free(a->first);
+  free(a->errs);
+  mpc_graph_free(&a->g);
+}
+
+static void mpc_search_store(mpc_analysis_t *a, mpc_parser_t *p);
+
+/* Points every parser found at one generation, newer than any tables they have */
+static void mpc_analysis_generation(mpc_analysis_t *a) {
   
-  mpc_parser_t *out;
-  size_t i, j;
-  size_t start, end;
-  const char *tmp = NULL;
-  const char *s = x;
-  int comp = s[0] == '^' ? 1 : 0;
-  char *range = calloc(1,1);
+  int k;
+  unsigned long value = 0;
+  mpc_generation_t *g = NULL, *h;
   
-  if (s[0] == '\0') { free(x); return mpc_fail("Invalid Regex Range Expression"); } 
-  if (s[0] == '^' && 
-      s[1] == '\0') { free(x); return mpc_fail("Invalid Regex Range Expression"); }
+  for (k = 0; k < a->g.nodes_num; k++) {
+    h = mpc_generation_find(a->g.nodes[k]->generation);
+    if (h == NULL || h == g) { continue; }
+    if (h->value > value) { value = h->value; }
+    if (g == NULL) { g = h; continue; }
+    h->into = g;
+    g->refs++;
+  }
   
-  for (i = comp; i < strlen(s); i++){
-    
-    /* Regex Range Escape */
-    if (s[i] == '\\') {
-      tmp = mpc_re_range_escape_char(s[i+1]);
-      if (tmp != NULL) {
-        range = realloc(range, strlen(range) + strlen(tmp) + 1);
-        strcat(range, tmp);
-      } else {
-        range = realloc(range, strlen(range) + 1 + 1);
-        range[strlen(range) + 1] = '\0';
-        range[strlen(range) + 0] = s[i+1];      
-      }
-      i++;
+  if (g == NULL) {
+    g = malloc(sizeof(mpc_generation_t));
+    g->refs = 0;
+    g->into = NULL;
+  }
+  
+  g->value = value + 1;
+  for (k = 0; k < a->g.nodes_num; k++) {
+    if (a->g.nodes[k]->generation != g) { mpc_generation_set(a->g.nodes[k], g); }
+  }
+}
+
+static void mpc_analyse_roots(mpc_parser_t **roots, int n) {
+  
+  int j, k, changed;
+  int *order, order_num = 0;
+  mpc_parser_t *p;
+  mpc_analysis_t a;
+  
+  mpc_analysis_init(&a, roots, n);
+  mpc_analysis_generation(&a);
+  order = malloc(sizeof(int) * (unsigned)a.g.nodes_num);
+  
+  do {
+    changed = 0;
+    for (k = 0; k < a.g.nodes_num; k++) { changed = mpc_analyse_fallible(&a, k) || changed; }
+  } while (changed);
+  
+  /*
+  ** Parsers only become exact once the parsers they
+  ** depend on are, so left recursion never does, and
+  ** the templates can be made in the order found.
+  */
+  
+  do {
+    changed = 0;
+    for (k = 0; k < a.g.nodes_num; k++) {
+      if (a.exact[k] || !mpc_analyse_exact(&a, a.g.nodes[k])) { continue; }
+      a.exact[k] = 1;
+      order[order_num++] = k;
+      changed = 1;
     }
-    
-    /* Regex Range...Range */
-    else if (s[i] == '-') {
-      if (s[i+1] == '\0' || i == 0) {
-          range = realloc(range, strlen(range) + strlen("-") + 1);
-          strcat(range, "-");
-      } else {
-        start = s[i-1]+1;
-        end = s[i+1]-1;
-        for (j = start; j <= end; j++) {
-          range = realloc(range, strlen(range) + 1 + 1);
-          range[strlen(range) + 1] = '\0';
-          range[strlen(range) + 0] = j;
-        }        
-      }
+  } while (changed);
+  
+  for (j = 0; j < order_num; j++) {
+    a.errs[order[j]] = mpc_analyse_err(&a, a.g.nodes[order[j]]);
+  }
+  
+  for (k = 0; k < a.g.nodes_num; k++) {
+    p = a.g.nodes[k];
+    if (p->type == MPC_TYPE_OR) {
+      mpc_dispatch_delete(p->data.or.dispatch);
+      p->data.or.dispatch = mpc_analyse_dispatch(&a, p);
     }
-    
-    /* Regex Range Normal */
-    else {
-      range = realloc(range, strlen(range) + 1 + 1);
-      range[strlen(range) + 1] = '\0';
-      range[strlen(range) + 0] = s[i];
+    if (p->type == MPC_TYPE_AND) {
+      p->data.and.unmarked = mpc_analyse_unmarked(&a, p) ? mpc_generation_of(p) : 0;
     }
+  }
+  
+  for (j = 0; j < n; j++) { mpc_search_store(&a, roots[j]); }
+  
+  for (j = 0; j < order_num; j++) { mpc_err_delete(a.errs[order[j]]); }
+  
+  free(order);
+  mpc_analysis_free(&a);
+}
+
+void mpc_analyse(mpc_parser_t *a) {
+  mpc_analyse_roots(&a, 1);
+}
+
+/*
+** Searching
+*/
+
+/*
+** Searches try the parser only at the positions its
+** FIRST set says it could start. When that is just
+** one byte `memchr` is used to jump between them,
+** otherwise a table of the bytes is checked. If the
+** parser always starts with some string literal the
+** rest of it is compared before trying the parser.
+** If the parser can match without input it must be
+** tried everywhere.
+**
+** A single input covers the whole buffer, so the
+** positions in results and errors are from the start
+** of the buffer, and the character before each try
+** is what anchors such as `mpc_boundary` look at.
+** One stack is used for every try, and tries which
+** fail don't build an error.
+**
+** `mpc_analyse` stores this for the parsers it is
+** given, so searches with them don't have to work it
+** out again. As with the dispatch tables it is out of
+** date once any parser is redefined.
+*/
+
+typedef struct mpc_search_t {
+  unsigned long generation;
+  int nullable;
+  int single;
+  const char *prefix;
+  size_t prefix_len;
+  unsigned char first[MPC_SET_BYTES];
+} mpc_search_t;
+
+/* Returns the string literal any match of `p` starts with, if there is one */
+static const char *mpc_search_prefix(mpc_parser_t *p) {
+  
+  mpc_parser_t **xs;
   
+  while (1) {
+    switch (p->type) {
+      case MPC_TYPE_EXPECT:
+      case MPC_TYPE_APPLY:
+      case MPC_TYPE_APPLY_TO:
+      case MPC_TYPE_PREDICT:
+        case MPC_TYPE_PACKRAT:
+      case MPC_TYPE_MEMO:
+      case MPC_TYPE_LIMIT:
+      case MPC_TYPE_RECOVER:
+      case MPC_TYPE_MANY1:
+        mpc_parser_children(p, &xs);
+        p = xs[0];
+        break;
+      case MPC_TYPE_AND:
+        if (mpc_analyse_and_start(p) == p->data.and.n) { return NULL; }
+        p = p->data.and.xs[mpc_analyse_and_start(p)];
+        break;
+      case MPC_TYPE_STRING:
+        return p->data.string.x;
+      default:
+        return NULL;
+    }
   }
+}
+
+static void mpc_search_fill(mpc_search_t *s, mpc_analysis_t *a, mpc_parser_t *p) {
   
-  out = comp == 1 ? mpc_noneof(range) : mpc_oneof(range);
+  int c, count = 0;
   
-  free(x);
-  free(range);
+  s->generation = mpc_generation_of(p);
+  s->nullable = mpc_analysis_nullable(a, p);
+  memcpy(s->first, mpc_analysis_first(a, p), MPC_SET_BYTES);
   
-  return out;
+  s->single = -1;
+  for (c = 0; c < 256; c++) {
+    if (mpc_set_has(s->first, c)) { s->single = c; count++; }
+  }
+  if (count != 1) { s->single = -1; }
+  
+  s->prefix = s->nullable ? NULL : mpc_search_prefix(p);
+  s->prefix_len = s->prefix ? strlen(s->prefix) : 0;
 }
 
-mpc_parser_t *mpc_re(const char *re) {
+static void mpc_search_store(mpc_analysis_t *a, mpc_parser_t *p) {
+  if (p->search == NULL) { p->search = malloc(sizeof(mpc_search_t)); }
+  mpc_search_fill(p->search, a, p);
+}
+
+/* Returns what `mpc_analyse` stored for `p` if it is up to date, or else works it out in `s` */
+static mpc_search_t *mpc_search_get(mpc_search_t *s, mpc_parser_t *p) {
   
-  char *err_msg;
-  mpc_parser_t *err_out;
-  mpc_result_t r;
-  mpc_parser_t *Regex, *Term, *Factor, *Base, *Range, *RegexEnclose; 
+  mpc_analysis_t a;
   
-  Regex  = mpc_new("regex");
-  Term   = mpc_new("term");
-  Factor = mpc_new("factor");
-  Base   = mpc_new("base");
-  Range  = mpc_new("range");
+  if (p->search && p->search->generation == mpc_generation_of(p)) { return p->search; }
   
-  mpc_define(Regex, mpc_and(2, mpcf_re_or,
-    Term, 
-    mpc_maybe(mpc_and(2, mpcf_snd_free, mpc_char('|'), Regex, free)),
-    (mpc_dtor_t)mpc_delete
-  ));
+  mpc_analysis_init(&a, &p, 1);
+  mpc_search_fill(s, &a, p);
+  mpc_analysis_free(&a);
+  return s;
+}
+
+/* Returns the next position at or after `pos` where the parser could match */
+static long mpc_search_next(mpc_search_t *s, const char *string, long length, long pos) {
   
-  mpc_define(Term, mpc_many(mpcf_re_and, Factor));
+  const char *x;
   
-  mpc_define(Factor, mpc_and(2, mpcf_re_repeat,
-    Base,
-    mpc_or(5,
-      mpc_char('*'), mpc_char('+'), mpc_char('?'),
-      mpc_brackets(mpc_int(), free),
-      mpc_pass()),
-    (mpc_dtor_t)mpc_delete
-  ));
+  if (s->nullable) { return pos; }
   
-  mpc_define(Base, mpc_or(4,
-    mpc_parens(Regex, (mpc_dtor_t)mpc_delete),
-    mpc_squares(Range, (mpc_dtor_t)mpc_delete),
-    mpc_apply(mpc_escape(), mpcf_re_escape),
-    mpc_apply(mpc_noneof(")|"), mpcf_re_escape)
-  ));
+  if (s->single != -1) {
+    while (pos < length) {
+      x = memchr(string + pos, s->single, (size_t)(length - pos));
+      if (x == NULL) { return -1; }
+      pos = (long)(x - string);
+      if (s->prefix == NULL
+      || (s->prefix_len <= (size_t)(length - pos) && memcmp(x, s->prefix, s->prefix_len) == 0)) { return pos; }
+      pos++;
+    }
+    return -1;
+  }
   
-  mpc_define(Range, mpc_apply(
-    mpc_many(mpcf_strfold, mpc_or(2, mpc_escape(), mpc_noneof("]"))),
-    mpcf_re_range
-  ));
+  while (pos < length && !mpc_set_has(s->first, (unsigned char)string[pos])) { pos++; }
+  return pos < length ? pos : -1;
+}
+
+/* Finds the first match at or after `i->pos`, leaving `i->pos` at its end */
+static int mpc_search_input(mpc_search_t *s, mpc_input_t *i, mpc_stack_t *stk, mpc_parser_t *p, long *start, mpc_result_t *r) {
   
-  RegexEnclose = mpc_whole(mpc_predictive(Regex), (mpc_dtor_t)mpc_delete);
+  long pos = i->pos;
   
-  if(!mpc_parse("<mpc_re_compiler>", re, RegexEnclose, &r)) {
-    err_msg = mpc_err_string(r.error);
-    err_out = mpc_failf("Invalid Regex: %s", err_msg);
-    mpc_err_delete(r.error);  
-    free(err_msg);
-    r.output = err_out;
+  while (pos <= i->length) {
+    
+    pos = mpc_search_next(s, i->string, i->length, pos);
+    if (pos == -1) { break; }
+    
+    i->pos = pos;
+    i->last = pos > 0 ? i->string[pos-1] : '\0';
+    mpc_stack_reset(stk, i->filename, 0);
+    stk->quiet = 1;
+    if (mpc_parse_input_stack(i, stk, p, r, NULL, NULL)) { *start = pos; return 1; }
+    pos++;
   }
   
-  mpc_delete(RegexEnclose);
-  mpc_cleanup(5, Regex, Term, Factor, Base, Range);
+  i->pos = i->length;
+  r->error = mpc_err_fail(i->filename, mpc_input_state(i), "No match found");
+  return 0;
+}
+
+int mpc_search(const char *filename, const char *string, size_t length, size_t *offset, size_t *start, mpc_parser_t *p, mpc_result_t *r) {
   
-  return r.output;
+  int x;
+  long st;
+  mpc_search_t t;
+  mpc_search_t *s = mpc_search_get(&t, p);
+  mpc_input_t *i = mpc_input_new_string(filename, string, (long)length);
+  mpc_stack_t *stk = mpc_stack_new(i->filename, 0);
+  
+  i->pos = (long)*offset;
+  x = mpc_search_input(s, i, stk, p, &st, r);
+  if (x) { *start = (size_t)st; *offset = (size_t)i->pos; }
+  mpc_stack_delete(stk);
+  mpc_input_delete(i);
+  return x;
+}
+
+int mpc_find_all(const char *filename, const char *string, size_t length, mpc_parser_t *p, mpc_found_t f, void *data) {
+  
+  int n = 0;
+  long st;
+  mpc_search_t t;
+  mpc_search_t *s = mpc_search_get(&t, p);
+  mpc_result_t r;
+  mpc_input_t *i = mpc_input_new_string(filename, string, (long)length);
+  mpc_stack_t *stk = mpc_stack_new(i->filename, 0);
+  
+  while (i->pos <= i->length) {
+    if (!mpc_search_input(s, i, stk, p, &st, &r)) { mpc_err_delete(r.error); break; }
+    n++;
+    if (!f((size_t)st, (size_t)i->pos, r.output, data)) { break; }
+    /* Empty matches are skipped over so the search moves on */
+    if (i->pos == st) { i->pos++; }
+  }
   
+  mpc_stack_delete(stk);
+  mpc_input_delete(i);
+  return n;
+}
+
+/*
+** Earley
+*/
+
+/*
+** `mpc_parse_earley` reads the parser graph as a
+** context free grammar and parses with Earley's
+** algorithm. It takes at most cubic time whatever
+** the grammar, and copes with left recursion, where
+** the interpreter can take exponential time or loop
+** forever.
+**
+** Each parser becomes a nonterminal with some rules.
+** An `mpc_or` has a rule for each alternative and an
+** `mpc_and` a single rule. Repetitions are made left
+** recursive, which Earley's algorithm handles best.
+** Parsers reading characters are terminals, and the
+** anchors and `mpc_not` are terminals which match
+** nothing when they hold.
+**
+** Once the input is recognised the results are built
+** by walking back down from the root, calling all of
+** the usual folds and functions. Where the input can
+** be parsed more than one way earlier alternatives
+** and longer matches for earlier parts of a sequence
+** are preferred, so that unambiguous grammars give
+** exactly the same results as the interpreter.
+*/
+
+enum {
+  MPC_EARLEY_RULES = 0,
+  MPC_EARLEY_TERMINAL = 1,
+  MPC_EARLEY_PREDICATE = 2
+};
+
+enum {
+  MPC_EARLEY_ITEM,
+  MPC_EARLEY_WAIT,
+  MPC_EARLEY_EMPTY,
+  MPC_EARLEY_DONE,
+  MPC_EARLEY_ENDS,
+  MPC_EARLEY_STARTS,
+  MPC_EARLEY_NOT,
+  MPC_EARLEY_SPLIT
+};
+
+#define MPC_EARLEY_UNSET -2
+
+typedef struct {
+  long k[4];
+  long v;
+} mpc_earley_slot_t;
+
+typedef struct {
+  int at;
+  long origin;
+  long wait;
+} mpc_earley_item_t;
+
+typedef struct {
+  long num;
+  long slots;
+  mpc_earley_item_t *items;
+} mpc_earley_set_t;
+
+typedef struct {
+
+  mpc_analysis_t a;
+  int root;
+
+  const char *string;
+  long length;
+  mpc_input_t *i;
+
+  char *kind;
+  int *rules;
+  int *rules_num;
+
+  int rule_num;
+  int rule_slots;
+  int *rule_at;
+  int *rule_len;
+
+  int at_num;
+  int at_slots;
+  int *sym;
+  int *lhs;
+
+  mpc_earley_set_t *sets;
+
+  long hash_num;
+  long hash_slots;
+  mpc_earley_slot_t *hash;
+
+  long links_num;
+  long *links;
+
+} mpc_earley_t;
+
+/* Hashing */
+
+static unsigned long mpc_earley_hash(long a, long b, long c, long d) {
+  unsigned long h = (unsigned long)a;
+  h = h * 1000003UL ^ (unsigned long)b;
+  h = h * 1000003UL ^ (unsigned long)c;
+  h = h * 1000003UL ^ (unsigned long)d;
+  h = (h ^ (h >> 16)) * 0x45d9f3bUL;
+  h = (h ^ (h >> 16)) * 0x45d9f3bUL;
+  return h ^ (h >> 16);
+}
+
+static mpc_earley_slot_t *mpc_earley_probe(mpc_earley_slot_t *hash, long slots, long a, long b, long c, long d) {
+  unsigned long x = mpc_earley_hash(a, b, c, d) & (unsigned long)(slots - 1);
+  while (hash[x].k[0] != -1
+  && !(hash[x].k[0] == a && hash[x].k[1] == b && hash[x].k[2] == c && hash[x].k[3] == d)) {
+    x = (x + 1) & (unsigned long)(slots - 1);
+  }
+  return &hash[x];
+}
+
+static void mpc_earley_rehash(mpc_earley_t *e) {
+
+  long j, slots = e->hash_slots ? e->hash_slots * 2 : 1024;
+  mpc_earley_slot_t *hash = malloc(sizeof(mpc_earley_slot_t) * (unsigned long)slots);
+  mpc_earley_slot_t *s;
+
+  for (j = 0; j < slots; j++) { hash[j].k[0] = -1; }
+  for (j = 0; j < e->hash_slots; j++) {
+    if (e->hash[j].k[0] == -1) { continue; }
+    s = e->hash + j;
+    *mpc_earley_probe(hash, slots, s->k[0], s->k[1], s->k[2], s->k[3]) = *s;
+  }
+
+  free(e->hash);
+  e->hash = hash;
+  e->hash_slots = slots;
 }
 
-/*
-** Common Fold Functions
-*/
+/* Finds some entry, adding it if asked with a value of `MPC_EARLEY_UNSET` */
+static mpc_earley_slot_t *mpc_earley_find(mpc_earley_t *e, long a, long b, long c, long d, int add) {
+
+  mpc_earley_slot_t *s;
 
-void mpcf_dtor_null(mpc_val_t *x) { (void) x; return; }
+  if (add && (e->hash_num + 1) * 2 > e->hash_slots) { mpc_earley_rehash(e); }
 
-mpc_val_t *mpcf_ctor_null(void) { return NULL; }
-mpc_val_t *mpcf_ctor_str(void) { return calloc(1, 1); }
-mpc_val_t *mpcf_free(mpc_val_t *x) { free(x); return NULL; }
+  s = mpc_earley_probe(e->hash, e->hash_slots, a, b, c, d);
+  if (s->k[0] != -1) { return s; }
+  if (!add) { return NULL; }
 
-mpc_val_t *mpcf_int(mpc_val_t *x) {
-  int *y = malloc(sizeof(int));
-  *y = strtol(x, NULL, 10);
-  free(x);
-  return y;
+  s->k[0] = a; s->k[1] = b; s->k[2] = c; s->k[3] = d;
+  s->v = MPC_EARLEY_UNSET;
+  e->hash_num++;
+  return s;
 }
 
-mpc_val_t *mpcf_hex(mpc_val_t *x) {
-  int *y = malloc(sizeof(int));
-  *y = strtol(x, NULL, 16);
-  free(x);
-  return y;
+static long mpc_earley_get(mpc_earley_t *e, long a, long b, long c, long d) {
+  mpc_earley_slot_t *s = mpc_earley_find(e, a, b, c, d, 0);
+  return s ? s->v : MPC_EARLEY_UNSET;
 }
 
-mpc_val_t *mpcf_oct(mpc_val_t *x) {
-  int *y = malloc(sizeof(int));
-  *y = strtol(x, NULL, 8);
-  free(x);
-  return y;
+/* The number of the `n` sorted positions `xs` which are at most `x` */
+static long mpc_earley_upto(const long *xs, long n, long x) {
+  long lo = 0, hi = n, mid;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (xs[mid] <= x) { lo = mid + 1; } else { hi = mid; }
+  }
+  return lo;
 }
 
-mpc_val_t *mpcf_float(mpc_val_t *x) {
-  float *y = malloc(sizeof(float));
-  *y = strtod(x, NULL);
-  free(x);
-  return y;
+static int mpc_earley_cmp(const void *x, const void *y) {
+  long a = *(const long*)x, b = *(const long*)y;
+  return a < b ? -1 : a > b;
 }
 
-mpc_val_t *mpcf_strtriml(mpc_val_t *x) {
-  char *s = x;
-  while (isspace(*s)) {
-    memmove(s, s+1, strlen(s));
+/* Grammar */
+
+static void mpc_earley_rule(mpc_earley_t *e, int k, int n, int *xs) {
+
+  int j;
+
+  if (e->rule_num == e->rule_slots) {
+    e->rule_slots = e->rule_slots ? e->rule_slots * 2 : 64;
+    e->rule_at = realloc(e->rule_at, sizeof(int) * (unsigned)e->rule_slots);
+    e->rule_len = realloc(e->rule_len, sizeof(int) * (unsigned)e->rule_slots);
+  }
+
+  while (e->at_num + n + 1 > e->at_slots) {
+    e->at_slots = e->at_slots ? e->at_slots * 2 : 256;
+    e->sym = realloc(e->sym, sizeof(int) * (unsigned)e->at_slots);
+    e->lhs = realloc(e->lhs, sizeof(int) * (unsigned)e->at_slots);
+  }
+
+  e->rule_at[e->rule_num] = e->at_num;
+  e->rule_len[e->rule_num] = n;
+  e->rule_num++;
+
+  for (j = 0; j <= n; j++) {
+    e->sym[e->at_num] = j < n ? xs[j] : -1;
+    e->lhs[e->at_num] = k;
+    e->at_num++;
   }
-  return s;
 }
 
-mpc_val_t *mpcf_strtrimr(mpc_val_t *x) {
-  char *s = x;
-  size_t l = strlen(s);
-  while (isspace(s[l-1])) {
-    s[l-1] = '\0'; l--;
+static void mpc_earley_rules(mpc_earley_t *e, int k) {
+
+  int j, n, xs[2], *ys;
+  mpc_parser_t *p = e->a.g.nodes[k], **cs;
+
+  e->rules[k] = e->rule_num;
+  e->kind[k] = MPC_EARLEY_RULES;
+
+  n = mpc_parser_children(p, &cs);
+  for (j = 0; j < n && j < 2; j++) { xs[j] = mpc_graph_index(&e->a.g, cs[j]); }
+
+  switch (p->type) {
+
+    case MPC_TYPE_ANY:
+    case MPC_TYPE_SINGLE:
+    case MPC_TYPE_RANGE:
+    case MPC_TYPE_ONEOF:
+    case MPC_TYPE_NONEOF:
+    case MPC_TYPE_SATISFY:
+    case MPC_TYPE_STRING:
+      e->kind[k] = MPC_EARLEY_TERMINAL;
+      break;
+
+    case MPC_TYPE_ANCHOR:
+    case MPC_TYPE_NOT:
+      e->kind[k] = MPC_EARLEY_PREDICATE;
+      break;
+
+    case MPC_TYPE_PASS:
+    case MPC_TYPE_LIFT:
+    case MPC_TYPE_LIFT_VAL:
+    case MPC_TYPE_STATE:
+      mpc_earley_rule(e, k, 0, NULL);
+      break;
+
+    case MPC_TYPE_EXPECT:
+    case MPC_TYPE_APPLY:
+    case MPC_TYPE_APPLY_TO:
+    case MPC_TYPE_PREDICT:
+    case MPC_TYPE_PACKRAT:
+    case MPC_TYPE_MEMO:
+    case MPC_TYPE_LIMIT:
+    case MPC_TYPE_RECOVER:
+      mpc_earley_rule(e, k, 1, xs);
+      break;
+
+    case MPC_TYPE_MAYBE:
+      mpc_earley_rule(e, k, 1, xs);
+      mpc_earley_rule(e, k, 0, NULL);
+      break;
+
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+      xs[1] = xs[0];
+      xs[0] = k;
+      mpc_earley_rule(e, k, 2, xs);
+      if (p->type == MPC_TYPE_MANY)  { mpc_earley_rule(e, k, 0, NULL); }
+      if (p->type == MPC_TYPE_MANY1) { mpc_earley_rule(e, k, 1, xs + 1); }
+      break;
+
+    case MPC_TYPE_COUNT:
+      ys = malloc(sizeof(int) * (unsigned)(p->data.repeat.n + 1));
+      for (j = 0; j < p->data.repeat.n; j++) { ys[j] = xs[0]; }
+      mpc_earley_rule(e, k, p->data.repeat.n, ys);
+      free(ys);
+      break;
+
+    case MPC_TYPE_OR:
+      for (j = 0; j < n; j++) {
+        xs[0] = mpc_graph_index(&e->a.g, cs[j]);
+        mpc_earley_rule(e, k, 1, xs);
+      }
+      if (n == 0) { mpc_earley_rule(e, k, 0, NULL); }
+      break;
+
+    case MPC_TYPE_AND:
+      ys = malloc(sizeof(int) * (unsigned)(n + 1));
+      for (j = 0; j < n; j++) { ys[j] = mpc_graph_index(&e->a.g, cs[j]); }
+      mpc_earley_rule(e, k, n, ys);
+      free(ys);
+      break;
+
+    /* Failures and undefined parsers have no rules */
+    default: break;
   }
-  return s;
+
+  e->rules_num[k] = e->rule_num - e->rules[k];
 }
 
-mpc_val_t *mpcf_strtrim(mpc_val_t *x) {
-  return mpcf_strtriml(mpcf_strtrimr(x));
+/* Terminals */
+
+static void mpc_earley_seek(mpc_earley_t *e, long pos) {
+  e->i->pos = pos;
+  e->i->last = pos > 0 ? e->string[pos-1] : '\0';
 }
 
-static const char mpc_escape_input_c[]  = {
-  '\a', '\b', '\f', '\n', '\r',
-  '\t', '\v', '\\', '\'', '\"', '\0'};
-    
-static const char *mpc_escape_output_c[] = {
-  "\\a", "\\b", "\\f", "\\n", "\\r", "\\t", 
-  "\\v", "\\\\", "\\'", "\\\"", "\\0", NULL};
+/* Returns how much input a terminal matches at `pos`, or -1 */
+static long mpc_earley_match(mpc_earley_t *e, int k, long pos) {
 
-static const char mpc_escape_input_raw_re[] = { '/' };
-static const char *mpc_escape_output_raw_re[] = { "\\/", NULL };
+  long n;
+  mpc_result_t r;
+  mpc_earley_slot_t *s;
+  mpc_parser_t *p = e->a.g.nodes[k];
 
-static const char mpc_escape_input_raw_cstr[] = { '"' };
-static const char *mpc_escape_output_raw_cstr[] = { "\\\"", NULL };
+  switch (p->type) {
 
-static const char mpc_escape_input_raw_cchar[] = { '\'' };
-static const char *mpc_escape_output_raw_cchar[] = { "\\'", NULL };
+    case MPC_TYPE_STRING:
+      n = (long)strlen(p->data.string.x);
+      return n <= e->length - pos && memcmp(e->string + pos, p->data.string.x, (size_t)n) == 0 ? n : -1;
 
-static mpc_val_t *mpcf_escape_new(mpc_val_t *x, const char *input, const char **output) {
-  
-  int i;
-  int found;
-  char buff[2];
-  char *s = x;
-  char *y = calloc(1, 1);
-  
-  while (*s) {
-    
-    i = 0;
-    found = 0;
+    case MPC_TYPE_ANCHOR:
+      return p->data.anchor.f(
+        pos > 0 ? e->string[pos-1] : '\0',
+        pos < e->length ? e->string[pos] : '\0') ? 0 : -1;
 
-    while (output[i]) {
-      if (*s == input[i]) {
-        y = realloc(y, strlen(y) + strlen(output[i]) + 1);
-        strcat(y, output[i]);
-        found = 1;
-        break;
+    /* Lookaheads are run by the interpreter */
+    case MPC_TYPE_NOT:
+      s = mpc_earley_find(e, MPC_EARLEY_NOT, k, pos, 0, 1);
+      if (s->v != MPC_EARLEY_UNSET) { return s->v; }
+      mpc_earley_seek(e, pos);
+      if (mpc_parse_input_run(e->i, p->data.not.x, &r, 1, NULL, NULL)) {
+        n = -1;
+      } else {
+        mpc_err_delete(r.error);
+        n = 0;
       }
-      i++;
+      mpc_earley_find(e, MPC_EARLEY_NOT, k, pos, 0, 1)->v = n;
+      return n;
+
+    default:
+      return pos < e->length && mpc_analyse_accepts(p, e->string[pos]) ? 1 : -1;
+  }
+}
+
+/* Recognising */
+
+static void mpc_earley_add(mpc_earley_t *e, long j, int at, long origin) {
+
+  mpc_earley_set_t *set = &e->sets[j];
+  mpc_earley_slot_t *s = mpc_earley_find(e, MPC_EARLEY_ITEM, j, at, origin, 1);
+
+  if (s->v != MPC_EARLEY_UNSET) { return; }
+  s->v = set->num;
+
+  if (set->num == set->slots) {
+    set->slots = set->slots ? set->slots * 2 : 16;
+    set->items = realloc(set->items, sizeof(mpc_earley_item_t) * (unsigned long)set->slots);
+  }
+
+  set->items[set->num].at = at;
+  set->items[set->num].origin = origin;
+  set->items[set->num].wait = -1;
+  set->num++;
+}
+
+static void mpc_earley_set(mpc_earley_t *e, long j) {
+
+  int r, at, k, s;
+  long x, y, n, origin;
+  mpc_earley_slot_t *w;
+  mpc_earley_item_t *it;
+
+  for (x = 0; x < e->sets[j].num; x++) {
+
+    at = e->sets[j].items[x].at;
+    origin = e->sets[j].items[x].origin;
+    s = e->sym[at];
+
+    /* Complete */
+    if (s == -1) {
+      k = e->lhs[at];
+      if (k == -1) { continue; }
+      if (origin == j) { mpc_earley_find(e, MPC_EARLEY_EMPTY, j, k, 0, 1); }
+      for (y = mpc_earley_get(e, MPC_EARLEY_WAIT, origin, k, 0); y >= 0; y = it->wait) {
+        it = &e->sets[origin].items[y];
+        mpc_earley_add(e, j, it->at + 1, it->origin);
+        it = &e->sets[origin].items[y];
+      }
+      continue;
     }
-    
-    if (!found) {
-      y = realloc(y, strlen(y) + 2);
-      buff[0] = *s; buff[1] = '\0';
-      strcat(y, buff);
+
+    /* Scan */
+    if (e->kind[s] != MPC_EARLEY_RULES) {
+      n = mpc_earley_match(e, s, j);
+      if (n >= 0) { mpc_earley_add(e, j + n, at + 1, origin); }
+      continue;
+    }
+
+    /* Predict */
+    w = mpc_earley_find(e, MPC_EARLEY_WAIT, j, s, 0, 1);
+    e->sets[j].items[x].wait = w->v == MPC_EARLEY_UNSET ? -1 : w->v;
+    w->v = x;
+
+    if (e->sets[j].items[x].wait == -1) {
+      for (r = e->rules[s]; r < e->rules[s] + e->rules_num[s]; r++) {
+        mpc_earley_add(e, j, e->rule_at[r], j);
+      }
+    }
+
+    if (mpc_earley_get(e, MPC_EARLEY_EMPTY, j, s, 0) != MPC_EARLEY_UNSET) {
+      mpc_earley_add(e, j, at + 1, origin);
     }
-    
-    s++;
   }
-  
-  
-  return y;
 }
 
-static mpc_val_t *mpcf_unescape_new(mpc_val_t *x, const char *input, const char **output) {
-  
-  int i;
-  int found = 0;
-  char buff[2];
-  char *s = x;
-  char *y = calloc(1, 1);
-  
-  while (*s) {
-    
-    i = 0;
-    found = 0;
-    
-    while (output[i]) {
-      if ((*(s+0)) == output[i][0] &&
-          (*(s+1)) == output[i][1]) {
-        y = realloc(y, strlen(y) + 2);
-        buff[0] = input[i]; buff[1] = '\0';
-        strcat(y, buff);
-        found = 1;
-        s++;
-        break;
+/* Building */
+
+/*
+** Once recognised, each completed parser is indexed
+** by where it starts and by where it ends. Each list
+** is stored in `links` as a count followed by the
+** positions in ascending order, so that the nearest
+** position to some point can be found by bisection.
+*/
+
+static void mpc_earley_index(mpc_earley_t *e, long end) {
+
+  int at, pass;
+  long j, x, origin, off;
+  mpc_earley_slot_t *s;
+
+  for (pass = 0; pass < 2; pass++) {
+
+    if (pass == 1) {
+      for (x = 0; x < e->hash_slots; x++) {
+        s = &e->hash[x];
+        if (s->k[0] != MPC_EARLEY_ENDS && s->k[0] != MPC_EARLEY_STARTS) { continue; }
+        off = e->links_num;
+        e->links_num += s->v + 1;
+        s->v = off;
+      }
+      e->links = malloc(sizeof(long) * (unsigned long)(e->links_num + 1));
+      for (x = 0; x < e->hash_slots; x++) {
+        s = &e->hash[x];
+        if (s->k[0] == MPC_EARLEY_ENDS || s->k[0] == MPC_EARLEY_STARTS) { e->links[s->v] = 0; }
       }
-      i++;
     }
-    
-    if (!found) {
-      y = realloc(y, strlen(y) + 2);
-      buff[0] = *s; buff[1] = '\0';
-      strcat(y, buff);
+
+    for (j = 0; j <= end; j++) {
+      for (x = 0; x < e->sets[j].num; x++) {
+
+        at = e->sets[j].items[x].at;
+        origin = e->sets[j].items[x].origin;
+        if (e->sym[at] != -1 || e->lhs[at] == -1) { continue; }
+
+        s = mpc_earley_find(e, MPC_EARLEY_DONE, e->lhs[at], origin, j, 1);
+        if (s->v != (pass == 0 ? MPC_EARLEY_UNSET : 0)) { continue; }
+        s->v = pass;
+
+        if (pass == 0) {
+          s = mpc_earley_find(e, MPC_EARLEY_ENDS, e->lhs[at], origin, 0, 1);
+          s->v = s->v == MPC_EARLEY_UNSET ? 1 : s->v + 1;
+          s = mpc_earley_find(e, MPC_EARLEY_STARTS, e->lhs[at], j, 0, 1);
+          s->v = s->v == MPC_EARLEY_UNSET ? 1 : s->v + 1;
+        } else {
+          off = mpc_earley_get(e, MPC_EARLEY_ENDS, e->lhs[at], origin, 0);
+          e->links[off + 1 + e->links[off]++] = j;
+          off = mpc_earley_get(e, MPC_EARLEY_STARTS, e->lhs[at], j, 0);
+          e->links[off + 1 + e->links[off]++] = origin;
+        }
+      }
     }
-    
-    if (*s == '\0') { break; }
-    else { s++; }
   }
-  
-  return y;
-  
+
+  /* Ends are added in order but starts are not */
+  for (x = 0; x < e->hash_slots; x++) {
+    s = &e->hash[x];
+    if (s->k[0] != MPC_EARLEY_STARTS) { continue; }
+    qsort(e->links + s->v + 1, (size_t)e->links[s->v], sizeof(long), mpc_earley_cmp);
+  }
 }
 
-mpc_val_t *mpcf_escape(mpc_val_t *x) {
-  mpc_val_t *y = mpcf_escape_new(x, mpc_escape_input_c, mpc_escape_output_c);
-  free(x);
-  return y;
+/* Where the parser at `at` ends if the rest of its rule can go from `pos` to `end`, or -1 */
+static long mpc_earley_split(mpc_earley_t *e, int at, long pos, long end) {
+
+  long y, b, n, off, found = -1;
+  int s = e->sym[at];
+
+  if (s == -1) { return pos == end ? pos : -1; }
+
+  n = mpc_earley_get(e, MPC_EARLEY_SPLIT, at, pos, end);
+  if (n != MPC_EARLEY_UNSET) { return n; }
+
+  if (e->kind[s] != MPC_EARLEY_RULES) {
+    n = mpc_earley_match(e, s, pos);
+    if (n >= 0 && pos + n <= end && mpc_earley_split(e, at + 1, pos + n, end) != -1) { found = pos + n; }
+  } else {
+    /* Longest ends first */
+    off = mpc_earley_get(e, MPC_EARLEY_ENDS, s, pos, 0);
+    if (off >= 0) {
+      for (y = mpc_earley_upto(e->links + off + 1, e->links[off], end) - 1; y >= 0; y--) {
+        b = e->links[off + 1 + y];
+        if (mpc_earley_split(e, at + 1, b, end) != -1) { found = b; break; }
+      }
+    }
+  }
+
+  mpc_earley_find(e, MPC_EARLEY_SPLIT, at, pos, end, 1)->v = found;
+  return found;
 }
 
-mpc_val_t *mpcf_unescape(mpc_val_t *x) {
-  mpc_val_t *y = mpcf_unescape_new(x, mpc_escape_input_c, mpc_escape_output_c);
-  free(x);
-  return y;
+/* The first place from `start` a parser could begin and end at `end`, or -1 */
+static long mpc_earley_start(mpc_earley_t *e, int s, long start, long end) {
+
+  long y, b, off;
+  mpc_parser_t *p = e->a.g.nodes[s];
+
+  /* Terminals always match the same amount */
+  if (e->kind[s] != MPC_EARLEY_RULES) {
+    b = end - (e->kind[s] == MPC_EARLEY_PREDICATE ? 0
+      : p->type == MPC_TYPE_STRING ? (long)strlen(p->data.string.x) : 1);
+    return b >= start && mpc_earley_match(e, s, b) == end - b ? b : -1;
+  }
+
+  off = mpc_earley_get(e, MPC_EARLEY_STARTS, s, end, 0);
+  if (off < 0) { return -1; }
+  y = mpc_earley_upto(e->links + off + 1, e->links[off], start - 1);
+  return y < e->links[off] ? e->links[off + 1 + y] : -1;
+}
+
+/*
+** Results are built with an explicit stack of frames,
+** one for each parser being built, so that long left
+** recursive or repeated inputs don't use up the C
+** stack. A frame works out where each of its parts
+** begins and ends, and is folded once they are built.
+*/
+
+typedef struct {
+  int k;
+  int at;
+  int repeat;
+  int n;
+  int t;
+  long i;
+  long j;
+  long pos;
+  long *bs;
+  mpc_val_t **xs;
+} mpc_earley_frame_t;
+
+/*
+** Repetitions are split from the end backwards and
+** each element is made as long as it can be, which
+** is what the greedy interpreter would have done.
+** The boundaries are stored in order in `f->bs`.
+*/
+
+static void mpc_earley_repeat(mpc_earley_t *e, mpc_earley_frame_t *f) {
+
+  int x = e->sym[f->at];
+  long b, i = f->i, j = f->j, n = 0, slots = 8, m;
+  mpc_parser_t *p = e->a.g.nodes[f->k];
+
+  f->bs = malloc(sizeof(long) * (unsigned long)slots);
+  f->bs[n] = j;
+
+  while (i < j || (p->type == MPC_TYPE_MANY1 && n == 0)) {
+
+    b = -1;
+    for (m = mpc_earley_start(e, x, i, j); m != -1 && m <= j; m = mpc_earley_start(e, x, m + 1, j)) {
+      if (p->type == MPC_TYPE_MANY1 && m == i) { b = m; break; }
+      if (m < j && mpc_earley_get(e, MPC_EARLEY_DONE, f->k, i, m) != MPC_EARLEY_UNSET) { b = m; break; }
+    }
+    if (b == -1) { break; }
+
+    if (n + 1 == slots) {
+      slots = slots * 2;
+      f->bs = realloc(f->bs, sizeof(long) * (unsigned long)slots);
+    }
+    f->bs[++n] = b;
+    j = b;
+    if (p->type == MPC_TYPE_MANY1 && b == i) { break; }
+  }
+
+  for (m = 0; m < (n + 1) / 2; m++) {
+    b = f->bs[m]; f->bs[m] = f->bs[n-m]; f->bs[n-m] = b;
+  }
+
+  f->n = (int)n;
 }
 
-mpc_val_t *mpcf_escape_regex(mpc_val_t *x) {
-  mpc_val_t *y = mpcf_escape_new(x, mpc_escape_input_raw_re, mpc_escape_output_raw_re);
-  free(x);
-  return y;  
+static void mpc_earley_frame(mpc_earley_t *e, mpc_earley_frame_t *f, int k, long i, long j) {
+
+  int r;
+  mpc_parser_t *p = e->a.g.nodes[k];
+
+  f->k = k;
+  f->i = i;
+  f->j = j;
+  f->t = 0;
+  f->pos = i;
+  f->bs = NULL;
+  f->xs = NULL;
+
+  if (p->type == MPC_TYPE_MANY || p->type == MPC_TYPE_MANY1) {
+    f->at = e->rule_at[e->rules[k]] + 1;
+    f->repeat = 1;
+    mpc_earley_repeat(e, f);
+  } else {
+    /* Earlier rules are preferred */
+    for (r = e->rules[k]; r < e->rules[k] + e->rules_num[k]; r++) {
+      if (mpc_earley_split(e, e->rule_at[r], i, j) != -1) { break; }
+    }
+    f->at = e->rule_at[r];
+    f->repeat = 0;
+    f->n = e->rule_len[r];
+  }
+
+  if (f->n > 0) { f->xs = malloc(sizeof(mpc_val_t*) * (unsigned)f->n); }
 }
 
-mpc_val_t *mpcf_unescape_regex(mpc_val_t *x) {
-  mpc_val_t *y = mpcf_unescape_new(x, mpc_escape_input_raw_re, mpc_escape_output_raw_re);
-  free(x);
-  return y;  
-}
+static mpc_val_t *mpc_earley_leaf(mpc_earley_t *e, int k, long i, long j) {
 
-mpc_val_t *mpcf_escape_string_raw(mpc_val_t *x) {
-  mpc_val_t *y = mpcf_escape_new(x, mpc_escape_input_raw_cstr, mpc_escape_output_raw_cstr);
-  free(x);
-  return y;
-}
+  char *s;
+  mpc_parser_t *p = e->a.g.nodes[k];
 
-mpc_val_t *mpcf_unescape_string_raw(mpc_val_t *x) {
-  mpc_val_t *y = mpcf_unescape_new(x, mpc_escape_input_raw_cstr, mpc_escape_output_raw_cstr);
-  free(x);
-  return y;
-}
+  if (e->kind[k] == MPC_EARLEY_TERMINAL) {
+    s = malloc((size_t)(j - i) + 1);
+    memcpy(s, e->string + i, (size_t)(j - i));
+    s[j - i] = '\0';
+    return s;
+  }
 
-mpc_val_t *mpcf_escape_char_raw(mpc_val_t *x) {
-  mpc_val_t *y = mpcf_escape_new(x, mpc_escape_input_raw_cchar, mpc_escape_output_raw_cchar);
-  free(x);
-  return y;
+  return p->type == MPC_TYPE_NOT ? p->data.not.lf() : NULL;
 }
 
-mpc_val_t *mpcf_unescape_char_raw(mpc_val_t *x) {
-  mpc_val_t *y = mpcf_unescape_new(x, mpc_escape_input_raw_cchar, mpc_escape_output_raw_cchar);
-  free(x);
-  return y;
-}
+static mpc_val_t *mpc_earley_fold(mpc_earley_t *e, mpc_earley_frame_t *f) {
 
-mpc_val_t *mpcf_null(int n, mpc_val_t** xs) { (void) n; (void) xs; return NULL; }
-mpc_val_t *mpcf_fst(int n, mpc_val_t **xs) { (void) n; return xs[0]; }
-mpc_val_t *mpcf_snd(int n, mpc_val_t **xs) { (void) n; return xs[1]; }
-mpc_val_t *mpcf_trd(int n, mpc_val_t **xs) { (void) n; return xs[2]; }
+  mpc_val_t *v, **xs = f->xs;
+  mpc_parser_t *p = e->a.g.nodes[f->k];
+  int n = f->n;
 
-static mpc_val_t *mpcf_nth_free(int n, mpc_val_t **xs, int x) {
-  int i;
-  for (i = 0; i < n; i++) {
-    if (i != x) { free(xs[i]); }
+  switch (p->type) {
+    case MPC_TYPE_PASS:     v = NULL; break;
+    case MPC_TYPE_LIFT:     v = p->data.lift.lf(); break;
+    case MPC_TYPE_LIFT_VAL: v = p->data.lift.x; break;
+    case MPC_TYPE_STATE:    mpc_earley_seek(e, f->i); v = mpc_state_copy(mpc_input_state(e->i)); break;
+    case MPC_TYPE_APPLY:    v = p->data.apply.f(xs[0]); break;
+    case MPC_TYPE_APPLY_TO: v = p->data.apply_to.f(xs[0], p->data.apply_to.d); break;
+    case MPC_TYPE_MAYBE:    v = n ? xs[0] : p->data.not.lf(); break;
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+    case MPC_TYPE_COUNT:    v = p->data.repeat.f(n, xs); break;
+    case MPC_TYPE_OR:       v = n ? xs[0] : NULL; break;
+    case MPC_TYPE_AND:      v = p->data.and.f(n, xs); break;
+    default:                v = xs[0]; break;
   }
-  return xs[x];
+
+  free(f->xs);
+  free(f->bs);
+  return v;
 }
- 
-mpc_val_t *mpcf_fst_free(int n, mpc_val_t **xs) { return mpcf_nth_free(n, xs, 0); }
-mpc_val_t *mpcf_snd_free(int n, mpc_val_t **xs) { return mpcf_nth_free(n, xs, 1); }
-mpc_val_t *mpcf_trd_free(int n, mpc_val_t **xs) { return mpcf_nth_free(n, xs, 2); }
 
-mpc_val_t *mpcf_strfold(int n, mpc_val_t **xs) {
-  int i;
-  char *x = calloc(1, 1);
+static mpc_val_t *mpc_earley_value(mpc_earley_t *e, int k, long i, long j) {
 
-  for (i = 0; i < n; i++) {
-    x = realloc(x, strlen(x) + strlen(xs[i]) + 1);
-    strcat(x, xs[i]);
-    free(xs[i]);
+  int c, num = 0, slots = 16;
+  long a, b;
+  mpc_val_t *v = NULL;
+  mpc_earley_frame_t *f, *fs;
+
+  if (e->kind[k] != MPC_EARLEY_RULES) { return mpc_earley_leaf(e, k, i, j); }
+
+  fs = malloc(sizeof(mpc_earley_frame_t) * (unsigned)slots);
+  mpc_earley_frame(e, &fs[num++], k, i, j);
+
+  while (num > 0) {
+
+    f = &fs[num-1];
+
+    if (f->t == f->n) {
+      v = mpc_earley_fold(e, f);
+      num--;
+      if (num > 0) { fs[num-1].xs[fs[num-1].t++] = v; }
+      continue;
+    }
+
+    if (f->repeat) {
+      c = e->sym[f->at];
+      a = f->bs[f->t];
+      b = f->bs[f->t+1];
+    } else {
+      c = e->sym[f->at + f->t];
+      a = f->pos;
+      b = mpc_earley_split(e, f->at + f->t, a, f->j);
+      f->pos = b;
+    }
+
+    if (e->kind[c] != MPC_EARLEY_RULES) {
+      f->xs[f->t++] = mpc_earley_leaf(e, c, a, b);
+      continue;
+    }
+
+    if (num == slots) {
+      slots = slots * 2;
+      fs = realloc(fs, sizeof(mpc_earley_frame_t) * (unsigned)slots);
+    }
+    mpc_earley_frame(e, &fs[num++], c, a, b);
   }
-  return x;
-}
 
-mpc_val_t *mpcf_maths(int n, mpc_val_t **xs) {
-  int **vs = (int**)xs;
-  (void) n;
-  
-  if (strcmp(xs[1], "*") == 0) { *vs[0] *= *vs[2]; }
-  if (strcmp(xs[1], "/") == 0) { *vs[0] /= *vs[2]; }
-  if (strcmp(xs[1], "%") == 0) { *vs[0] %= *vs[2]; }
-  if (strcmp(xs[1], "+") == 0) { *vs[0] += *vs[2]; }
-  if (strcmp(xs[1], "-") == 0) { *vs[0] -= *vs[2]; }
-  
-  free(xs[1]); free(xs[2]);
-  
-  return xs[0];
+  free(fs);
+  return v;
 }
 
+/* Errors */
+
 /*
-** Printing
+** On failure the error is made at the furthest place
+** the input was read to, expecting whatever could
+** have come next for the items there which began
+** earlier. These are described as the interpreter
+** would, by the outermost `mpc_expect` labels.
 */
 
-static void mpc_print_unretained(mpc_parser_t *p, int force) {
-  
-  /* TODO: Print Everything Escaped */
-  
-  int i;
-  char *s, *e;
-  char buff[2];
-  
-  if (p->retained && !force) {;
-    if (p->name) { printf("<%s>", p->name); }
-    else { printf("<anon>"); }
-    return;
-  }
-  
-  if (p->type == MPC_TYPE_UNDEFINED) { printf("<?>"); }
-  if (p->type == MPC_TYPE_PASS)   { printf("<:>"); }
-  if (p->type == MPC_TYPE_FAIL)   { printf("<!>"); }
-  if (p->type == MPC_TYPE_LIFT)   { printf("<#>"); }
-  if (p->type == MPC_TYPE_STATE)  { printf("<S>"); }
-  if (p->type == MPC_TYPE_ANCHOR) { printf("<@>"); }
+static mpc_err_t *mpc_earley_expected(mpc_earley_t *e, int k, char *seen, mpc_err_t *blank) {
+
+  int r, t, at, n = 0, slots = 0;
+  mpc_err_t *x, **xs = NULL;
+  mpc_parser_t *p = e->a.g.nodes[k];
+
+  if (seen[k] || e->kind[k] != MPC_EARLEY_RULES) { return NULL; }
+  seen[k] = 1;
+
   if (p->type == MPC_TYPE_EXPECT) {
-    printf("%s", p->data.expect.m);
-    /*mpc_print_unretained(p->data.expect.x, 0);*/
+    return mpc_err_new(blank->filename, blank->state, p->data.expect.m, blank->recieved);
   }
-  
-  if (p->type == MPC_TYPE_ANY) { printf("<.>"); }
-  if (p->type == MPC_TYPE_SATISFY) { printf("<f>"); }
 
-  if (p->type == MPC_TYPE_SINGLE) {
-    buff[0] = p->data.single.x; buff[1] = '\0';
-    s = mpcf_escape_new(
-      buff,
-      mpc_escape_input_c,
-      mpc_escape_output_c);
-    printf("'%s'", s);
-    free(s);
-  }
-  
-  if (p->type == MPC_TYPE_RANGE) {
-    buff[0] = p->data.range.x; buff[1] = '\0';
-    s = mpcf_escape_new(
-      buff,
-      mpc_escape_input_c,
-      mpc_escape_output_c);
-    buff[0] = p->data.range.y; buff[1] = '\0';
-    e = mpcf_escape_new(
-      buff,
-      mpc_escape_input_c,
-      mpc_escape_output_c);
-    printf("[%s-%s]", s, e);
-    free(s);
-    free(e);
+  if (p->type == MPC_TYPE_MANY1 || p->type == MPC_TYPE_COUNT) {
+    x = mpc_earley_expected(e, e->sym[e->rule_at[e->rules[k]] + (p->type == MPC_TYPE_MANY1)], seen, blank);
+    if (x == NULL) { return NULL; }
+    return p->type == MPC_TYPE_MANY1 ? mpc_err_many1(x) : mpc_err_count(x, p->data.repeat.n);
   }
-  
-  if (p->type == MPC_TYPE_ONEOF) {
-    s = mpcf_escape_new(
-      p->data.string.x,
-      mpc_escape_input_c,
-      mpc_escape_output_c);
-    printf("[%s]", s);
-    free(s);
+
+  for (r = e->rules[k]; r < e->rules[k] + e->rules_num[k]; r++) {
+    at = e->rule_at[r];
+    for (t = 0; t < e->rule_len[r]; t++) {
+      x = mpc_earley_expected(e, e->sym[at + t], seen, blank);
+      if (x) {
+        if (n == slots) {
+          slots = slots ? slots * 2 : 4;
+          xs = realloc(xs, sizeof(mpc_err_t*) * (unsigned)slots);
+        }
+        xs[n++] = x;
+      }
+      if (!mpc_analysis_nullable(&e->a, e->a.g.nodes[e->sym[at + t]])) { break; }
+    }
   }
-  
-  if (p->type == MPC_TYPE_NONEOF) {
-    s = mpcf_escape_new(
-      p->data.string.x,
-      mpc_escape_input_c,
-      mpc_escape_output_c);
-    printf("[^%s]", s);
-    free(s);
+
+  x = n ? mpc_err_or(xs, n) : NULL;
+  free(xs);
+  return x;
+}
+
+static mpc_err_t *mpc_earley_err(mpc_earley_t *e, const char *filename) {
+
+  int at, s, n = 0;
+  long j, x;
+  char *seen = calloc((unsigned)e->a.g.nodes_num, 1);
+  mpc_err_t *err, *blank, **xs = NULL;
+
+  j = e->length;
+  while (j > 0 && e->sets[j].num == 0) { j--; }
+
+  mpc_earley_seek(e, j);
+  blank = mpc_err_fail(filename, mpc_input_state(e->i), "Incorrect Input");
+  blank->recieved = j < e->length ? e->string[j] : '\0';
+
+  for (x = 0; x < e->sets[j].num; x++) {
+    at = e->sets[j].items[x].at;
+    s = e->sym[at];
+    if (s == -1 || (e->sets[j].items[x].origin == j && e->lhs[at] != -1)) { continue; }
+    err = mpc_earley_expected(e, s, seen, blank);
+    if (err == NULL) { continue; }
+    xs = realloc(xs, sizeof(mpc_err_t*) * (unsigned)(n + 1));
+    xs[n++] = err;
   }
-  
-  if (p->type == MPC_TYPE_STRING) {
-    s = mpcf_escape_new(
-      p->data.string.x,
-      mpc_escape_input_c,
-      mpc_escape_output_c);
-    printf("\"%s\"", s);
-    free(s);
+
+  if (n) {
+    err = mpc_err_or(xs, n);
+    mpc_err_delete(blank);
+  } else {
+    err = blank;
   }
-  
-  if (p->type == MPC_TYPE_APPLY)    { mpc_print_unretained(p->data.apply.x, 0); }
-  if (p->type == MPC_TYPE_APPLY_TO) { mpc_print_unretained(p->data.apply_to.x, 0); }
-  if (p->type == MPC_TYPE_PREDICT)  { mpc_print_unretained(p->data.predict.x, 0); }
 
-  if (p->type == MPC_TYPE_NOT)   { mpc_print_unretained(p->data.not.x, 0); printf("!"); }
-  if (p->type == MPC_TYPE_MAYBE) { mpc_print_unretained(p->data.not.x, 0); printf("?"); }
+  free(xs);
+  free(seen);
+  return err;
+}
 
-  if (p->type == MPC_TYPE_MANY)  { mpc_print_unretained(p->data.repeat.x, 0); printf("*"); }
-  if (p->type == MPC_TYPE_MANY1) { mpc_print_unretained(p->data.repeat.x, 0); printf("+"); }
-  if (p->type == MPC_TYPE_COUNT) { mpc_print_unretained(p->data.repeat.x, 0); printf("{%i}", p->data.repeat.n); }
-  
-  if (p->type == MPC_TYPE_OR) {
-    printf("(");
-    for(i = 0; i < p->data.or.n-1; i++) {
-      mpc_print_unretained(p->data.or.xs[i], 0);
-      printf(" | ");
-    }
-    mpc_print_unretained(p->data.or.xs[p->data.or.n-1], 0);
-    printf(")");
+int mpc_parse_earley(const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r) {
+
+  int k;
+  long j, end = -1;
+  mpc_earley_t e;
+
+  mpc_analysis_init(&e.a, &p, 1);
+  e.root = mpc_graph_index(&e.a.g, p);
+  e.string = string;
+  e.length = (long)strlen(string);
+  e.i = mpc_input_new_string(filename, string, e.length);
+
+  e.kind = malloc((unsigned)e.a.g.nodes_num);
+  e.rules = malloc(sizeof(int) * (unsigned)e.a.g.nodes_num);
+  e.rules_num = malloc(sizeof(int) * (unsigned)e.a.g.nodes_num);
+  e.rule_num = 0; e.rule_slots = 0; e.rule_at = NULL; e.rule_len = NULL;
+  e.at_num = 0; e.at_slots = 0; e.sym = NULL; e.lhs = NULL;
+  e.hash_num = 0; e.hash_slots = 0; e.hash = NULL;
+  e.links_num = 0; e.links = NULL;
+  e.sets = calloc((unsigned long)e.length + 1, sizeof(mpc_earley_set_t));
+
+  for (k = 0; k < e.a.g.nodes_num; k++) { mpc_earley_rules(&e, k); }
+
+  /* The start rule has no parser of its own */
+  mpc_earley_rule(&e, -1, 1, &e.root);
+  mpc_earley_rehash(&e);
+  mpc_earley_add(&e, 0, e.rule_at[e.rule_num-1], 0);
+
+  for (j = 0; j <= e.length; j++) {
+    mpc_earley_set(&e, j);
+    if (mpc_earley_get(&e, MPC_EARLEY_ITEM, j, e.rule_at[e.rule_num-1] + 1, 0) != MPC_EARLEY_UNSET) { end = j; }
   }
-  
-  if (p->type == MPC_TYPE_AND) {
-    printf("(");
-    for(i = 0; i < p->data.and.n-1; i++) {
-      mpc_print_unretained(p->data.and.xs[i], 0);
-      printf(" ");
-    }
-    mpc_print_unretained(p->data.and.xs[p->data.and.n-1], 0);
-    printf(")");
+
+  if (end == -1) {
+    r->error = mpc_earley_err(&e, filename);
+  } else {
+
+    mpc_earley_index(&e, end);
+    r->output = mpc_earley_value(&e, e.root, 0, end);
   }
-  
-}
 
-void mpc_print(mpc_parser_t *p) {
-  mpc_print_unretained(p, 1);
-  printf("\n");
+  for (j = 0; j <= e.length; j++) { free(e.sets[j].items); }
+  free(e.sets);
+  free(e.links);
+  free(e.hash);
+  free(e.sym);
+  free(e.lhs);
+  free(e.rule_at);
+  free(e.rule_len);
+  free(e.rules);
+  free(e.rules_num);
+  free(e.kind);
+  mpc_input_delete(e.i);
+  mpc_analysis_free(&e.a);
+
+  return end != -1;
 }
 
 /*
@@ -2544,6 +6343,24 @@ mpc_ast_t *mpc_ast_new(const char *tag, const char *contents) {
   
 }
 
+mpc_ast_t *mpc_ast_copy(mpc_ast_t *a) {
+  
+  int i;
+  mpc_ast_t *r;
+  
+  if (a == NULL) { return NULL; }
+  
+  r = mpc_ast_new(a->tag, a->contents);
+  r->state = a->state;
+  r->children_num = a->children_num;
+  r->children = malloc(sizeof(mpc_ast_t*) * a->children_num);
+  for (i = 0; i < a->children_num; i++) {
+    r->children[i] = mpc_ast_copy(a->children[i]);
+  }
+  
+  return r;
+}
+
 mpc_ast_t *mpc_ast_build(int n, const char *tag, ...) {
   
   mpc_ast_t *a = mpc_ast_new(tag, "");
@@ -2737,6 +6554,7 @@ mpc_parser_t *mpca_or(int n, ...) {
   p->type = MPC_TYPE_OR;
   p->data.or.n = n;
   p->data.or.xs = malloc(sizeof(mpc_parser_t*) * n);
+  p->data.or.dispatch = NULL;
   
   va_start(va, n);  
   for (i = 0; i < n; i++) {
@@ -2757,6 +6575,7 @@ mpc_parser_t *mpca_and(int n, ...) {
   
   p->type = MPC_TYPE_AND;
   p->data.and.n = n;
+  p->data.and.unmarked = 0;
   p->data.and.f = mpcf_fold_ast;
   p->data.and.xs = malloc(sizeof(mpc_parser_t*) * n);
   p->data.and.dxs = malloc(sizeof(mpc_dtor_t) * (n-1));
@@ -2774,6 +6593,16 @@ mpc_parser_t *mpca_and(int n, ...) {
 }
 
 mpc_parser_t *mpca_total(mpc_parser_t *a) { return mpc_total(a, (mpc_dtor_t)mpc_ast_delete); }
+mpc_parser_t *mpca_packrat(mpc_parser_t *a) { return mpc_packrat(a, (mpc_apply_t)mpc_ast_copy, (mpc_dtor_t)mpc_ast_delete); }
+mpc_parser_t *mpca_memo(mpc_parser_t *a) { return mpc_memo(a, (mpc_apply_t)mpc_ast_copy, (mpc_dtor_t)mpc_ast_delete); }
+
+static mpc_val_t *mpcaf_recover(mpc_val_t *x) {
+  mpc_ast_t *e = mpc_ast_new("error", x);
+  free(x);
+  return e;
+}
+
+mpc_parser_t *mpca_recover(mpc_parser_t *a, mpc_parser_t *sync) { return mpc_recover(a, sync, (mpc_dtor_t)mpc_ast_delete, mpcaf_recover); }
 
 /*
 ** Grammar Parser
@@ -3023,9 +6852,55 @@ mpc_parser_t *mpca_grammar(int flags, const char *grammar, ...) {
   return res;
 }
 
+typedef struct {
+  int memo;
+  mpc_parser_t *recover;
+} mpca_flags_t;
+
+static mpc_val_t *mpca_flag_memo(mpc_val_t *x) {
+  mpca_flags_t *flags = calloc(1, sizeof(mpca_flags_t));
+  flags->memo = 1;
+  free(x);
+  return flags;
+}
+
+static mpc_val_t *mpca_flag_recover(int n, mpc_val_t **xs) {
+  mpca_flags_t *flags = calloc(1, sizeof(mpca_flags_t));
+  flags->recover = xs[1];
+  (void) n;
+  free(xs[0]);
+  return flags;
+}
+
+static void mpca_flags_delete(mpc_val_t *x) {
+  mpca_flags_t *flags = x;
+  if (flags->recover) { mpc_soft_delete(flags->recover); }
+  free(flags);
+}
+
+static mpc_val_t *mpca_flags_fold(int n, mpc_val_t **xs) {
+  
+  int i;
+  mpca_flags_t *flags = calloc(1, sizeof(mpca_flags_t));
+  
+  for (i = 0; i < n; i++) {
+    mpca_flags_t *x = xs[i];
+    flags->memo = flags->memo || x->memo;
+    if (x->recover) {
+      if (flags->recover) { mpc_soft_delete(flags->recover); }
+      flags->recover = x->recover;
+    }
+    free(x);
+  }
+  
+  return flags;
+}
+
 typedef struct {
   char *ident;
   char *name;
+  int memo;
+  mpc_parser_t *recover;
   mpc_parser_t *grammar;
 } mpca_stmt_t;
 
@@ -3033,10 +6908,13 @@ static mpc_val_t *mpca_stmt_afold(int n, mpc_val_t **xs) {
   mpca_stmt_t *stmt = malloc(sizeof(mpca_stmt_t));
   stmt->ident = ((char**)xs)[0];
   stmt->name = ((char**)xs)[1];
-  stmt->grammar = ((mpc_parser_t**)xs)[3];
+  stmt->memo = ((mpca_flags_t**)xs)[2]->memo;
+  stmt->recover = ((mpca_flags_t**)xs)[2]->recover;
+  stmt->grammar = ((mpc_parser_t**)xs)[4];
   (void) n;
   free(((char**)xs)[2]);
-  free(((char**)xs)[4]);
+  free(((char**)xs)[3]);
+  free(((char**)xs)[5]);
   
   return stmt;
 }
@@ -3062,6 +6940,7 @@ static void mpca_stmt_list_delete(mpc_val_t *x) {
     mpca_stmt_t *stmt = *stmts; 
     free(stmt->ident);
     free(stmt->name);
+    if (stmt->recover) { mpc_soft_delete(stmt->recover); }
     mpc_soft_delete(stmt->grammar);
     free(stmt);  
     stmts++;
@@ -3082,6 +6961,8 @@ static mpc_val_t *mpca_stmt_list_apply_to(mpc_val_t *x, void *s) {
     left = mpca_grammar_find_parser(stmt->ident, st);
     if (st->flags & MPCA_LANG_PREDICTIVE) { stmt->grammar = mpc_predictive(stmt->grammar); }
     if (stmt->name) { stmt->grammar = mpc_expect(stmt->grammar, stmt->name); }
+    if (stmt->memo) { stmt->grammar = mpca_memo(stmt->grammar); }
+    if (stmt->recover) { stmt->grammar = mpca_recover(stmt->grammar, stmt->recover); }
     mpc_define(left, stmt->grammar);
     free(stmt->ident);
     free(stmt->name);
@@ -3097,10 +6978,11 @@ static mpc_err_t *mpca_lang_st(mpc_input_t *i, mpca_grammar_st_t *st) {
   
   mpc_result_t r;
   mpc_err_t *e;
-  mpc_parser_t *Lang, *Stmt, *Grammar, *Term, *Factor, *Base; 
+  mpc_parser_t *Lang, *Stmt, *Flag, *Grammar, *Term, *Factor, *Base; 
   
   Lang    = mpc_new("lang");
   Stmt    = mpc_new("stmt");
+  Flag    = mpc_new("flag");
   Grammar = mpc_new("grammar");
   Term    = mpc_new("term");
   Factor  = mpc_new("factor");
@@ -3111,9 +6993,17 @@ static mpc_err_t *mpca_lang_st(mpc_input_t *i, mpca_grammar_st_t *st) {
     mpca_stmt_list_apply_to, st
   ));
   
-  mpc_define(Stmt, mpc_and(5, mpca_stmt_afold,
-    mpc_tok(mpc_ident()), mpc_maybe(mpc_tok(mpc_string_lit())), mpc_sym(":"), Grammar, mpc_sym(";"),
-    free, free, free, mpc_soft_delete
+  mpc_define(Stmt, mpc_and(6, mpca_stmt_afold,
+    mpc_tok(mpc_ident()), mpc_maybe(mpc_tok(mpc_string_lit())), mpc_many(mpca_flags_fold, Flag),
+    mpc_sym(":"), Grammar, mpc_sym(";"),
+    free, free, mpca_flags_delete, free, mpc_soft_delete
+  ));
+  
+  mpc_define(Flag, mpc_and(2, mpcf_snd_free, mpc_char('@'),
+    mpc_or(2,
+      mpc_apply(mpc_sym("memo"), mpca_flag_memo),
+      mpc_and(2, mpca_flag_recover, mpc_sym("recover"), Base, free)),
+    free
   ));
   
   mpc_define(Grammar, mpc_and(2, mpcaf_grammar_or,
@@ -3149,9 +7039,10 @@ static mpc_err_t *mpca_lang_st(mpc_input_t *i, mpca_grammar_st_t *st) {
     e = r.error;
   } else {
     e = NULL;
+    mpc_analyse_roots(st->parsers, st->parsers_num);
   }
   
-  mpc_cleanup(6, Lang, Stmt, Grammar, Term, Factor, Base);
+  mpc_cleanup(7, Lang, Stmt, Flag, Grammar, Term, Factor, Base);
   
   return e;
 }
@@ -3169,7 +7060,8 @@ mpc_err_t *mpca_lang_file(int flags, FILE *f, ...) {
   st.parsers = NULL;
   st.flags = flags;
   
-  i = mpc_input_new_file("<mpca_lang_file>", f);
+  i = mpc_input_new_mmap("<mpca_lang_file>", f);
+  if (i == NULL) { i = mpc_input_new_file("<mpca_lang_file>", f); }
   err = mpca_lang_st(i, &st);
   mpc_input_delete(i);
   
@@ -3214,7 +7106,7 @@ mpc_err_t *mpca_lang(int flags, const char *language, ...) {
   st.parsers = NULL;
   st.flags = flags;
   
-  i = mpc_input_new_string("<mpca_lang>", language);
+  i = mpc_input_new_string("<mpca_lang>", language, (long)strlen(language));
   err = mpca_lang_st(i, &st);
   mpc_input_delete(i);
   
@@ -3244,7 +7136,8 @@ mpc_err_t *mpca_lang_contents(int flags, const char *filename, ...) {
   st.parsers = NULL;
   st.flags = flags;
   
-  i = mpc_input_new_file(filename, f);
+  i = mpc_input_new_mmap(filename, f);
+  if (i == NULL) { i = mpc_input_new_file(filename, f); }
   err = mpca_lang_st(i, &st);
   mpc_input_delete(i);
   
@@ -60,10 +60,51 @@ typedef union {
 struct mpc_parser_t;
 typedef struct mpc_parser_t mpc_parser_t;
 
+/* Parsing a list of buffers is only available on POSIX systems */
+#if !defined(MPC_POSIX) && (defined(__unix__) || defined(__unix) || (defined(__APPLE__) && defined(__MACH__)))
+#define MPC_POSIX
+#endif
+
+#ifdef MPC_POSIX
+struct iovec;
+#endif
+
+typedef struct {
+  void *data;
+  size_t (*read)(void *data, char *buffer, size_t length);
+  int (*seek)(void *data, long offset);
+  long (*size)(void *data);
+} mpc_source_t;
+
 int mpc_parse(const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r);
+int mpc_parse_n(const char *filename, const char *string, size_t length, mpc_parser_t *p, mpc_result_t *r);
+int mpc_parse_prefix(const char *filename, const char *string, size_t length, size_t *offset, mpc_parser_t *p, mpc_result_t *r);
 int mpc_parse_file(const char *filename, FILE *file, mpc_parser_t *p, mpc_result_t *r);
 int mpc_parse_pipe(const char *filename, FILE *pipe, mpc_parser_t *p, mpc_result_t *r);
 int mpc_parse_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r);
+int mpc_parse_prefetch(const char *filename, FILE *file, mpc_parser_t *p, mpc_result_t *r);
+int mpc_parse_source(const char *filename, mpc_source_t *s, mpc_parser_t *p, mpc_result_t *r);
+#ifdef MPC_POSIX
+int mpc_parse_iov(const char *filename, const struct iovec *iov, int n, mpc_parser_t *p, mpc_result_t *r);
+#endif
+
+/* These still allocate an input and stacks each call. Use mpc_ctx_match to match without allocating */
+int mpc_match(const char *filename, const char *string, mpc_parser_t *p, mpc_err_t **e);
+int mpc_match_n(const char *filename, const char *string, size_t length, mpc_parser_t *p, mpc_err_t **e);
+
+int mpc_parse_recover(const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r, mpc_err_t ***es, int *n);
+int mpc_parse_recover_file(const char *filename, FILE *file, mpc_parser_t *p, mpc_result_t *r, mpc_err_t ***es, int *n);
+int mpc_parse_recover_pipe(const char *filename, FILE *pipe, mpc_parser_t *p, mpc_result_t *r, mpc_err_t ***es, int *n);
+
+struct mpc_ctx_t;
+typedef struct mpc_ctx_t mpc_ctx_t;
+
+mpc_ctx_t *mpc_ctx_new(void);
+void mpc_ctx_delete(mpc_ctx_t *c);
+int mpc_ctx_parse(mpc_ctx_t *c, const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r);
+int mpc_ctx_parse_n(mpc_ctx_t *c, const char *filename, const char *string, size_t length, mpc_parser_t *p, mpc_result_t *r);
+int mpc_ctx_match(mpc_ctx_t *c, const char *filename, const char *string, mpc_parser_t *p, mpc_err_t **e);
+int mpc_ctx_match_n(mpc_ctx_t *c, const char *filename, const char *string, size_t length, mpc_parser_t *p, mpc_err_t **e);
 
 /*
 ** Function Types
@@ -133,6 +174,18 @@ mpc_parser_t *mpc_or(int n, ...);
 mpc_parser_t *mpc_and(int n, mpc_fold_t f, ...);
 
 mpc_parser_t *mpc_predictive(mpc_parser_t *a);
+mpc_parser_t *mpc_packrat(mpc_parser_t *a, mpc_apply_t clone, mpc_dtor_t da);
+mpc_parser_t *mpc_memo(mpc_parser_t *a, mpc_apply_t clone, mpc_dtor_t da);
+
+typedef struct {
+  unsigned long steps;
+  unsigned long depth;
+  unsigned long buffer;
+  unsigned long memory;
+} mpc_limits_t;
+
+mpc_parser_t *mpc_limit(mpc_parser_t *a, mpc_dtor_t da, const mpc_limits_t *l);
+mpc_parser_t *mpc_recover(mpc_parser_t *a, mpc_parser_t *sync, mpc_dtor_t ds, mpc_apply_t f);
 
 /*
 ** Common Parsers
@@ -264,6 +317,7 @@ typedef struct mpc_ast_t {
 } mpc_ast_t;
 
 mpc_ast_t *mpc_ast_new(const char *tag, const char *contents);
+mpc_ast_t *mpc_ast_copy(mpc_ast_t *a);
 mpc_ast_t *mpc_ast_build(int n, const char *tag, ...);
 mpc_ast_t *mpc_ast_add_root(mpc_ast_t *a);
 mpc_ast_t *mpc_ast_add_child(mpc_ast_t *r, mpc_ast_t *a);
@@ -289,6 +343,9 @@ mpc_parser_t *mpca_add_tag(mpc_parser_t *a, const char *t);
 mpc_parser_t *mpca_root(mpc_parser_t *a);
 mpc_parser_t *mpca_state(mpc_parser_t *a);
 mpc_parser_t *mpca_total(mpc_parser_t *a);
+mpc_parser_t *mpca_packrat(mpc_parser_t *a);
+mpc_parser_t *mpca_memo(mpc_parser_t *a);
+mpc_parser_t *mpca_recover(mpc_parser_t *a, mpc_parser_t *sync);
 
 mpc_parser_t *mpca_not(mpc_parser_t *a);
 mpc_parser_t *mpca_maybe(mpc_parser_t *a);
@@ -313,6 +370,27 @@ mpc_err_t *mpca_lang_file(int flags, FILE *f, ...);
 mpc_err_t *mpca_lang_pipe(int flags, FILE *f, ...);
 mpc_err_t *mpca_lang_contents(int flags, const char *filename, ...);
 
+/*
+** Analysis
+*/
+
+void mpc_analyse(mpc_parser_t *a);
+
+/*
+** Searching
+*/
+
+typedef int(*mpc_found_t)(size_t,size_t,mpc_val_t*,void*);
+
+int mpc_search(const char *filename, const char *string, size_t length, size_t *offset, size_t *start, mpc_parser_t *p, mpc_result_t *r);
+int mpc_find_all(const char *filename, const char *string, size_t length, mpc_parser_t *p, mpc_found_t f, void *data);
+
+/*
+** Earley
+*/
+
+int mpc_parse_earley(const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r);
+
 /*
 ** Debug & Testing
 */
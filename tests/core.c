@@ -1,9 +1,38 @@
+#if defined(__unix__) || defined(__unix) || (defined(__APPLE__) && defined(__MACH__))
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+#endif
+
 #include "ptest.h"
 #include "../mpc.h"
 
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__unix__) || defined(__unix) || (defined(__APPLE__) && defined(__MACH__))
+#include <sys/uio.h>
+#include <unistd.h>
+#define TEST_IOV
+#endif
+
+/* Allocations are counted by wrapping the C library allocator where it can be reached */
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+#define TEST_ALLOCS
+
+extern void *__libc_malloc(size_t n);
+extern void *__libc_calloc(size_t n, size_t m);
+extern void *__libc_realloc(void *p, size_t n);
+extern void __libc_free(void *p);
+
+static unsigned long test_allocs = 0;
+
+void *malloc(size_t n) { test_allocs++; return __libc_malloc(n); }
+void *calloc(size_t n, size_t m) { test_allocs++; return __libc_calloc(n, m); }
+void *realloc(void *p, size_t n) { test_allocs++; return __libc_realloc(p, n); }
+void free(void *p) { __libc_free(p); }
+#endif
+
 static int int_eq(const void* x, const void* y) { return (*(int*)x == *(int*)y); }
 static void int_print(const void* x) { printf("'%i'", *((int*)x)); }
 static int streq(const void* x, const void* y) { return (strcmp(x, y) == 0); }
@@ -85,8 +114,696 @@ void test_strip(void) {
   
 }
 
+void test_parse_n(void) {
+  
+  mpc_result_t r;
+  mpc_parser_t *Digits = mpc_many1(mpcf_strfold, mpc_digit());
+  mpc_parser_t *Any = mpc_total(mpc_many(mpcf_strfold, mpc_noneof("a")), free);
+  
+  PT_ASSERT(mpc_parse_n("<test>", "123456", 3, Digits, &r));
+  PT_ASSERT_STR_EQ(r.output, "123");
+  free(r.output);
+  
+  PT_ASSERT(mpc_parse_n("<test>", "12\0" "34", 5, Any, &r));
+  PT_ASSERT_STR_EQ(r.output, "1234");
+  free(r.output);
+  
+  PT_ASSERT(!mpc_parse_n("<test>", "12\0" "3a", 5, Any, &r));
+  mpc_err_delete(r.error);
+  
+  mpc_delete(Digits);
+  mpc_delete(Any);
+  
+}
+
+void test_parse_prefix(void) {
+  
+  mpc_result_t r;
+  size_t offset = 0;
+  const char *records = "12;345;6a";
+  mpc_parser_t *Record = mpc_and(2, mpcf_fst_free,
+    mpc_many1(mpcf_strfold, mpc_digit()), mpc_char(';'), free);
+  
+  PT_ASSERT(mpc_parse_prefix("<test>", records, 9, &offset, Record, &r));
+  PT_ASSERT_STR_EQ(r.output, "12");
+  PT_ASSERT(offset == 3);
+  free(r.output);
+  
+  PT_ASSERT(mpc_parse_prefix("<test>", records, 9, &offset, Record, &r));
+  PT_ASSERT_STR_EQ(r.output, "345");
+  PT_ASSERT(offset == 7);
+  free(r.output);
+  
+  PT_ASSERT(!mpc_parse_prefix("<test>", records, 9, &offset, Record, &r));
+  PT_ASSERT(offset == 7);
+  PT_ASSERT(r.error->state.pos == 8);
+  mpc_err_delete(r.error);
+  
+  offset = 10;
+  PT_ASSERT(!mpc_parse_prefix("<test>", records, 9, &offset, Record, &r));
+  PT_ASSERT(offset == 10);
+  mpc_err_delete(r.error);
+  
+  mpc_delete(Record);
+  
+  /* Errors past the first record are placed in the whole buffer */
+  Record = mpc_and(3, mpcf_strfold, mpc_char('a'), mpc_char('b'), mpc_char('\n'), free, free);
+  offset = 6;
+  PT_ASSERT(!mpc_parse_prefix("<test>", "ab\nab\nXb", 8, &offset, Record, &r));
+  PT_ASSERT(r.error->state.pos == 6);
+  PT_ASSERT(r.error->state.row == 2);
+  PT_ASSERT(r.error->state.col == 0);
+  mpc_err_delete(r.error);
+  mpc_delete(Record);
+  
+  /* Anchors see the character before the offset */
+  Record = mpc_and(2, mpcf_snd, mpc_boundary(), mpc_char('X'), mpcf_dtor_null);
+  offset = 1;
+  PT_ASSERT(!mpc_parse_prefix("<test>", "aXb", 3, &offset, Record, &r));
+  mpc_err_delete(r.error);
+  offset = 1;
+  PT_ASSERT(mpc_parse_prefix("<test>", " Xb", 3, &offset, Record, &r));
+  PT_ASSERT(offset == 2);
+  free(r.output);
+  mpc_delete(Record);
+  
+}
+
+static int test_match_folds = 0;
+
+static mpc_val_t *test_match_fold(int n, mpc_val_t **xs) {
+  test_match_folds++;
+  return mpcf_strfold(n, xs);
+}
+
+void test_match(void) {
+  
+  mpc_result_t r;
+  mpc_err_t *e;
+  char *es0, *es1;
+  mpc_parser_t *Pair = mpc_and(3, test_match_fold,
+    mpc_many1(test_match_fold, mpc_digit()), mpc_char(','),
+    mpc_many1(test_match_fold, mpc_digit()), free, free);
+  
+  PT_ASSERT(mpc_match("<test>", "12,34", Pair, NULL));
+  PT_ASSERT(mpc_match_n("<test>", "1,2garbage", 3, Pair, &e));
+  PT_ASSERT(test_match_folds == 0);
+  
+  PT_ASSERT(!mpc_match("<test>", "12;34", Pair, &e));
+  PT_ASSERT(!mpc_parse("<test>", "12;34", Pair, &r));
+  es0 = mpc_err_string(e);
+  es1 = mpc_err_string(r.error);
+  PT_ASSERT_STR_EQ(es0, es1);
+  free(es0); free(es1);
+  mpc_err_delete(e);
+  mpc_err_delete(r.error);
+  
+  PT_ASSERT(!mpc_match("<test>", "12", Pair, NULL));
+  
+  mpc_delete(Pair);
+  
+}
+
+void test_ctx(void) {
+  
+  int i;
+  mpc_result_t r0, r1;
+  char *es0, *es1;
+  mpc_ctx_t *c = mpc_ctx_new();
+  mpc_parser_t *Pair = mpc_and(3, mpcf_strfold,
+    mpc_many1(mpcf_strfold, mpc_digit()), mpc_char(','),
+    mpc_many1(mpcf_strfold, mpc_digit()), free, free);
+  
+  for (i = 0; i < 3; i++) {
+    PT_ASSERT(mpc_ctx_parse(c, "<test>", "12,34", Pair, &r0));
+    PT_ASSERT_STR_EQ(r0.output, "12,34");
+    free(r0.output);
+    PT_ASSERT(mpc_ctx_parse_n(c, "<test>", "1,2garbage", 3, Pair, &r0));
+    PT_ASSERT_STR_EQ(r0.output, "1,2");
+    free(r0.output);
+  }
+  
+  PT_ASSERT(!mpc_ctx_parse(c, "<other>", "12;\n34", Pair, &r0));
+  PT_ASSERT(!mpc_parse("<other>", "12;\n34", Pair, &r1));
+  es0 = mpc_err_string(r0.error);
+  es1 = mpc_err_string(r1.error);
+  PT_ASSERT_STR_EQ(es0, es1);
+  free(es0); free(es1);
+  mpc_err_delete(r0.error);
+  mpc_err_delete(r1.error);
+  
+  PT_ASSERT(mpc_ctx_match(c, "<test>", "5,6", Pair, NULL));
+  PT_ASSERT(mpc_ctx_match_n(c, "<test>", "5,6", 3, Pair, NULL));
+  PT_ASSERT(!mpc_ctx_match_n(c, "<test>", "5,", 2, Pair, NULL));
+  
+#ifdef TEST_ALLOCS
+  /* Once warm a successful match allocates nothing */
+  PT_ASSERT(mpc_ctx_match(c, "<test>", "123,456", Pair, NULL));
+  test_allocs = 0;
+  for (i = 0; i < 3; i++) {
+    PT_ASSERT(mpc_ctx_match(c, "<test>", "123,456", Pair, NULL));
+    PT_ASSERT(mpc_ctx_match_n(c, "<test>", "1,2garbage", 3, Pair, NULL));
+  }
+  PT_ASSERT(test_allocs == 0);
+#endif
+  
+  mpc_delete(Pair);
+  mpc_ctx_delete(c);
+  
+}
+
+void test_labels(void) {
+  
+  int i;
+  char *es;
+  mpc_result_t r;
+  mpc_ctx_t *c = mpc_ctx_new();
+  mpc_parser_t *Nums;
+  
+  /* Errors keep their labels after the parsers, and the labels made while parsing, are gone */
+  for (i = 0; i < 2; i++) {
+    Nums = mpc_and(2, mpcf_strfold, mpc_many1(mpcf_strfold, mpc_digit()), mpc_count(2, mpcf_strfold, mpc_oneof("+-"), free), free);
+    PT_ASSERT(!mpc_ctx_parse(c, "<test>", "x", Nums, &r));
+    mpc_delete(Nums);
+    es = mpc_err_string(r.error);
+    PT_ASSERT_STR_EQ(es, "<test>:1:1: error: expected one or more of digit at 'x'\n");
+    free(es);
+    mpc_err_delete(r.error);
+  }
+  
+  Nums = mpc_and(2, mpcf_strfold, mpc_many1(mpcf_strfold, mpc_digit()), mpc_count(2, mpcf_strfold, mpc_oneof("+-"), free), free);
+  PT_ASSERT(!mpc_ctx_parse(c, "<test>", "12+", Nums, &r));
+  es = mpc_err_string(r.error);
+  PT_ASSERT_STR_EQ(es, "<test>:1:4: error: expected 2 of one of '+-' at end of input\n");
+  free(es);
+  mpc_err_delete(r.error);
+  
+  mpc_delete(Nums);
+  mpc_ctx_delete(c);
+  
+}
+
+static int test_find_all_found(size_t start, size_t end, mpc_val_t *x, void *data) {
+  char *found = data;
+  sprintf(found + strlen(found), "%lu-%lu:%s ", (unsigned long)start, (unsigned long)end, (char*)x);
+  free(x);
+  return 1;
+}
+
+void test_search(void) {
+  
+  mpc_result_t r;
+  size_t offset = 0, start = 0;
+  char found[64] = "";
+  const char *text = "ab 12 cd 345\nx6";
+  mpc_parser_t *Number = mpc_many1(mpcf_strfold, mpc_digit());
+  mpc_parser_t *Word = mpc_and(2, mpcf_snd, mpc_boundary(), mpc_many1(mpcf_strfold, mpc_alpha()), free);
+  mpc_parser_t *Digits = mpc_many(mpcf_strfold, mpc_digit());
+  mpc_parser_t *Literal = mpc_string("45");
+  
+  PT_ASSERT(mpc_search("<test>", text, 15, &offset, &start, Number, &r));
+  PT_ASSERT(start == 3 && offset == 5);
+  PT_ASSERT_STR_EQ(r.output, "12");
+  free(r.output);
+  
+  PT_ASSERT(mpc_search("<test>", text, 15, &offset, &start, Number, &r));
+  PT_ASSERT(start == 9 && offset == 12);
+  free(r.output);
+  
+  PT_ASSERT(mpc_search("<test>", text, 15, &offset, &start, Word, &r));
+  PT_ASSERT(start == 13 && offset == 14);
+  PT_ASSERT(r.output && ((char*)r.output)[0] == 'x');
+  free(r.output);
+  
+  PT_ASSERT(!mpc_search("<test>", text, 15, &offset, &start, Word, &r));
+  PT_ASSERT(offset == 14);
+  mpc_err_delete(r.error);
+  
+  offset = 0;
+  PT_ASSERT(mpc_search("<test>", text, 15, &offset, &start, Literal, &r));
+  PT_ASSERT(start == 10 && offset == 12);
+  free(r.output);
+  
+  PT_ASSERT(mpc_find_all("<test>", text, 15, Number, test_find_all_found, found) == 3);
+  PT_ASSERT_STR_EQ(found, "3-5:12 9-12:345 14-15:6 ");
+  
+  found[0] = '\0';
+  PT_ASSERT(mpc_find_all("<test>", "1a22", 4, Digits, test_find_all_found, found) == 4);
+  PT_ASSERT_STR_EQ(found, "0-1:1 1-1: 2-4:22 4-4: ");
+  
+  mpc_delete(Number);
+  mpc_delete(Word);
+  mpc_delete(Digits);
+  mpc_delete(Literal);
+  
+}
+
+void test_limit(void) {
+  
+  int j;
+  char input[401];
+  mpc_result_t r;
+  mpc_limits_t steps = { 100, 0, 0, 0 };
+  mpc_limits_t depth = { 0, 20, 0, 0 };
+  mpc_limits_t memory = { 0, 0, 0, 1024 };
+  mpc_parser_t *Chars = mpc_many(mpcf_strfold, mpc_any());
+  mpc_parser_t *Steps = mpc_limit(Chars, free, &steps);
+  mpc_parser_t *Memory = mpc_limit(mpc_many(mpcf_strfold, mpc_and(2, mpcf_strfold, mpc_char('a'), mpc_char('b'), free)), free, &memory);
+  mpc_parser_t *Nested = mpc_new("nested");
+  mpc_parser_t *Depth = mpc_limit(Nested, free, &depth);
+  
+  mpc_define(Nested, mpc_or(2,
+    mpc_and(3, mpcf_strfold, mpc_char('('), Nested, mpc_char(')'), free, free),
+    mpc_string("x")));
+  
+  PT_ASSERT(mpc_parse("<test>", "abcdef", Steps, &r));
+  PT_ASSERT_STR_EQ(r.output, "abcdef");
+  free(r.output);
+  
+  PT_ASSERT(!mpc_parse("<test>", "abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz", Steps, &r));
+  PT_ASSERT_STR_EQ(r.error->failure, "Step limit exceeded");
+  mpc_err_delete(r.error);
+  
+  PT_ASSERT(mpc_parse("<test>", "(((x)))", Depth, &r));
+  PT_ASSERT_STR_EQ(r.output, "(((x)))");
+  free(r.output);
+  
+  PT_ASSERT(!mpc_parse("<test>", "((((((((((((((((((((x))))))))))))))))))))", Depth, &r));
+  PT_ASSERT_STR_EQ(r.error->failure, "Depth limit exceeded");
+  mpc_err_delete(r.error);
+  
+  PT_ASSERT(!mpc_match("<test>", "((((((((((((((((((((x))))))))))))))))))))", Depth, NULL));
+  
+  for (j = 0; j < 400; j++) { input[j] = "ab"[j % 2]; }
+  input[400] = '\0';
+  
+  PT_ASSERT(!mpc_parse("<test>", input, Memory, &r));
+  PT_ASSERT_STR_EQ(r.error->failure, "Memory limit exceeded");
+  mpc_err_delete(r.error);
+  
+  mpc_delete(Steps);
+  mpc_delete(Memory);
+  mpc_delete(Depth);
+  mpc_cleanup(1, Nested);
+  
+}
+
+static char *test_analyse_err(mpc_parser_t *p, const char *s) {
+  mpc_result_t r;
+  char *e;
+  if (mpc_parse("<test>", s, p, &r)) { free(r.output); return NULL; }
+  e = mpc_err_string(r.error);
+  mpc_err_delete(r.error);
+  return e;
+}
+
+void test_analyse(void) {
+  
+  int i;
+  char *before[4], *after;
+  const char *inputs[4] = { "x", "", "ab", "1" };
+  mpc_parser_t *Word = mpc_new("word");
+  mpc_parser_t *Value = mpc_new("value");
+  mpc_parser_t *Word2 = mpc_new("word2");
+  mpc_parser_t *Other = mpc_new("other");
+  mpc_parser_t *Both = mpc_new("both");
+  
+  mpc_define(Word, mpc_or(2, mpc_string("ab"), mpc_string("ac")));
+  mpc_define(Value, mpc_or(3, mpc_digits(), mpc_many1(mpcf_strfold, mpc_char('+')), mpc_and(2, mpcf_fst_free, Word, mpc_char('!'), free)));
+  
+  for (i = 0; i < 4; i++) { before[i] = test_analyse_err(Value, inputs[i]); }
+  mpc_analyse(Value);
+  for (i = 0; i < 4; i++) {
+    after = test_analyse_err(Value, inputs[i]);
+    PT_ASSERT((before[i] == NULL) == (after == NULL));
+    if (before[i] && after) { PT_ASSERT_STR_EQ(after, before[i]); }
+    free(before[i]);
+    free(after);
+  }
+  
+  /* Grammars analysed apart are tracked together once a parser using both is analysed */
+  mpc_define(Word2, mpc_or(2, mpc_string("ab"), mpc_string("ac")));
+  mpc_define(Other, mpc_or(2, mpc_char('?'), Word2));
+  mpc_define(Both, mpc_or(2, Word, Word2));
+  mpc_analyse(Other);
+  mpc_analyse(Both);
+  
+  /* Tables no longer apply once a parser has been redefined */
+  mpc_undefine(Word);
+  mpc_define(Word, mpc_string("x"));
+  after = test_analyse_err(Value, "x!");
+  PT_ASSERT(after == NULL);
+  
+  mpc_undefine(Word2);
+  mpc_define(Word2, mpc_string("y"));
+  after = test_analyse_err(Other, "y");
+  PT_ASSERT(after == NULL);
+  
+  mpc_cleanup(5, Word, Value, Word2, Other, Both);
+  
+}
+
+typedef struct {
+  const char *string;
+  size_t length;
+  size_t pos;
+  int seeks;
+} test_source_t;
+
+static size_t test_source_read(void *data, char *buffer, size_t length) {
+  test_source_t *s = data;
+  size_t n = s->length - s->pos;
+  if (n > 3) { n = 3; }
+  if (n > length) { n = length; }
+  memcpy(buffer, s->string + s->pos, n);
+  s->pos += n;
+  return n;
+}
+
+static int test_source_seek(void *data, long offset) {
+  test_source_t *s = data;
+  s->pos = offset;
+  s->seeks++;
+  return 0;
+}
+
+static int test_source_seek_fail(void *data, long offset) {
+  (void) data; (void) offset;
+  return -1;
+}
+
+static mpc_val_t *test_source_fold(int n, mpc_val_t **xs) {
+  int j;
+  for (j = 0; j < n; j++) { free(xs[j]); }
+  return NULL;
+}
+
+void test_source(void) {
+  
+  char *big;
+  mpc_result_t r;
+  test_source_t data;
+  mpc_source_t source;
+  mpc_parser_t *Words = mpc_or(2,
+    mpc_and(2, mpcf_strfold, mpc_many(mpcf_strfold, mpc_alpha()), mpc_char('!'), free),
+    mpc_and(2, mpcf_strfold, mpc_many(mpcf_strfold, mpc_alpha()), mpc_char('?'), free));
+  mpc_parser_t *Skip = mpc_or(2,
+    mpc_and(2, test_source_fold, mpc_many(test_source_fold, mpc_alpha()), mpc_char('!'), free),
+    mpc_and(2, test_source_fold, mpc_many(test_source_fold, mpc_alpha()), mpc_char('?'), free));
+  
+  data.string = "abcdefghij?";
+  data.length = strlen(data.string);
+  data.pos = 0;
+  data.seeks = 0;
+  
+  source.data = &data;
+  source.read = test_source_read;
+  source.seek = NULL;
+  source.size = NULL;
+  
+  PT_ASSERT(mpc_parse_source("<test>", &source, Words, &r));
+  PT_ASSERT_STR_EQ(r.output, "abcdefghij?");
+  free(r.output);
+  
+  data.pos = 0;
+  source.seek = test_source_seek;
+  
+  PT_ASSERT(mpc_parse_source("<test>", &source, Words, &r));
+  PT_ASSERT_STR_EQ(r.output, "abcdefghij?");
+  free(r.output);
+  
+  /* Backtracking past the cached pages evicts them and seeks back */
+  big = malloc(400001);
+  memset(big, 'a', 400000);
+  big[400000] = '?';
+  data.string = big;
+  data.length = 400001;
+  data.pos = 0;
+  data.seeks = 0;
+  
+  PT_ASSERT(mpc_parse_source("<test>", &source, Skip, &r));
+  PT_ASSERT(r.output == NULL);
+  PT_ASSERT(data.seeks > 0);
+  
+  /* If that seek fails so does the parse */
+  data.pos = 0;
+  source.seek = test_source_seek_fail;
+  
+  PT_ASSERT(!mpc_parse_source("<test>", &source, Skip, &r));
+  PT_ASSERT_STR_EQ(r.error->failure, "Unable to seek input!");
+  mpc_err_delete(r.error);
+  free(big);
+  
+  mpc_delete(Words);
+  mpc_delete(Skip);
+  
+}
+
+void test_pipe(void) {
+  
+  FILE *f;
+  long j, k;
+  mpc_result_t r;
+  mpc_limits_t window = { 0, 0, 8192, 0 };
+  mpc_limits_t lines = { 0, 0, 8192, 1048576 };
+  mpc_parser_t *Pair = mpc_or(2,
+    mpc_and(3, test_source_fold, mpc_char('a'), mpc_char('b'), mpc_char('!'), free, free),
+    mpc_and(2, test_source_fold, mpc_char('a'), mpc_char('b'), free));
+  mpc_parser_t *Pairs = mpc_limit(mpc_many(test_source_fold, Pair), free, &window);
+  
+  f = tmpfile();
+  PT_ASSERT(f != NULL);
+  if (f == NULL) { mpc_delete(Pairs); return; }
+  
+  /* Each pair backtracks, but the buffer only keeps what a mark still needs */
+  for (j = 0; j < 100000; j++) { fputs("ab", f); }
+  rewind(f);
+  
+  PT_ASSERT(mpc_parse_pipe("<test>", f, Pairs, &r));
+  PT_ASSERT(r.output == NULL);
+  PT_ASSERT(fgetc(f) == EOF);
+  
+  fclose(f);
+  mpc_delete(Pairs);
+  
+  Pair = mpc_or(2,
+    mpc_and(3, test_source_fold, mpc_char('a'), mpc_char('b'), mpc_char('!'), free, free),
+    mpc_and(3, test_source_fold, mpc_char('a'), mpc_char('b'), mpc_many(test_source_fold, mpc_newline()), free, free));
+  Pairs = mpc_limit(mpc_and(2, mpcf_snd_free, mpc_many(test_source_fold, Pair), mpc_state(), free), free, &lines);
+  mpc_analyse(Pairs);
+  
+  f = tmpfile();
+  PT_ASSERT(f != NULL);
+  if (f == NULL) { mpc_delete(Pairs); return; }
+  
+  /* The newline index only covers what the buffer still holds, so stays well inside the memory limit */
+  for (j = 0; j < 10000; j++) {
+    fputs("ab", f);
+    for (k = 0; k < 40; k++) { fputc('\n', f); }
+  }
+  rewind(f);
+  
+  PT_ASSERT(mpc_parse_pipe("<test>", f, Pairs, &r));
+  PT_ASSERT(((mpc_state_t*)r.output)->pos == 420000);
+  PT_ASSERT(((mpc_state_t*)r.output)->row == 400000);
+  PT_ASSERT(((mpc_state_t*)r.output)->col == 0);
+  free(r.output);
+  
+  fclose(f);
+  mpc_delete(Pairs);
+  
+}
+
+static mpc_val_t *test_lines_fold(int n, mpc_val_t **xs) {
+  int j;
+  for (j = 0; j < n-1; j++) { free(xs[j]); }
+  return xs[n-1];
+}
+
+void test_lines(void) {
+  
+  FILE *f;
+  long j;
+  char *input;
+  mpc_result_t r;
+  mpc_state_t *s;
+  mpc_parser_t *Line = mpc_or(2,
+    mpc_and(3, test_source_fold, mpc_string("ab"), mpc_char('!'), mpc_newline(), free, free),
+    mpc_and(2, test_source_fold, mpc_string("ab"), mpc_newline(), free));
+  mpc_parser_t *Back = mpc_or(2,
+    mpc_and(2, test_lines_fold, mpc_many(test_source_fold, mpc_any()), mpc_char('!'), free),
+    mpc_and(2, test_lines_fold, mpc_string("ab\nab\nab"), mpc_state(), free));
+  mpc_parser_t *End = mpc_and(2, test_lines_fold, mpc_many(test_source_fold, Line), mpc_state(), free);
+  
+  input = malloc(60001);
+  for (j = 0; j < 20000; j++) { memcpy(input + j * 3, "ab\n", 3); }
+  input[60000] = '\0';
+  
+  /* Positions before the furthest point read are found after backtracking */
+  PT_ASSERT(mpc_parse("<test>", input, Back, &r));
+  s = r.output;
+  PT_ASSERT(s->pos == 8 && s->row == 2 && s->col == 2);
+  free(s);
+  
+  PT_ASSERT(mpc_parse("<test>", input, End, &r));
+  s = r.output;
+  PT_ASSERT(s->pos == 60000 && s->row == 20000 && s->col == 0);
+  free(s);
+  
+  f = tmpfile();
+  PT_ASSERT(f != NULL);
+  if (f == NULL) { free(input); mpc_delete(Back); mpc_delete(End); return; }
+  fputs(input, f);
+  
+  /* Streamed input keeps its newlines counted after the buffer moves on */
+  rewind(f);
+  PT_ASSERT(mpc_parse_pipe("<test>", f, Back, &r));
+  s = r.output;
+  PT_ASSERT(s->pos == 8 && s->row == 2 && s->col == 2);
+  free(s);
+  
+  rewind(f);
+  PT_ASSERT(mpc_parse_pipe("<test>", f, End, &r));
+  s = r.output;
+  PT_ASSERT(s->pos == 60000 && s->row == 20000 && s->col == 0);
+  free(s);
+  
+  fclose(f);
+  free(input);
+  mpc_delete(Back);
+  mpc_delete(End);
+  
+}
+
+void test_prefetch(void) {
+  
+  FILE *f;
+  long j;
+#ifdef TEST_IOV
+  int fds[2];
+#endif
+  mpc_result_t r;
+  mpc_parser_t *Pair = mpc_or(2,
+    mpc_and(3, test_source_fold, mpc_char('a'), mpc_char('b'), mpc_char('!'), free, free),
+    mpc_and(2, test_source_fold, mpc_char('a'), mpc_char('b'), free));
+  mpc_parser_t *Pairs = mpc_and(2, test_lines_fold,
+    mpc_many(test_source_fold, Pair), mpc_many1(mpcf_strfold, mpc_digit()), free);
+  
+  f = tmpfile();
+  PT_ASSERT(f != NULL);
+  if (f == NULL) { mpc_delete(Pairs); return; }
+  
+  /* Spans many of the blocks the reader hands over */
+  for (j = 0; j < 100000; j++) { fputs("ab", f); }
+  fputs("123", f);
+  rewind(f);
+  
+  PT_ASSERT(mpc_parse_prefetch("<test>", f, Pairs, &r));
+  PT_ASSERT_STR_EQ(r.output, "123");
+  free(r.output);
+  
+  rewind(f);
+  fputs("ab?", f);
+  rewind(f);
+  
+  PT_ASSERT(!mpc_parse_prefetch("<test>", f, Pairs, &r));
+  PT_ASSERT(r.error->state.pos == 2);
+  mpc_err_delete(r.error);
+  
+  fclose(f);
+  
+#ifdef TEST_IOV
+  /* Failing early returns even though the reader is waiting on a stream that is still open */
+  PT_ASSERT(pipe(fds) == 0);
+  PT_ASSERT(write(fds[1], "ab?", 3) == 3);
+  f = fdopen(fds[0], "r");
+  PT_ASSERT(f != NULL);
+  
+  PT_ASSERT(!mpc_parse_prefetch("<test>", f, Pairs, &r));
+  PT_ASSERT(r.error->state.pos == 2);
+  mpc_err_delete(r.error);
+  
+  close(fds[1]);
+  fclose(f);
+#endif
+  
+  mpc_delete(Pairs);
+  
+}
+
+void test_file(void) {
+  
+  FILE *f;
+  mpc_result_t r;
+  mpc_parser_t *Alnum = mpc_or(2,
+    mpc_and(2, mpcf_strfold, mpc_many(mpcf_strfold, mpc_alpha()), mpc_char('!'), free),
+    mpc_and(2, mpcf_strfold, mpc_many(mpcf_strfold, mpc_alpha()), mpc_many1(mpcf_strfold, mpc_digit()), free));
+  
+  f = tmpfile();
+  PT_ASSERT(f != NULL);
+  if (f == NULL) { mpc_delete(Alnum); return; }
+  
+  /* The mapping starts part way in and backtracks to its start */
+  fputs("xxabc123 rest", f);
+  fseek(f, 2, SEEK_SET);
+  
+  PT_ASSERT(mpc_parse_file("<test>", f, Alnum, &r));
+  PT_ASSERT_STR_EQ(r.output, "abc123");
+  free(r.output);
+  PT_ASSERT(ftell(f) == 8);
+  
+  PT_ASSERT(!mpc_parse_file("<test>", f, Alnum, &r));
+  PT_ASSERT(r.error->state.pos == 0);
+  mpc_err_delete(r.error);
+  
+  fclose(f);
+  mpc_delete(Alnum);
+  
+}
+
+#ifdef TEST_IOV
+
+void test_iov(void) {
+  
+  mpc_result_t r;
+  struct iovec iov[4];
+  mpc_parser_t *Lit = mpc_or(2,
+    mpc_and(2, mpcf_strfold, mpc_string("abcdx"), mpc_many(mpcf_strfold, mpc_any()), free),
+    mpc_and(2, mpcf_strfold, mpc_string("abcde"), mpc_many(mpcf_strfold, mpc_any()), free));
+  
+  iov[0].iov_base = (void*)"ab"; iov[0].iov_len = 2;
+  iov[1].iov_base = (void*)"";   iov[1].iov_len = 0;
+  iov[2].iov_base = (void*)"cde"; iov[2].iov_len = 3;
+  iov[3].iov_base = (void*)"fg";  iov[3].iov_len = 2;
+  
+  PT_ASSERT(mpc_parse_iov("<test>", iov, 4, Lit, &r));
+  PT_ASSERT_STR_EQ(r.output, "abcdefg");
+  free(r.output);
+  
+  mpc_delete(Lit);
+  
+}
+
+#endif
+
 void suite_core(void) {
   pt_add_test(test_ident, "Test Ident", "Suite Core");
   pt_add_test(test_maths, "Test Maths", "Suite Core");
   pt_add_test(test_strip, "Test Strip", "Suite Core");
+  pt_add_test(test_parse_n, "Test Parse N", "Suite Core");
+  pt_add_test(test_parse_prefix, "Test Parse Prefix", "Suite Core");
+  pt_add_test(test_match, "Test Match", "Suite Core");
+  pt_add_test(test_ctx, "Test Ctx", "Suite Core");
+  pt_add_test(test_labels, "Test Labels", "Suite Core");
+  pt_add_test(test_search, "Test Search", "Suite Core");
+  pt_add_test(test_limit, "Test Limit", "Suite Core");
+  pt_add_test(test_analyse, "Test Analyse", "Suite Core");
+  pt_add_test(test_source, "Test Source", "Suite Core");
+  pt_add_test(test_file, "Test File", "Suite Core");
+  pt_add_test(test_pipe, "Test Pipe", "Suite Core");
+  pt_add_test(test_lines, "Test Lines", "Suite Core");
+  pt_add_test(test_prefetch, "Test Prefetch", "Suite Core");
+#ifdef TEST_IOV
+  pt_add_test(test_iov, "Test Iov", "Suite Core");
+#endif
 }
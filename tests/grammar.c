@@ -1,3 +1,11 @@
+#if defined(__unix__) || defined(__unix) || (defined(__APPLE__) && defined(__MACH__))
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+#include <pthread.h>
+#define TEST_THREADS
+#endif
+
 #include "ptest.h"
 #include "../mpc.h"
 
@@ -91,8 +99,378 @@ void test_language_file(void) {
   
 }
 
+/*
+** Fixture shared by the tests of the other parsing
+** strategies. Every `num` parsed is counted, so that
+** the amount of reparsing can be checked.
+*/
+
+typedef struct {
+  mpc_parser_t *exp;
+  mpc_parser_t *lexp;
+  mpc_parser_t *cmp;
+  mpc_parser_t *num;
+} test_cmp_t;
+
+static int test_nums = 0;
+
+static mpc_val_t *test_num_count(mpc_val_t *x) {
+  test_nums++;
+  return x;
+}
+
+static void test_cmp_new(test_cmp_t *g, const char *flags) {
+  
+  char lang[256];
+  
+  g->exp  = mpc_new("exp");
+  g->lexp = mpc_new("lexp");
+  g->cmp  = mpc_new("cmp");
+  g->num  = mpc_new("num");
+  
+  mpc_define(g->num, mpc_apply(mpca_grammar(MPCA_LANG_DEFAULT, " /[0-9]+/ "), test_num_count));
+  
+  sprintf(lang,
+    " exp     : <lexp> '>' <lexp> | <lexp> '<' <lexp> | <lexp> ; "
+    " lexp %s : <num> ('+' <num>)* ;                            "
+    " cmp     : /^/ <exp> /$/ ;                                 ", flags);
+  
+  mpca_lang(MPCA_LANG_DEFAULT, lang, g->exp, g->lexp, g->cmp, g->num);
+  test_nums = 0;
+}
+
+static void test_cmp_delete(test_cmp_t *g) {
+  mpc_cleanup(4, g->exp, g->lexp, g->cmp, g->num);
+}
+
+/*
+** Parses `input` with `p0` and `p1`, checking that both
+** give the same tree or both give the same error.
+*/
+
+static int test_cmp_same(
+  mpc_parser_t *p0, mpc_parser_t *p1,
+  int (*parse)(const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r),
+  const char *input) {
+  
+  int x0, x1, same;
+  mpc_result_t r0, r1;
+  char *e0, *e1;
+  
+  x0 = mpc_parse("<test>", input, p0, &r0);
+  x1 = parse("<test>", input, p1, &r1);
+  
+  if (x0 && x1) {
+    same = mpc_ast_eq(r0.output, r1.output);
+  } else if (!x0 && !x1) {
+    e0 = mpc_err_string(r0.error);
+    e1 = mpc_err_string(r1.error);
+    same = strcmp(e0, e1) == 0;
+    free(e0);
+    free(e1);
+  } else {
+    same = 0;
+  }
+  
+  if (x0) { mpc_ast_delete(r0.output); } else { mpc_err_delete(r0.error); }
+  if (x1) { mpc_ast_delete(r1.output); } else { mpc_err_delete(r1.error); }
+  return same;
+}
+
+void test_packrat(void) {
+  
+  test_cmp_t g;
+  mpc_parser_t *Packrat;
+  mpc_result_t r;
+  
+  test_cmp_new(&g, "");
+  Packrat = mpca_packrat(g.cmp);
+  
+  /* Every alternative of `exp` parses the first `lexp` again */
+  PT_ASSERT(mpc_parse("<test>", "1+2+3<4", g.cmp, &r));
+  mpc_ast_delete(r.output);
+  PT_ASSERT(test_nums == 7);
+  
+  /* Packrat parsing reuses it, and each `num` in it */
+  test_nums = 0;
+  PT_ASSERT(mpc_parse("<test>", "1+2+3<4", Packrat, &r));
+  mpc_ast_delete(r.output);
+  PT_ASSERT(test_nums == 4);
+  
+  PT_ASSERT(test_cmp_same(g.cmp, Packrat, mpc_parse, "1+2+3<4"));
+  PT_ASSERT(test_cmp_same(g.cmp, Packrat, mpc_parse, "1+2+3=4"));
+  PT_ASSERT(test_cmp_same(g.cmp, Packrat, mpc_parse, "1+2+"));
+  
+  mpc_delete(Packrat);
+  test_cmp_delete(&g);
+  
+}
+
+void test_memo(void) {
+  
+  test_cmp_t g0, g1;
+  mpc_result_t r;
+  
+  test_cmp_new(&g0, "");
+  test_cmp_new(&g1, "@memo");
+  
+  /* Only `lexp` is remembered, so it is parsed once per position */
+  PT_ASSERT(mpc_parse("<test>", "1+2+3<4+5", g1.cmp, &r));
+  mpc_ast_delete(r.output);
+  PT_ASSERT(test_nums == 5);
+  
+  test_nums = 0;
+  PT_ASSERT(mpc_parse("<test>", "1+2+3<4+5", g0.cmp, &r));
+  mpc_ast_delete(r.output);
+  PT_ASSERT(test_nums == 8);
+  
+  PT_ASSERT(test_cmp_same(g0.cmp, g1.cmp, mpc_parse, "1+2+3<4+5"));
+  PT_ASSERT(test_cmp_same(g0.cmp, g1.cmp, mpc_parse, "1+2+3<"));
+  PT_ASSERT(test_cmp_same(g0.cmp, g1.cmp, mpc_parse, "1+2+3>4+"));
+  
+  test_cmp_delete(&g0);
+  test_cmp_delete(&g1);
+  
+}
+
+static void test_recovered_delete(mpc_err_t **es, int n) {
+  int i;
+  for (i = 0; i < n; i++) { mpc_err_delete(es[i]); }
+  free(es);
+}
+
+void test_recover(void) {
+  
+  mpc_parser_t *Num, *Stmt, *Group, *Prog;
+  mpc_result_t r;
+  mpc_err_t **es;
+  FILE *f;
+  int n;
+  
+  Num   = mpc_new("num");
+  Stmt  = mpc_new("stmt");
+  Group = mpc_new("group");
+  Prog  = mpc_new("prog");
+  
+  mpca_lang(MPCA_LANG_DEFAULT,
+    " num              : /[0-9]+/ ;                                 "
+    " stmt @recover ';' : \"let\" <num> ';' ;                         "
+    " group @memo      : '(' <stmt>* ')' ;                          "
+    " prog             : /^/ (<group> '!' | <group> '?' | <stmt>*) /$/ ; ",
+    Num, Stmt, Group, Prog);
+  
+  PT_ASSERT(mpc_parse_recover("<test>", "let 1; let x; let 3; let ; let 5;", Prog, &r, &es, &n));
+  PT_ASSERT(n == 2);
+  PT_ASSERT(es[0]->state.col == 11);
+  PT_ASSERT(es[1]->state.col == 25);
+  PT_ASSERT(((mpc_ast_t*)r.output)->children_num == 7);
+  PT_ASSERT(strcmp(((mpc_ast_t*)r.output)->children[2]->tag, "stmt|error") == 0);
+  PT_ASSERT(strcmp(((mpc_ast_t*)r.output)->children[2]->contents, "let x") == 0);
+  test_recovered_delete(es, n);
+  mpc_ast_delete(r.output);
+  
+  PT_ASSERT(!mpc_parse("<test>", "let 1; let x;", Prog, &r));
+  mpc_err_delete(r.error);
+  
+  /* The first alternative fails after recovering, but the memoized group keeps its error for the second */
+  PT_ASSERT(mpc_parse_recover("<test>", "(let 1; let x;)?", Prog, &r, &es, &n));
+  PT_ASSERT(n == 1);
+  PT_ASSERT(es[0]->state.col == 12);
+  test_recovered_delete(es, n);
+  mpc_ast_delete(r.output);
+  
+  mpc_cleanup(4, Num, Stmt, Group, Prog);
+  
+  /* Without the group, errors in the branch backtracked out of are dropped */
+  Num   = mpc_new("num");
+  Stmt  = mpc_new("stmt");
+  Prog  = mpc_new("prog");
+  
+  mpca_lang(MPCA_LANG_DEFAULT,
+    " num              : /[0-9]+/ ;                            "
+    " stmt @recover ';' : \"let\" <num> ';' ;                    "
+    " prog             : /^/ ('(' <stmt>* ')' '!' | /\\([^)]*\\)\\?/) /$/ ; ",
+    Num, Stmt, Prog);
+  
+  PT_ASSERT(mpc_parse_recover("<test>", "(let 1; let x;)?", Prog, &r, &es, &n));
+  PT_ASSERT(n == 0);
+  PT_ASSERT(es == NULL);
+  mpc_ast_delete(r.output);
+  
+  PT_ASSERT(mpc_parse_recover("<test>", "(let 1; let x;)!", Prog, &r, &es, &n));
+  PT_ASSERT(n == 1);
+  test_recovered_delete(es, n);
+  mpc_ast_delete(r.output);
+  
+  /* Files and pipes recover the same way */
+  f = tmpfile();
+  PT_ASSERT(f != NULL);
+  if (f == NULL) { mpc_cleanup(3, Num, Stmt, Prog); return; }
+  
+  fputs("(let x; let 2; let ;)!", f);
+  rewind(f);
+  PT_ASSERT(mpc_parse_recover_file("<test>", f, Prog, &r, &es, &n));
+  PT_ASSERT(n == 2);
+  PT_ASSERT(es[1]->state.col == 19);
+  test_recovered_delete(es, n);
+  mpc_ast_delete(r.output);
+  
+  rewind(f);
+  PT_ASSERT(mpc_parse_recover_pipe("<test>", f, Prog, &r, &es, &n));
+  PT_ASSERT(n == 2);
+  test_recovered_delete(es, n);
+  mpc_ast_delete(r.output);
+  
+  fclose(f);
+  mpc_cleanup(3, Num, Stmt, Prog);
+  
+}
+
+void test_earley(void) {
+  
+  test_cmp_t g;
+  mpc_parser_t *Num, *Sub, *Line, *Xs, *Ys, *Pick, *Last;
+  mpc_result_t r;
+  mpc_ast_t *t;
+  
+  test_cmp_new(&g, "");
+  
+  PT_ASSERT(test_cmp_same(g.cmp, g.cmp, mpc_parse_earley, "1+2+3<4"));
+  PT_ASSERT(test_cmp_same(g.cmp, g.cmp, mpc_parse_earley, "1+2+3=4"));
+  PT_ASSERT(test_cmp_same(g.cmp, g.cmp, mpc_parse_earley, "1+2+"));
+  
+  test_cmp_delete(&g);
+  
+  /* Left recursion */
+  Num  = mpc_new("num");
+  Sub  = mpc_new("sub");
+  Line = mpc_new("line");
+  
+  mpca_lang(MPCA_LANG_DEFAULT,
+    " num  : /[0-9]+/ ;                "
+    " sub  : <sub> '-' <num> | <num> ; "
+    " line : /^/ <sub> /$/ ;           ",
+    Num, Sub, Line);
+  
+  PT_ASSERT(mpc_parse_earley("<test>", "5-2-1", Line, &r));
+  t = r.output;
+  PT_ASSERT_STR_EQ(t->children[1]->tag, "sub|>");
+  PT_ASSERT_STR_EQ(t->children[1]->children[0]->tag, "sub|>");
+  PT_ASSERT_STR_EQ(t->children[1]->children[0]->children[0]->contents, "5");
+  PT_ASSERT_STR_EQ(t->children[1]->children[2]->contents, "1");
+  mpc_ast_delete(r.output);
+  
+  PT_ASSERT(!mpc_parse_earley("<test>", "5-2-", Line, &r));
+  mpc_err_delete(r.error);
+  
+  mpc_cleanup(3, Num, Sub, Line);
+  
+  /* Ambiguity goes to the earlier alternative and the longer first part */
+  Xs   = mpc_new("xs");
+  Ys   = mpc_new("ys");
+  Pick = mpc_new("pick");
+  Last = mpc_new("last");
+  
+  mpca_lang(MPCA_LANG_DEFAULT,
+    " xs   : 'x'* ;                     "
+    " ys   : 'x'+ ;                     "
+    " pick : /^/ (<ys> | <xs>) <xs> /$/ ; "
+    " last : /^/ <xs> 'x' /$/ ;         ",
+    Xs, Ys, Pick, Last);
+  
+  PT_ASSERT(mpc_parse_earley("<test>", "xxx", Pick, &r));
+  t = r.output;
+  PT_ASSERT_STR_EQ(t->children[1]->tag, "ys|>");
+  PT_ASSERT(t->children[1]->children_num == 3);
+  PT_ASSERT(t->children[2]->children_num == 0);
+  mpc_ast_delete(r.output);
+  
+  /* Unlike mpc_parse the repetition is not committed to */
+  PT_ASSERT(!mpc_parse("<test>", "xxx", Last, &r));
+  mpc_err_delete(r.error);
+  
+  PT_ASSERT(mpc_parse_earley("<test>", "xxx", Last, &r));
+  t = r.output;
+  PT_ASSERT_STR_EQ(t->children[1]->tag, "xs|>");
+  PT_ASSERT(t->children[1]->children_num == 2);
+  mpc_ast_delete(r.output);
+  
+  mpc_cleanup(4, Xs, Ys, Pick, Last);
+  
+}
+
+#ifdef TEST_THREADS
+
+/* Builds, runs and deletes a grammar over and over, counting wrong results */
+static void *test_threads_run(void *data) {
+  
+  int j, *wrong = data;
+  char *es;
+  mpc_result_t r;
+  mpc_parser_t *Expr, *Prod, *Value, *Maths;
+  
+  for (j = 0; j < 200; j++) {
+    
+    Expr  = mpc_new("expression");
+    Prod  = mpc_new("product");
+    Value = mpc_new("value");
+    Maths = mpc_new("maths");
+    
+    mpca_lang(MPCA_LANG_DEFAULT,
+      " expression : <product> (('+' | '-') <product>)*; "
+      " product : <value>   (('*' | '/')   <value>)*;    "
+      " value : /[0-9]/+ | '(' <expression> ')';         "
+      " maths : /^/ <expression> /$/;                    ",
+      Expr, Prod, Value, Maths);
+    
+    if (mpc_parse("<test>", "(1+2)*3", Maths, &r)) {
+      mpc_ast_delete(r.output);
+    } else {
+      mpc_err_delete(r.error);
+      (*wrong)++;
+    }
+    
+    if (mpc_parse("<test>", "(1+)", Maths, &r)) {
+      mpc_ast_delete(r.output);
+      (*wrong)++;
+    } else {
+      es = mpc_err_string(r.error);
+      if (strcmp(es, "<test>:1:4: error: expected whitespace, one or more of one of '0123456789' or '(' at ')'\n") != 0) { (*wrong)++; }
+      free(es);
+      mpc_err_delete(r.error);
+    }
+    
+    mpc_cleanup(4, Expr, Prod, Value, Maths);
+  }
+  
+  return NULL;
+}
+
+void test_threads(void) {
+  
+  int wrong[2] = { 0, 0 };
+  pthread_t t0, t1;
+  
+  PT_ASSERT(pthread_create(&t0, NULL, test_threads_run, &wrong[0]) == 0);
+  PT_ASSERT(pthread_create(&t1, NULL, test_threads_run, &wrong[1]) == 0);
+  pthread_join(t0, NULL);
+  pthread_join(t1, NULL);
+  
+  PT_ASSERT(wrong[0] == 0);
+  PT_ASSERT(wrong[1] == 0);
+}
+
+#endif
+
 void suite_grammar(void) {
   pt_add_test(test_grammar, "Test Grammar", "Suite Grammar");
   pt_add_test(test_language, "Test Language", "Suite Grammar");
   pt_add_test(test_language_file, "Test Language File", "Suite Grammar");
+  pt_add_test(test_packrat, "Test Packrat", "Suite Grammar");
+  pt_add_test(test_memo, "Test Memo", "Suite Grammar");
+  pt_add_test(test_recover, "Test Recover", "Suite Grammar");
+  pt_add_test(test_earley, "Test Earley", "Suite Grammar");
+#ifdef TEST_THREADS
+  pt_add_test(test_threads, "Test Threads", "Suite Grammar");
+#endif
 }